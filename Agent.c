@@ -24,24 +24,80 @@
 #include "Uart1.h"
 #include "Negotiation.h"
 #include "Field.h"
+#include "GuessEngine.h"
+#include "PlacementSampler.h"
+#include "OpponentModel.h"
+#include "LinkLayer.h"
+
+/**
+ * A guess engine search started ahead of time, along with the key of the opponent field it was
+ * started from and the time spent on it so far.
+ */
+struct Speculation {
+    uint8_t valid;
+    uint32_t key;
+    uint32_t ticks;
+};
 
 struct Agent {
     AgentState state;
     NegotiationData secret;
     NegotiationData hash;
+    NegotiationWideData wideSecret; // A or B for the strong commitment
+    NegotiationWideData commitment; // the challenger's strong commitment
     Field own;
     Field other;
     Message message;
+    uint8_t capabilities; // protocol extensions agreed on for this game
+    uint16_t linkBrg; // UART rate for the fast link extension
+    struct Speculation speculation;
 };
 
 static struct Agent agent;
 static int turnCount = 0;;
 static char *errorMSG;
 static FieldOledTurn turn;
+static AgentSpeculationStats speculationStats;
+static uint8_t gamesUnsaved; // games folded into the opponent model since it was last saved
+static uint8_t offeredCapabilities = AGENT_OFFERED_CAPABILITIES;
 
 #define RAND_SIZE 0xFFFF
 #define ALL_SUNK 0b00000000
 
+// noise between messages is only skipped, see Message_UseResync(), with an extension that notices
+// a message lost to it.  Otherwise it is reported, and the game ends on the error screen
+#define AGENT_RESYNC_CAPABILITIES (MESSAGE_CAPABILITY_RELIABLE | MESSAGE_CAPABILITY_CRC)
+
+// free-running tick counter used to time guess computations
+#ifdef PIC32
+#define AGENT_TICKS() _CP0_GET_COUNT()
+#define AGENT_TICKS_PER_MS (BOARD_GetSysClock() / 2000)
+#else
+#include <time.h>
+#define AGENT_TICKS() ((uint32_t) clock())
+#define AGENT_TICKS_PER_MS (CLOCKS_PER_SEC / 1000)
+#endif
+
+// placements evaluated per guess engine step, or samples drawn per placement sampler step, small
+// enough not to delay event handling
+#define GUESS_STEP 32
+#define SAMPLE_STEP 2
+
+// the search behind our shots, the guess engine, or the placement sampler with FIELD_AI_SAMPLES
+#if FIELD_AI_SAMPLES > 0
+#define SEARCH_BEGIN(field) PlacementSamplerBegin(field, FIELD_AI_SAMPLES)
+#define SEARCH_STEP() PlacementSamplerStep(SAMPLE_STEP)
+#define SEARCH_IS_DONE() PlacementSamplerIsDone()
+#define SEARCH_RESULT() PlacementSamplerResult()
+#define SEARCH_RESULTS(guesses, count) PlacementSamplerResults(guesses, count)
+#else
+#define SEARCH_BEGIN(field) GuessEngineBegin(field)
+#define SEARCH_STEP() GuessEngineStep(GUESS_STEP)
+#define SEARCH_IS_DONE() GuessEngineIsDone()
+#define SEARCH_RESULT() GuessEngineResult()
+#define SEARCH_RESULTS(guesses, count) GuessEngineResults(guesses, count)
+#endif
+
 /**
  * The Init() function for an Agent sets up everything necessary for an agent before the game
  * starts.  At a minimum, this requires:
@@ -57,10 +113,494 @@ void AgentInit(void) {
     agent.state = AGENT_STATE_START;
     turnCount = 0;
     turn = FIELD_OLED_TURN_NONE;
-    
+    agent.speculation.valid = FALSE;
+    agent.capabilities = 0;
+    Message_UseCrc(FALSE);
+    Message_UseResync(FALSE);
+    LinkLayerInit();
+#if defined(PIC32) && OPPONENT_MODEL_FLASH
+    // what we learned about the opponent before the board was switched off.  After a reset the
+    // model in RAM is newer
+    static uint8_t modelLoaded = FALSE;
+    if (!modelLoaded) {
+        OpponentModelLoad();
+        modelLoaded = TRUE;
+    }
+#endif
+
+    // if we might play with the link layer, it screens what arrives before the handshake too
+    LinkLayerEnable((offeredCapabilities & MESSAGE_CAPABILITY_RELIABLE) != 0);
+
+}
+
+/**
+ * Every handler below services exactly one (state, event) pair of the transition table.
+ * A handler fills in agent.message if it wants to send something (AgentRun clears it to
+ * MESSAGE_NONE beforehand), moves agent.state and returns TRUE if the field screen should be
+ * redrawn afterwards, or FALSE if it has already put something else on the OLED.
+ */
+typedef uint8_t (*AgentHandler)(const BB_Event *event);
+
+/**
+ * One entry of the transition table.  nextStates is a bitmask of AGENT_STATE_BIT()s that the
+ * handler can move to; it is only used to introspect the table.
+ */
+typedef struct {
+    AgentHandler handler;
+    uint8_t nextStates;
+} AgentTransition;
+
+#define AGENT_STATE_BIT(state) (1 << (state))
+
+#ifdef AGENT_COVERAGE
+static uint32_t transitionCount[AGENT_NUM_STATES][BB_NUM_EVENTS];
+#endif
+
+// error strings for the OLED, indexed by BB_Error
+static const char *errorMessages[] = {
+    [BB_SUCCESS] = "message parse failure",
+    [BB_ERROR_BAD_CHECKSUM] = "Bad checksum",
+    [BB_ERROR_PAYLOAD_LEN_EXCEEDED] = "Payload len exceeded",
+    [BB_ERROR_CHECKSUM_LEN_EXCEEDED] = "checksum len exceeded",
+    [BB_ERROR_CHECKSUM_LEN_INSUFFICIENT] = "checksum len insufficient",
+    [BB_ERROR_INVALID_MESSAGE_TYPE] = "invalid msg type",
+    [BB_ERROR_MESSAGE_PARSE_FAILURE] = "message parse failure",
+    [BB_ERROR_LINK_TIMEOUT] = "link timed out",
+    [BB_ERROR_LINK_WINDOW_FULL] = "link window full",
+};
+
+#ifdef AGENT_COVERAGE
+// state and event names for the coverage report and the DOT graph
+static const char *stateNames[AGENT_NUM_STATES] = {
+    "START", "CHALLENGING", "ACCEPTING", "ATTACKING",
+    "DEFENDING", "WAITING_TO_SEND", "END_SCREEN", "SETUP_BOATS",
+};
+static const char *eventNames[BB_NUM_EVENTS] = {
+    "NO_EVENT", "START_BUTTON", "RESET_BUTTON", "CHA_RECEIVED", "ACC_RECEIVED", "REV_RECEIVED",
+    "SHO_RECEIVED", "RES_RECEIVED", "MESSAGE_SENT", "ERROR", "SOUTH_BUTTON", "EAST_BUTTON",
+    "RSH_RECEIVED", "SAL_RECEIVED", "SRS_RECEIVED", "ACK_RECEIVED", "NAK_RECEIVED",
+};
+#endif
+
+/**
+ * Clears the OLED and shows a single line of text in place of the fields.
+ */
+static void AgentShowText(const char *text) {
+    OledClear(OLED_COLOR_BLACK);
+    OledDrawString(text);
+    OledUpdate();
+}
+
+/**
+ * Searches for our next shot, continuing the speculative search if it is still valid for what we
+ * know about the opponent field.  The search runs until it is done or the turn's budget of
+ * AGENT_GUESS_BUDGET_MS has been spent, and the best guesses found by then are taken.
+ */
+static void AgentSearchGuess(void) {
+    uint32_t start = AGENT_TICKS();
+    if (agent.speculation.valid && agent.speculation.key == agent.other.key) {
+        speculationStats.hits++;
+        speculationStats.savedTicks += agent.speculation.ticks;
+    } else {
+        speculationStats.misses++;
+        SEARCH_BEGIN(&agent.other);
+    }
+    agent.speculation.valid = FALSE;
+    while (!SEARCH_IS_DONE() &&
+            AGENT_TICKS() - start < AGENT_GUESS_BUDGET_MS * AGENT_TICKS_PER_MS) {
+        SEARCH_STEP();
+    }
+}
+
+static GuessData AgentDecideGuess(void) {
+    GuessData guess;
+    if (FieldAIDecideGuessWithoutSearch(&agent.other, &guess)) {
+        return guess;
+    }
+    AgentSearchGuess();
+    return SEARCH_RESULT();
+}
+
+// fills in our next attack: a single SHO, or a SAL with one shot per boat we have left
+static void AgentAim(void) {
+    if (agent.capabilities & MESSAGE_CAPABILITY_SALVO) {
+        unsigned int *fields[] = {&agent.message.param1, &agent.message.param2,
+            &agent.message.param3, &agent.message.param4};
+        GuessData guesses[MESSAGE_SALVO_MAX];
+        uint8_t boats = FieldGetBoatStates(&agent.own);
+        uint8_t i, count = __builtin_popcount(boats);
+        if (count > MESSAGE_SALVO_MAX) {
+            count = MESSAGE_SALVO_MAX;
+        }
+        AgentSearchGuess();
+        count = SEARCH_RESULTS(guesses, count ? count : 1);
+        agent.message.type = MESSAGE_SAL;
+        agent.message.param0 = count;
+        for (i = 0; i < count; i++) {
+            *fields[i] = MESSAGE_PACK_SHOT(guesses[i].row, guesses[i].col);
+        }
+    } else {
+        GuessData guess = AgentDecideGuess();
+        agent.message.type = MESSAGE_SHO;
+        agent.message.param0 = guess.row;
+        agent.message.param1 = guess.col;
+    }
+}
+
+// shared handler for every (state, event) pair that has no entry in the table:
+// nothing is sent and the state is unchanged
+static uint8_t AgentRejectEvent(const BB_Event *event) {
+    (void) event;
+    return TRUE;
+}
+
+// here we reset all the data that needs resetting, and output a new screen
+static uint8_t AgentReset(const BB_Event *event) {
+    (void) event;
+    AgentShowText("Press BTN4 to start \nor wait for challenge\n");
+    AgentInit();
+    return FALSE;
+}
+
+// error messages for debugging
+static uint8_t AgentReportError(const BB_Event *event) {
+    if (event->param0 < sizeof (errorMessages) / sizeof (errorMessages[0])) {
+        errorMSG = (char *) errorMessages[event->param0];
+    } else {
+        errorMSG = "message parse failure";
+    }
+    AgentShowText(errorMSG);
+
+    agent.state = AGENT_STATE_END_SCREEN;
+    agent.message.type = MESSAGE_ERROR;
+    return FALSE;
+}
+
+// rand() only gives 15 bits on the PIC32, so a 32-bit secret takes three calls
+static NegotiationWideData AgentRandomWide(void) {
+    return ((NegotiationWideData) rand() << 30) ^ ((NegotiationWideData) rand() << 15) ^ rand();
+}
+
+// the game is over, so the opponent model learns from it, and with OPPONENT_MODEL_FLASH it is
+// saved by AgentIdle() for after the board is switched off.  On a host it is kept in memory only,
+// so that tests and simulated games repeat
+static void AgentLearnFromGame(void) {
+    OpponentModelEndGame(&agent.other);
+    gamesUnsaved++;
+}
+
+// we set the fields up for playing, generate the hash, and go to the challenge mode
+// the strong commitment is to a secret of its own, so the Beef hash gives nothing away about it
+static uint8_t AgentStartChallenge(const BB_Event *event) {
+    (void) event;
+    agent.secret = rand() & RAND_SIZE;
+    agent.wideSecret = AgentRandomWide();
+    NegotiationWideData commitment = NegotiationCommit(agent.wideSecret);
+    agent.message.param0 = NegotiationHash(agent.secret);
+    agent.message.param1 = offeredCapabilities;
+    agent.message.param2 = AGENT_FASTEST_BRG;
+    agent.message.param3 = commitment >> 16;
+    agent.message.param4 = commitment & 0xFFFF;
+    agent.message.type = MESSAGE_CHA;
+    FieldInit(&agent.own, &agent.other);
+
+    FieldAIPlaceAllBoats(&agent.own);
+
+    agent.state = AGENT_STATE_CHALLENGING;
+    return TRUE;
+}
+
+// we received a challenge, we generate the random number and send it to the challenger
+// along with the offered extensions we support
+static uint8_t AgentAcceptChallenge(const BB_Event *event) {
+    agent.secret = rand() & RAND_SIZE;
+    agent.hash = event->param0;
+    agent.wideSecret = AgentRandomWide();
+    agent.commitment = ((NegotiationWideData) event->param3 << 16) | event->param4;
+    agent.capabilities = event->param1 & AGENT_SUPPORTED_CAPABILITIES;
+    if (agent.capabilities & MESSAGE_CAPABILITY_SALVO) {
+        agent.capabilities &= ~MESSAGE_CAPABILITY_RSH;
+    }
+    agent.message.type = MESSAGE_ACC;
+    agent.message.param0 = agent.secret;
+    agent.message.param1 = agent.capabilities;
+    agent.message.param2 = AGENT_FASTEST_BRG;
+    if (agent.capabilities & MESSAGE_CAPABILITY_STRONG_COMMIT) {
+        agent.message.param0 = agent.wideSecret & 0xFFFF;
+        agent.message.param3 = agent.wideSecret >> 16;
+    }
+    agent.linkBrg = event->param2 > AGENT_FASTEST_BRG ? event->param2 : AGENT_FASTEST_BRG;
+    Message_UseCrc((agent.capabilities & MESSAGE_CAPABILITY_CRC) != 0);
+    Message_UseResync((agent.capabilities & AGENT_RESYNC_CAPABILITIES) != 0);
+    LinkLayerEnable((agent.capabilities & MESSAGE_CAPABILITY_RELIABLE) != 0);
+
+    FieldInit(&agent.own, &agent.other);
+    FieldAIPlaceAllBoats(&agent.own);
+    agent.state = AGENT_STATE_ACCEPTING;
+    return TRUE;
+}
+
+// we are challenger and received the other random number, so we reveal our secret and
+// run the coin flip to see who attacks first
+static uint8_t AgentRevealSecret(const BB_Event *event) {
+    agent.capabilities = event->param1 & offeredCapabilities;
+    agent.linkBrg = event->param2 > AGENT_FASTEST_BRG ? event->param2 : AGENT_FASTEST_BRG;
+    Message_UseCrc((agent.capabilities & MESSAGE_CAPABILITY_CRC) != 0);
+    Message_UseResync((agent.capabilities & AGENT_RESYNC_CAPABILITIES) != 0);
+    LinkLayerEnable((agent.capabilities & MESSAGE_CAPABILITY_RELIABLE) != 0);
+    agent.message.type = MESSAGE_REV;
+
+    NegotiationOutcome outcome;
+    if (agent.capabilities & MESSAGE_CAPABILITY_STRONG_COMMIT) {
+        NegotiationWideData B = ((NegotiationWideData) event->param3 << 16) | event->param0;
+        agent.message.param0 = agent.wideSecret & 0xFFFF;
+        agent.message.param1 = agent.wideSecret >> 16;
+        outcome = NegotiateCoinFlipWide(agent.wideSecret, B);
+    } else {
+        agent.message.param0 = agent.secret;
+        agent.message.param1 = 0;
+        outcome = NegotiateCoinFlip(agent.secret, event->param0);
+    }
+    if (outcome == HEADS) {
+        turn = FIELD_OLED_TURN_MINE;
+        agent.state = AGENT_STATE_WAITING_TO_SEND;
+    } else {
+        turn = FIELD_OLED_TURN_THEIRS;
+        agent.state = AGENT_STATE_DEFENDING;
+    }
+    return TRUE;
+}
+
+// we are accepter and received the challenger's secret, so we make sure the challenger
+// hasn't cheated and run the coin flip to see who attacks first
+static uint8_t AgentVerifyReveal(const BB_Event *event) {
+    NegotiationOutcome outcome;
+    int fair;
+    if (agent.capabilities & MESSAGE_CAPABILITY_STRONG_COMMIT) {
+        NegotiationWideData A = ((NegotiationWideData) event->param1 << 16) | event->param0;
+        outcome = NegotiateCoinFlipWide(A, agent.wideSecret);
+        fair = NegotiationVerifyCommit(A, agent.commitment);
+    } else {
+        outcome = NegotiateCoinFlip(agent.secret, event->param0);
+        fair = NegotiationVerify(event->param0, agent.hash);
+    }
+    if (fair == FALSE) {
+        OledDrawString("cheating message here, press reset button to start again\n");
+        OledUpdate();
+        agent.state = AGENT_STATE_END_SCREEN;
+        return FALSE;
+    }
+    if (outcome == TAILS) {
+        // determine and send shot here
+        turn = FIELD_OLED_TURN_MINE;
+        AgentAim();
+        agent.state = AGENT_STATE_ATTACKING;
+    } else {
+        turn = FIELD_OLED_TURN_THEIRS;
+        agent.state = AGENT_STATE_DEFENDING;
+    }
+    return TRUE;
+}
+
+// we register the enemy attack and send the result back to the other boat
+// if we lost from this attack we display defeat
+// with the combined extension our next shot goes out with the result, and we attack right away
+static uint8_t AgentDefend(const BB_Event *event) {
+    GuessData opGuess;
+    opGuess.row = event->param0;
+    opGuess.col = event->param1;
+    FieldRegisterEnemyAttack(&agent.own, &opGuess);
+    OpponentModelRecordShot(&opGuess);
+
+    if (FieldGetBoatStates(&agent.own) == ALL_SUNK) {
+        AgentShowText("defeat :(\n");
+        AgentLearnFromGame();
+        agent.state = AGENT_STATE_END_SCREEN;
+        return FALSE;
+    }
+
+    agent.message.type = MESSAGE_RES;
+    agent.message.param0 = event->param0;
+    agent.message.param1 = event->param1;
+    agent.message.param2 = opGuess.result;
+    turn = FIELD_OLED_TURN_MINE;
+    agent.state = AGENT_STATE_WAITING_TO_SEND;
+
+    if (agent.capabilities & MESSAGE_CAPABILITY_RSH) {
+        turnCount++;
+        GuessData guess = AgentDecideGuess();
+        agent.message.type = MESSAGE_RSH;
+        agent.message.param3 = guess.row;
+        agent.message.param4 = guess.col;
+        agent.state = AGENT_STATE_ATTACKING;
+    }
+    return TRUE;
+}
+
+// we just got the result of our guess and we add the data to what we know already
+// if we won we display victory, otherwise we wait for the enemy attack
+static uint8_t AgentRecordResult(const BB_Event *event) {
+    GuessData ownGuess;
+    ownGuess.row = event->param0;
+    ownGuess.col = event->param1;
+    ownGuess.result = event->param2;
+    FieldUpdateKnowledge(&agent.other, &ownGuess);
+
+    if (FieldGetBoatStates(&agent.other) == ALL_SUNK) {
+        AgentShowText("victory :)\n");
+        AgentLearnFromGame();
+        agent.state = AGENT_STATE_END_SCREEN;
+        return FALSE;
+    }
+
+    turn = FIELD_OLED_TURN_THEIRS;
+    agent.state = AGENT_STATE_DEFENDING;
+    return TRUE;
+}
+
+// we got the result of our guess together with the enemy's next shot, so we record the
+// result and, unless we won, defend against the shot
+static uint8_t AgentRecordResultAndDefend(const BB_Event *event) {
+    if (!(agent.capabilities & MESSAGE_CAPABILITY_RSH)) {
+        return AgentRejectEvent(event);
+    }
+    if (!AgentRecordResult(event)) {
+        return FALSE;
+    }
+    BB_Event shot = {.type = BB_EVENT_SHO_RECEIVED, .param0 = event->param3,
+        .param1 = event->param4};
+    return AgentDefend(&shot);
+}
+
+// we register a whole salvo of enemy attacks and send all the results back in one message
+// if we lost from these attacks we display defeat
+static uint8_t AgentDefendSalvo(const BB_Event *event) {
+    if (!(agent.capabilities & MESSAGE_CAPABILITY_SALVO)) {
+        return AgentRejectEvent(event);
+    }
+    const uint16_t shots[] = {event->param1, event->param2, event->param3, event->param4};
+    unsigned int *fields[] = {&agent.message.param1, &agent.message.param2,
+        &agent.message.param3, &agent.message.param4};
+    GuessData opGuesses[MESSAGE_SALVO_MAX];
+    uint8_t i, count = event->param0 < MESSAGE_SALVO_MAX ? event->param0 : MESSAGE_SALVO_MAX;
+    for (i = 0; i < count; i++) {
+        opGuesses[i].row = MESSAGE_SHOT_ROW(shots[i]);
+        opGuesses[i].col = MESSAGE_SHOT_COL(shots[i]);
+    }
+    FieldRegisterEnemyAttackBatch(&agent.own, opGuesses, count);
+    for (i = 0; i < count; i++) {
+        OpponentModelRecordShot(&opGuesses[i]);
+    }
 
+    if (FieldGetBoatStates(&agent.own) == ALL_SUNK) {
+        AgentShowText("defeat :(\n");
+        AgentLearnFromGame();
+        agent.state = AGENT_STATE_END_SCREEN;
+        return FALSE;
+    }
+
+    agent.message.type = MESSAGE_SRS;
+    agent.message.param0 = count;
+    for (i = 0; i < count; i++) {
+        *fields[i] = MESSAGE_PACK_RESULT(opGuesses[i].row, opGuesses[i].col, opGuesses[i].result);
+    }
+    turn = FIELD_OLED_TURN_MINE;
+    agent.state = AGENT_STATE_WAITING_TO_SEND;
+    return TRUE;
 }
 
+// we just got the results of our salvo and we add them to what we know already
+// if we won we display victory, otherwise we wait for the enemy attack
+static uint8_t AgentRecordSalvo(const BB_Event *event) {
+    if (!(agent.capabilities & MESSAGE_CAPABILITY_SALVO)) {
+        return AgentRejectEvent(event);
+    }
+    const uint16_t results[] = {event->param1, event->param2, event->param3, event->param4};
+    GuessData ownGuesses[MESSAGE_SALVO_MAX];
+    uint8_t i, count = event->param0 < MESSAGE_SALVO_MAX ? event->param0 : MESSAGE_SALVO_MAX;
+    for (i = 0; i < count; i++) {
+        ownGuesses[i].row = MESSAGE_SHOT_ROW(MESSAGE_RESULT_SHOT(results[i]));
+        ownGuesses[i].col = MESSAGE_SHOT_COL(MESSAGE_RESULT_SHOT(results[i]));
+        ownGuesses[i].result = MESSAGE_RESULT_RESULT(results[i]);
+    }
+    FieldUpdateKnowledgeBatch(&agent.other, ownGuesses, count);
+
+    if (FieldGetBoatStates(&agent.other) == ALL_SUNK) {
+        AgentShowText("victory :)\n");
+        AgentLearnFromGame();
+        agent.state = AGENT_STATE_END_SCREEN;
+        return FALSE;
+    }
+
+    turn = FIELD_OLED_TURN_THEIRS;
+    agent.state = AGENT_STATE_DEFENDING;
+    return TRUE;
+}
+
+// our last message is out and it is our turn, so we decide our guess and send it
+static uint8_t AgentSendShot(const BB_Event *event) {
+    (void) event;
+    turnCount++;
+    AgentAim();
+
+    agent.state = AGENT_STATE_ATTACKING;
+    return TRUE;
+}
+
+// reset and errors are handled the same way in every state
+#define AGENT_COMMON_TRANSITIONS \
+    [BB_EVENT_RESET_BUTTON] = {AgentReset, AGENT_STATE_BIT(AGENT_STATE_START)}, \
+    [BB_EVENT_ERROR] = {AgentReportError, AGENT_STATE_BIT(AGENT_STATE_END_SCREEN)}
+
+/**
+ * The agent state machine.  Empty entries are dispatched to AgentRejectEvent().
+ */
+static const AgentTransition transitions[AGENT_NUM_STATES][BB_NUM_EVENTS] = {
+    [AGENT_STATE_START] = {
+        AGENT_COMMON_TRANSITIONS,
+        [BB_EVENT_START_BUTTON] = {AgentStartChallenge, AGENT_STATE_BIT(AGENT_STATE_CHALLENGING)},
+        [BB_EVENT_CHA_RECEIVED] = {AgentAcceptChallenge, AGENT_STATE_BIT(AGENT_STATE_ACCEPTING)},
+    },
+    [AGENT_STATE_CHALLENGING] = {
+        AGENT_COMMON_TRANSITIONS,
+        [BB_EVENT_ACC_RECEIVED] = {AgentRevealSecret,
+            AGENT_STATE_BIT(AGENT_STATE_WAITING_TO_SEND) | AGENT_STATE_BIT(AGENT_STATE_DEFENDING)},
+    },
+    [AGENT_STATE_ACCEPTING] = {
+        AGENT_COMMON_TRANSITIONS,
+        [BB_EVENT_REV_RECEIVED] = {AgentVerifyReveal,
+            AGENT_STATE_BIT(AGENT_STATE_ATTACKING) | AGENT_STATE_BIT(AGENT_STATE_DEFENDING) |
+            AGENT_STATE_BIT(AGENT_STATE_END_SCREEN)},
+    },
+    [AGENT_STATE_ATTACKING] = {
+        AGENT_COMMON_TRANSITIONS,
+        [BB_EVENT_RES_RECEIVED] = {AgentRecordResult,
+            AGENT_STATE_BIT(AGENT_STATE_DEFENDING) | AGENT_STATE_BIT(AGENT_STATE_END_SCREEN)},
+        [BB_EVENT_RSH_RECEIVED] = {AgentRecordResultAndDefend,
+            AGENT_STATE_BIT(AGENT_STATE_ATTACKING) | AGENT_STATE_BIT(AGENT_STATE_END_SCREEN)},
+        [BB_EVENT_SRS_RECEIVED] = {AgentRecordSalvo,
+            AGENT_STATE_BIT(AGENT_STATE_DEFENDING) | AGENT_STATE_BIT(AGENT_STATE_END_SCREEN)},
+    },
+    [AGENT_STATE_DEFENDING] = {
+        AGENT_COMMON_TRANSITIONS,
+        [BB_EVENT_SHO_RECEIVED] = {AgentDefend,
+            AGENT_STATE_BIT(AGENT_STATE_WAITING_TO_SEND) | AGENT_STATE_BIT(AGENT_STATE_ATTACKING) |
+            AGENT_STATE_BIT(AGENT_STATE_END_SCREEN)},
+        [BB_EVENT_SAL_RECEIVED] = {AgentDefendSalvo,
+            AGENT_STATE_BIT(AGENT_STATE_WAITING_TO_SEND) | AGENT_STATE_BIT(AGENT_STATE_END_SCREEN)},
+    },
+    [AGENT_STATE_WAITING_TO_SEND] = {
+        AGENT_COMMON_TRANSITIONS,
+        [BB_EVENT_MESSAGE_SENT] = {AgentSendShot, AGENT_STATE_BIT(AGENT_STATE_ATTACKING)},
+    },
+    [AGENT_STATE_END_SCREEN] = {
+        AGENT_COMMON_TRANSITIONS,
+    },
+    [AGENT_STATE_SETUP_BOATS] = {
+        AGENT_COMMON_TRANSITIONS,
+    },
+};
+
 /**
  * AgentRun evolves the Agent state machine in response to an event.
  * 
@@ -74,255 +614,95 @@ void AgentInit(void) {
  * for generating the Message struct, not for encoding or sending it.
  */
 Message AgentRun(BB_Event event) {
-    switch (event.type) {
-        case BB_EVENT_START_BUTTON:
-            // if the state is start, we set the fields up for playing, generate the hash,
-            // and go to the challenge mode
-            if (agent.state == AGENT_STATE_START) {
-                agent.secret = rand() & RAND_SIZE;
-                agent.message.param0 = NegotiationHash(agent.secret);
-                agent.message.type = MESSAGE_CHA;
-                FieldInit(&agent.own, &agent.other);
-                
-                FieldAIPlaceAllBoats(&agent.own);
-                
-                agent.state = AGENT_STATE_CHALLENGING;
-            } else {
-                agent.message.type = MESSAGE_NONE;
-            }
-            break;
-        case BB_EVENT_RESET_BUTTON:
-            // TODO:
-            //  make sure this is okay stylistically
-            // here we reset all the data that needs resetting, and output a new screen
-            agent.message.type = MESSAGE_NONE;
-            char *tempWelcome = "Press BTN4 to start \nor wait for challenge\n";
-            OledClear(OLED_COLOR_BLACK);
-            OledDrawString(tempWelcome);
-            OledUpdate();
-            AgentInit();
-            return agent.message;
-            break;
-        case BB_EVENT_CHA_RECEIVED:
-            // in this mode we received a challenge, we generate the random number and send
-            // it to the challenger
-            if (agent.state == AGENT_STATE_START) {
-                agent.secret = rand() & RAND_SIZE; // see agent.secret for EVENT_START_BUTTON
-                // TODO:
-                //  send ACC
-                agent.hash = event.param0;
-                agent.message.type = MESSAGE_ACC;
-                agent.message.param0 = agent.secret;
-                
-                FieldInit(&agent.own, &agent.other);
-                FieldAIPlaceAllBoats(&agent.own);
-                agent.state = AGENT_STATE_ACCEPTING;
-                
-            } else {
-                agent.message.type = MESSAGE_NONE;
-            }
-            break;
-        case BB_EVENT_ACC_RECEIVED:
-            // if we are challenger and we receive the other random number,
-            // we run the coin flip to see who is attack and go to a state
-            // dependant on attack/defending
-            if (agent.state == AGENT_STATE_CHALLENGING) {
-                // send REV
-                agent.message.type = MESSAGE_REV;
-                agent.message.param0 = agent.secret;
-                // fix this
-                NegotiationOutcome outcome = NegotiateCoinFlip(agent.secret, event.param0);
-                if (outcome == HEADS) {
-                    turn = FIELD_OLED_TURN_MINE;
-                    agent.state = AGENT_STATE_WAITING_TO_SEND;
-                } else {
-                    // else if tails
-                    turn = FIELD_OLED_TURN_THEIRS;
-                    agent.state = AGENT_STATE_DEFENDING;
-                }
-                
-            } else {
-                agent.message.type = MESSAGE_NONE;
-            }
-            break;
-        case BB_EVENT_REV_RECEIVED:
-            // if we are accepter and we receive the other random number,
-            // we run the coin flip to see who is attack and go to a state
-            // dependant on attack/defending
-            // we also check to make sure the challenger hasnt cheated
-            if (agent.state == AGENT_STATE_ACCEPTING) {
-                NegotiationOutcome outcome = NegotiateCoinFlip(agent.secret, event.param0);
-                if (NegotiationVerify(event.param0, agent.hash) == FALSE) {
-                    char *cheat = "cheating message here, press reset button to start again\n";
-                    OledDrawString(cheat);
-                    OledUpdate();
-                    agent.state = AGENT_STATE_END_SCREEN;
-                    agent.message.type = MESSAGE_NONE;
-                    return agent.message;
-                }
-                if (outcome == TAILS) {
-                    // determine and send shot here
-                    turn = FIELD_OLED_TURN_MINE;
-                    GuessData guess = FieldAIDecideGuess(&agent.other);
-                    agent.message.type = MESSAGE_SHO;
-                    agent.message.param0 = guess.row;
-                    agent.message.param1 = guess.col;
-                    agent.state = AGENT_STATE_ATTACKING;
-                } else {
-                    // else if tails
-                    agent.message.type = MESSAGE_NONE;
-                    turn = FIELD_OLED_TURN_THEIRS;
-                    agent.state = AGENT_STATE_DEFENDING;
-                }
-                // detect cheating
-            } else {
-                agent.message.type = MESSAGE_NONE;
-            }
-            break;
-        case BB_EVENT_SHO_RECEIVED:
-            // if we are defending and we just received the enemy attack
-            // we register the attack and send the result back to the other boat
-            // if we lost from this attack we display defeat
-            if (agent.state == AGENT_STATE_DEFENDING) {
-                GuessData opGuess;
-                opGuess.row = event.param0;
-                opGuess.col = event.param1;
-                FieldRegisterEnemyAttack(&agent.own, &opGuess);
-                
-                agent.message.type = MESSAGE_RES;
-                agent.message.param0 = event.param0;
-                agent.message.param1 = event.param1;
-                agent.message.param2 = opGuess.result;
-                
-                if (FieldGetBoatStates(&agent.own) == ALL_SUNK) {
-                    agent.message.type = MESSAGE_NONE;
-                    char *defeat = "defeat :(\n";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(defeat);
-                    OledUpdate();
-                    agent.state = AGENT_STATE_END_SCREEN;
-                    return agent.message;
-                } else {
-                    turn = FIELD_OLED_TURN_MINE;
-                    agent.state = AGENT_STATE_WAITING_TO_SEND;
-                }
-                
-            } else {
-                agent.message.type = MESSAGE_NONE;
-            }
-            break;
-        case BB_EVENT_RES_RECEIVED:
-            // if we are attacking
-            // we just got the result of our guess and we add the data to what we know already
-            // if we won we display victory
-            // otherwise we go to defending and wait for the enemy attack
-            if (agent.state == AGENT_STATE_ATTACKING) {
-                // check for victory
-                // otherwise go to defending
-                GuessData ownGuess;
-                ownGuess.row = event.param0;
-                ownGuess.col = event.param1;
-                ownGuess.result = event.param2;
-                FieldUpdateKnowledge(&agent.other, &ownGuess);
-                if (FieldGetBoatStates(&agent.other) == ALL_SUNK) {
-                    agent.message.type = MESSAGE_NONE;
-                    char *victory = "victory :)\n";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(victory);
-                    OledUpdate();
-                    agent.state = AGENT_STATE_END_SCREEN;
-                    return agent.message;
-                } else {
-                    agent.message.type = MESSAGE_NONE;
-                    turn = FIELD_OLED_TURN_THEIRS;
-                    agent.state = AGENT_STATE_DEFENDING;
-                }
-            } else {
-                agent.message.type = MESSAGE_NONE;
-            }
-            break;
-        case BB_EVENT_MESSAGE_SENT:
-            // if we sent a message just now and are about to attack,
-            // we decide out guess and send it to the other player
-            if (agent.state == AGENT_STATE_WAITING_TO_SEND) {
-                turnCount++;
-                GuessData guess = FieldAIDecideGuess(&agent.other);
-                
-                agent.message.type = MESSAGE_SHO;
-                agent.message.param0 = guess.row;
-                agent.message.param1 = guess.col;
-                
-                agent.state = AGENT_STATE_ATTACKING;
-                
-            } else {
-                agent.message.type = MESSAGE_NONE;
-            }
-            break;
-        case BB_EVENT_ERROR:
-            // error messages for debugging
-            switch (event.param0) {
-                case BB_ERROR_BAD_CHECKSUM:
-                    errorMSG = "Bad checksum";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(errorMSG);
-                    OledUpdate();
-                    break;
-                case BB_ERROR_PAYLOAD_LEN_EXCEEDED:
-                    errorMSG = "Payload len exceeded";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(errorMSG);
-                    OledUpdate();
-                    break;
-                case BB_ERROR_CHECKSUM_LEN_EXCEEDED:
-                    errorMSG = "checksum len exceeded";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(errorMSG);
-                    OledUpdate();
-                    break;
-                case BB_ERROR_CHECKSUM_LEN_INSUFFICIENT:
-                    errorMSG = "checksum len insufficient";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(errorMSG);
-                    OledUpdate();
-                    break;
-                case BB_ERROR_INVALID_MESSAGE_TYPE:
-                    errorMSG = "invalid msg type";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(errorMSG);
-                    OledUpdate();
-                    break;
-                case BB_ERROR_MESSAGE_PARSE_FAILURE:
-                    errorMSG = "message parse failure";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(errorMSG);
-                    OledUpdate();
-                    break;
-                default:
-                    errorMSG = "message parse failure";
-                    OledClear(OLED_COLOR_BLACK);
-                    OledDrawString(errorMSG);
-                    OledUpdate();
-                    break;
-            }
-            
-            agent.state = AGENT_STATE_END_SCREEN;
-            agent.message.type = MESSAGE_ERROR;
-            return agent.message;
-            
-            break;
-        case BB_EVENT_NO_EVENT: case BB_EVENT_SOUTH_BUTTON: case BB_EVENT_EAST_BUTTON:
-            // chose not to do the extra credit, so in these cases nothing happens
-            agent.message.type = MESSAGE_NONE;
-            break;
+    AgentHandler handler = AgentRejectEvent;
+
+    // look the handler up in the transition table, anything out of range is rejected
+    if (agent.state < AGENT_NUM_STATES && event.type < BB_NUM_EVENTS) {
+#ifdef AGENT_COVERAGE
+        transitionCount[agent.state][event.type]++;
+#endif
+        if (transitions[agent.state][event.type].handler) {
+            handler = transitions[agent.state][event.type].handler;
+        }
+    }
+
+    agent.message.type = MESSAGE_NONE;
+    if (handler(&event)) {
+        // if everything goes smoothly, we update the screen as it is
+        OledClear(OLED_COLOR_BLACK);
+        FieldOledDrawScreen(&agent.own, &agent.other, turn, turnCount);
+        OledUpdate();
     }
-    
-    // if everything goes smoothly, we update the screen as it is
-    OledClear(OLED_COLOR_BLACK);
-    FieldOledDrawScreen(&agent.own, &agent.other, turn, turnCount);
-    OledUpdate();
     return agent.message;
 }
 
+/**
+ * AgentIdle gives the agent spare time to work ahead.  It should be called from the top level
+ * whenever there is no pending event and no message being transmitted, and does a small, bounded
+ * amount of work each time.
+ * 
+ * In AGENT_STATE_DEFENDING, the opponent is deciding its shot and our knowledge of its field
+ * cannot change, so the search for our next guess is started here and advanced one step per call.
+ *
+ * On the PIC32 with OPPONENT_MODEL_FLASH, in AGENT_STATE_END_SCREEN, the opponent model is saved
+ * once OPPONENT_MODEL_SAVE_EVERY games have been played since it was last saved and the link
+ * layer has nothing left in flight, so that the flash is written while nothing is arriving.
+ */
+void AgentIdle(void) {
+#if defined(PIC32) && OPPONENT_MODEL_FLASH
+    if (agent.state == AGENT_STATE_END_SCREEN && gamesUnsaved >= OPPONENT_MODEL_SAVE_EVERY &&
+            LinkLayerIsIdle()) {
+        OpponentModelSave();
+        gamesUnsaved = 0;
+    }
+#endif
+    if (agent.state != AGENT_STATE_DEFENDING) {
+        return;
+    }
+    if (!agent.speculation.valid) {
+        SEARCH_BEGIN(&agent.other);
+        agent.speculation.key = agent.other.key;
+        agent.speculation.ticks = 0;
+        agent.speculation.valid = TRUE;
+    }
+    if (!SEARCH_IS_DONE()) {
+        uint32_t start = AGENT_TICKS();
+        SEARCH_STEP();
+        agent.speculation.ticks += AGENT_TICKS() - start;
+    }
+}
+
+/**
+ * Changes the protocol extensions offered in our next challenge.
+ * 
+ * @param capabilities A bitfield of MESSAGE_CAPABILITY_* values, or 0 for the plain protocol.
+ */
+void AgentSetOfferedCapabilities(uint8_t capabilities) {
+    offeredCapabilities = capabilities;
+    if (agent.state == AGENT_STATE_START) {
+        LinkLayerEnable((offeredCapabilities & MESSAGE_CAPABILITY_RELIABLE) != 0);
+    }
+}
+
+/**
+ * Tells the top level whether to switch the UART to a faster rate after REV.
+ * 
+ * @param brg Set to the BRG value both boards support, if a fast link was agreed on.
+ * @return TRUE if a fast link was agreed on for this game, FALSE otherwise.
+ */
+uint8_t AgentGetFastLink(uint16_t *brg) {
+    if (!(agent.capabilities & MESSAGE_CAPABILITY_FAST_LINK)) {
+        return FALSE;
+    }
+    *brg = agent.linkBrg;
+    return TRUE;
+}
+
+void AgentGetSpeculationStats(AgentSpeculationStats *stats) {
+    *stats = speculationStats;
+    stats->ticksPerMs = AGENT_TICKS_PER_MS;
+}
+
 /** * 
  * @return Returns the current state that AgentGetState is in.  
  * 
@@ -342,3 +722,62 @@ void AgentSetState(AgentState newState) {
 }
 
 
+
+int AgentIsTransitionDefined(AgentState state, BB_EventType event) {
+    if (state >= AGENT_NUM_STATES || event >= BB_NUM_EVENTS) {
+        return FALSE;
+    }
+    return transitions[state][event].handler != NULL;
+}
+
+#ifdef AGENT_COVERAGE
+
+uint32_t AgentGetTransitionCount(AgentState state, BB_EventType event) {
+    if (state >= AGENT_NUM_STATES || event >= BB_NUM_EVENTS) {
+        return 0;
+    }
+    return transitionCount[state][event];
+}
+
+void AgentPrintTransitionCoverage(void) {
+    int state, event;
+    int defined = 0, covered = 0;
+
+    printf("Agent transition coverage:\n");
+    for (state = 0; state < AGENT_NUM_STATES; state++) {
+        uint32_t rejected = 0;
+        for (event = 0; event < BB_NUM_EVENTS; event++) {
+            if (AgentIsTransitionDefined(state, event)) {
+                defined++;
+                if (transitionCount[state][event]) {
+                    covered++;
+                }
+                printf("  %-15s %-13s %lu\n", stateNames[state], eventNames[event],
+                        (unsigned long) transitionCount[state][event]);
+            } else {
+                rejected += transitionCount[state][event];
+            }
+        }
+        printf("  %-15s (rejected)    %lu\n", stateNames[state], (unsigned long) rejected);
+    }
+    printf("%d/%d transitions covered\n", covered, defined);
+}
+
+void AgentPrintTransitionGraph(void) {
+    int state, event, next;
+
+    printf("digraph Agent {\n");
+    for (state = 0; state < AGENT_NUM_STATES; state++) {
+        for (event = 0; event < BB_NUM_EVENTS; event++) {
+            for (next = 0; next < AGENT_NUM_STATES; next++) {
+                if (transitions[state][event].nextStates & AGENT_STATE_BIT(next)) {
+                    printf("  %s -> %s [label=\"%s\"];\n", stateNames[state], stateNames[next],
+                            eventNames[event]);
+                }
+            }
+        }
+    }
+    printf("}\n");
+}
+
+#endif // AGENT_COVERAGE
@@ -23,6 +23,11 @@ typedef enum {
     AGENT_STATE_SETUP_BOATS, //7
 } AgentState;
 
+/**
+ * The number of AgentState values, used to size tables indexed by state.
+ */
+#define AGENT_NUM_STATES 8
+
 /**
  * The Init() function for an Agent sets up everything necessary for an agent before the game
  * starts.  At a minimum, this requires:
@@ -62,4 +67,122 @@ AgentState AgentGetState(void);
  */
 void AgentSetState(AgentState newState);
 
+/**
+ * The protocol extensions (MESSAGE_CAPABILITY_* values) the agent accepts when challenged.
+ */
+#define AGENT_SUPPORTED_CAPABILITIES (MESSAGE_CAPABILITY_RSH | MESSAGE_CAPABILITY_SALVO | \
+    MESSAGE_CAPABILITY_FAST_LINK | MESSAGE_CAPABILITY_CRC | MESSAGE_CAPABILITY_RELIABLE | \
+    MESSAGE_CAPABILITY_STRONG_COMMIT)
+
+/**
+ * The lowest UART BRG value (the fastest rate) this board can run the link at.  With the 20MHz
+ * PBCLK, 0 is 1.25Mbaud.
+ */
+#ifndef AGENT_FASTEST_BRG
+#define AGENT_FASTEST_BRG 0
+#endif
+
+/**
+ * The protocol extensions the agent offers when it challenges.  None are offered by default, as
+ * the original BattleBoats firmware rejects a challenge that offers any.
+ */
+#ifndef AGENT_OFFERED_CAPABILITIES
+#define AGENT_OFFERED_CAPABILITIES 0
+#endif
+
+/**
+ * The longest the agent will spend deciding a guess once it is its turn, in milliseconds.  When
+ * the budget runs out, the best guess found so far is taken.
+ */
+#ifndef AGENT_GUESS_BUDGET_MS
+#define AGENT_GUESS_BUDGET_MS 50
+#endif
+
+/**
+ * Counters for the speculative guess search.  While defending, the agent starts searching for its
+ * next shot ahead of time; when its turn comes the search is continued if the opponent field it
+ * was started from has not changed since.
+ */
+typedef struct {
+    uint32_t hits; // turns whose search was started while defending
+    uint32_t misses; // turns whose search had to start from scratch
+    uint32_t savedTicks; // total time spent searching while defending, in ticks
+    uint32_t ticksPerMs; // tick rate of the counters above
+} AgentSpeculationStats;
+
+/**
+ * Changes the protocol extensions offered in our next challenge.
+ * 
+ * @param capabilities A bitfield of MESSAGE_CAPABILITY_* values, or 0 for the plain protocol.
+ */
+void AgentSetOfferedCapabilities(uint8_t capabilities);
+
+/**
+ * Tells the top level whether to switch the UART to a faster rate after REV.
+ * 
+ * @param brg Set to the BRG value both boards support, if a fast link was agreed on.
+ * @return TRUE if a fast link was agreed on for this game, FALSE otherwise.
+ */
+uint8_t AgentGetFastLink(uint16_t *brg);
+
+/**
+ * AgentIdle gives the agent spare time to work ahead.  It should be called from the top level
+ * whenever there is no pending event and no message being transmitted, and does a small, bounded
+ * amount of work each time.
+ * 
+ * In AGENT_STATE_DEFENDING, the opponent is deciding its shot and our knowledge of its field
+ * cannot change, so the search for our next guess is started here and advanced one step per call.
+ *
+ * On the PIC32 with OPPONENT_MODEL_FLASH, in AGENT_STATE_END_SCREEN, the opponent model is saved
+ * once OPPONENT_MODEL_SAVE_EVERY games have been played since it was last saved and the link
+ * layer has nothing left in flight, so that the flash is written while nothing is arriving.
+ */
+void AgentIdle(void);
+
+/**
+ * @param stats Filled with the speculative guess counters since power-on.
+ */
+void AgentGetSpeculationStats(AgentSpeculationStats *stats);
+
+/**
+ * AgentRun dispatches through a const transition table indexed by [AgentState][BB_EventType].
+ * Pairs that have no entry in the table are handled by a shared reject handler, which sends
+ * nothing and leaves the state unchanged.
+ * 
+ * @param state The state to look up
+ * @param event The event type to look up
+ * @return TRUE if the pair has its own handler, FALSE if it goes to the reject handler
+ */
+int AgentIsTransitionDefined(AgentState state, BB_EventType event);
+
+/**
+ * With AGENT_COVERAGE defined, AgentRun counts how often each (state, event) pair is dispatched,
+ * and the coverage report and DOT graph below are built.  It is off by default, as the counters
+ * take 4 bytes of RAM per pair and a write on every dispatch.
+ */
+#ifdef AGENT_COVERAGE
+
+/**
+ * @param state The state to look up
+ * @param event The event type to look up
+ * @return The number of times AgentRun has dispatched this pair since power-on.
+ */
+uint32_t AgentGetTransitionCount(AgentState state, BB_EventType event);
+
+/**
+ * Prints a transition coverage report: every defined (state, event) pair with the number of
+ * times it has been dispatched, followed by the number of rejected events per state.
+ * 
+ * This function is very useful for checking how much of the state machine a test run exercised.
+ */
+void AgentPrintTransitionCoverage(void);
+
+/**
+ * Prints the transition table as a Graphviz DOT digraph.  Each defined (state, event) pair
+ * becomes one edge per state it can lead to, labelled with the event name.
+ */
+void AgentPrintTransitionGraph(void);
+
+#endif // AGENT_COVERAGE
+
 #endif // AGENT_H
@@ -1,7 +1,155 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "Agent.h"
 #include "BattleBoats.h"
+#include "Field.h"
+#include "LinkLayer.h"
+#include "Negotiation.h"
+#include "BOARD.h"
+
+/**
+ * One recorded step of an event trace: the state the agent was forced into, the event that was
+ * fed to AgentRun, and the state and message type the original switch-based AgentRun produced.
+ * Steps that depend on the coin flip (and therefore on rand()) list both recorded outcomes.
+ *
+ * The tables were printed by RecordTrace() below, built with the AGENT_TEST_RECORD macro against
+ * the switch-based Agent.c of the first commit (which has no LinkLayer.h, so drop that include),
+ * and can be printed again the same way; which of two outcomes is listed first may differ.
+ * With gcc: `gcc AgentTest.c Agent.c Field.c Message.c Negotiation.c FieldOled.c Oled.c Ascii.c
+ *      -DAGENT_TEST_RECORD`
+ */
+typedef struct {
+    AgentState from;
+    BB_EventType type;
+    uint16_t param0, param1, param2;
+    AgentState state;
+    MessageType message;
+    AgentState altState;
+    MessageType altMessage;
+} AgentTraceStep;
+
+// recorded with the switch-based AgentRun, a challenger's game
+static const AgentTraceStep challengerTrace[] = {
+    {AGENT_STATE_START, BB_EVENT_START_BUTTON, 0, 0, 0, AGENT_STATE_CHALLENGING, MESSAGE_CHA, AGENT_STATE_CHALLENGING, MESSAGE_CHA},
+    {AGENT_STATE_CHALLENGING, BB_EVENT_ACC_RECEIVED, 1234, 0, 0, AGENT_STATE_WAITING_TO_SEND, MESSAGE_REV, AGENT_STATE_DEFENDING, MESSAGE_REV},
+    {AGENT_STATE_WAITING_TO_SEND, BB_EVENT_MESSAGE_SENT, 0, 0, 0, AGENT_STATE_ATTACKING, MESSAGE_SHO, AGENT_STATE_ATTACKING, MESSAGE_SHO},
+    {AGENT_STATE_ATTACKING, BB_EVENT_RES_RECEIVED, 2, 3, 1, AGENT_STATE_DEFENDING, MESSAGE_NONE, AGENT_STATE_DEFENDING, MESSAGE_NONE},
+    {AGENT_STATE_DEFENDING, BB_EVENT_SHO_RECEIVED, 4, 5, 0, AGENT_STATE_WAITING_TO_SEND, MESSAGE_RES, AGENT_STATE_WAITING_TO_SEND, MESSAGE_RES},
+    {AGENT_STATE_WAITING_TO_SEND, BB_EVENT_MESSAGE_SENT, 0, 0, 0, AGENT_STATE_ATTACKING, MESSAGE_SHO, AGENT_STATE_ATTACKING, MESSAGE_SHO},
+    {AGENT_STATE_ATTACKING, BB_EVENT_SHO_RECEIVED, 1, 1, 0, AGENT_STATE_ATTACKING, MESSAGE_NONE, AGENT_STATE_ATTACKING, MESSAGE_NONE},
+    {AGENT_STATE_ATTACKING, BB_EVENT_RES_RECEIVED, 0, 0, 0, AGENT_STATE_DEFENDING, MESSAGE_NONE, AGENT_STATE_DEFENDING, MESSAGE_NONE},
+    {AGENT_STATE_DEFENDING, BB_EVENT_ERROR, 1, 0, 0, AGENT_STATE_END_SCREEN, MESSAGE_ERROR, AGENT_STATE_END_SCREEN, MESSAGE_ERROR},
+    {AGENT_STATE_END_SCREEN, BB_EVENT_START_BUTTON, 0, 0, 0, AGENT_STATE_END_SCREEN, MESSAGE_NONE, AGENT_STATE_END_SCREEN, MESSAGE_NONE},
+    {AGENT_STATE_END_SCREEN, BB_EVENT_RESET_BUTTON, 0, 0, 0, AGENT_STATE_START, MESSAGE_NONE, AGENT_STATE_START, MESSAGE_NONE},
+};
+
+// recorded with the switch-based AgentRun, an accepter's game (49 is the hash of 7)
+static const AgentTraceStep accepterTrace[] = {
+    {AGENT_STATE_START, BB_EVENT_CHA_RECEIVED, 49, 0, 0, AGENT_STATE_ACCEPTING, MESSAGE_ACC, AGENT_STATE_ACCEPTING, MESSAGE_ACC},
+    {AGENT_STATE_ACCEPTING, BB_EVENT_REV_RECEIVED, 7, 0, 0, AGENT_STATE_ATTACKING, MESSAGE_SHO, AGENT_STATE_DEFENDING, MESSAGE_NONE},
+    {AGENT_STATE_ATTACKING, BB_EVENT_RES_RECEIVED, 1, 1, 2, AGENT_STATE_DEFENDING, MESSAGE_NONE, AGENT_STATE_DEFENDING, MESSAGE_NONE},
+    {AGENT_STATE_DEFENDING, BB_EVENT_SHO_RECEIVED, 0, 9, 0, AGENT_STATE_WAITING_TO_SEND, MESSAGE_RES, AGENT_STATE_WAITING_TO_SEND, MESSAGE_RES},
+    {AGENT_STATE_WAITING_TO_SEND, BB_EVENT_MESSAGE_SENT, 0, 0, 0, AGENT_STATE_ATTACKING, MESSAGE_SHO, AGENT_STATE_ATTACKING, MESSAGE_SHO},
+    {AGENT_STATE_ATTACKING, BB_EVENT_MESSAGE_SENT, 0, 0, 0, AGENT_STATE_ATTACKING, MESSAGE_NONE, AGENT_STATE_ATTACKING, MESSAGE_NONE},
+    {AGENT_STATE_ATTACKING, BB_EVENT_RES_RECEIVED, 5, 5, 0, AGENT_STATE_DEFENDING, MESSAGE_NONE, AGENT_STATE_DEFENDING, MESSAGE_NONE},
+    {AGENT_STATE_DEFENDING, BB_EVENT_SOUTH_BUTTON, 0, 0, 0, AGENT_STATE_DEFENDING, MESSAGE_NONE, AGENT_STATE_DEFENDING, MESSAGE_NONE},
+    {AGENT_STATE_DEFENDING, BB_EVENT_EAST_BUTTON, 0, 0, 0, AGENT_STATE_DEFENDING, MESSAGE_NONE, AGENT_STATE_DEFENDING, MESSAGE_NONE},
+    {AGENT_STATE_ACCEPTING, BB_EVENT_REV_RECEIVED, 8, 0, 0, AGENT_STATE_END_SCREEN, MESSAGE_NONE, AGENT_STATE_END_SCREEN, MESSAGE_NONE},
+    {AGENT_STATE_END_SCREEN, BB_EVENT_ERROR, 3, 0, 0, AGENT_STATE_END_SCREEN, MESSAGE_ERROR, AGENT_STATE_END_SCREEN, MESSAGE_ERROR},
+    {AGENT_STATE_END_SCREEN, BB_EVENT_RESET_BUTTON, 0, 0, 0, AGENT_STATE_START, MESSAGE_NONE, AGENT_STATE_START, MESSAGE_NONE},
+};
+
+#ifdef AGENT_TEST_RECORD
+#define RECORD_SEEDS 64
+
+static const char *recordStates[] = {"AGENT_STATE_START", "AGENT_STATE_CHALLENGING",
+    "AGENT_STATE_ACCEPTING", "AGENT_STATE_ATTACKING", "AGENT_STATE_DEFENDING",
+    "AGENT_STATE_WAITING_TO_SEND", "AGENT_STATE_END_SCREEN", "AGENT_STATE_SETUP_BOATS"};
+static const char *recordEvents[] = {"BB_EVENT_NO_EVENT", "BB_EVENT_START_BUTTON",
+    "BB_EVENT_RESET_BUTTON", "BB_EVENT_CHA_RECEIVED", "BB_EVENT_ACC_RECEIVED",
+    "BB_EVENT_REV_RECEIVED", "BB_EVENT_SHO_RECEIVED", "BB_EVENT_RES_RECEIVED",
+    "BB_EVENT_MESSAGE_SENT", "BB_EVENT_ERROR", "BB_EVENT_SOUTH_BUTTON", "BB_EVENT_EAST_BUTTON"};
+
+static const char *RecordMessage(MessageType type) {
+    switch (type) {
+    case MESSAGE_CHA: return "MESSAGE_CHA";
+    case MESSAGE_ACC: return "MESSAGE_ACC";
+    case MESSAGE_REV: return "MESSAGE_REV";
+    case MESSAGE_SHO: return "MESSAGE_SHO";
+    case MESSAGE_RES: return "MESSAGE_RES";
+    case MESSAGE_ERROR: return "MESSAGE_ERROR";
+    default: return "MESSAGE_NONE";
+    }
+}
+
+/**
+ * Feeds the events of a trace to AgentRun once for each of RECORD_SEEDS seeds of rand(), the
+ * same way ReplayTrace() does, and prints the table again with the outcomes seen.  Only the
+ * from state, event and parameters of the trace are read.
+ */
+static void RecordTrace(const AgentTraceStep *trace, int length) {
+    AgentState states[2][32];
+    MessageType messages[2][32];
+    int outcomes[32] = {0};
+    int seed, i, k;
+
+    for (seed = 1; seed <= RECORD_SEEDS; seed++) {
+        srand(seed);
+        AgentInit();
+        for (i = 0; i < length && i < 32; i++) {
+            BB_Event event = {trace[i].type, trace[i].param0, trace[i].param1, trace[i].param2};
+            AgentSetState(trace[i].from);
+            Message message = AgentRun(event);
+            AgentState state = AgentGetState();
+            for (k = 0; k < outcomes[i]; k++) {
+                if (states[k][i] == state && messages[k][i] == message.type) break;
+            }
+            if (k == outcomes[i] && k < 2) {
+                states[k][i] = state;
+                messages[k][i] = message.type;
+                outcomes[i]++;
+            }
+        }
+    }
+    for (i = 0; i < length && i < 32; i++) {
+        k = outcomes[i] > 1 ? 1 : 0;
+        printf("    {%s, %s, %u, %u, %u, %s, %s, %s, %s},\n", recordStates[trace[i].from],
+                recordEvents[trace[i].type], trace[i].param0, trace[i].param1, trace[i].param2,
+                recordStates[states[0][i]], RecordMessage(messages[0][i]),
+                recordStates[states[k][i]], RecordMessage(messages[k][i]));
+    }
+}
+
+int main() {
+    printf("// a challenger's game\n");
+    RecordTrace(challengerTrace, sizeof (challengerTrace) / sizeof (challengerTrace[0]));
+    printf("// an accepter's game\n");
+    RecordTrace(accepterTrace, sizeof (accepterTrace) / sizeof (accepterTrace[0]));
+    return 0;
+}
+#else
+
+/**
+ * Replays a recorded trace through AgentRun.
+ * @return the number of steps whose outcome did not match the recording
+ */
+static int ReplayTrace(const AgentTraceStep *trace, int length) {
+    int i, mismatches = 0;
+    for (i = 0; i < length; i++) {
+        BB_Event event = {trace[i].type, trace[i].param0, trace[i].param1, trace[i].param2};
+        AgentSetState(trace[i].from);
+        Message message = AgentRun(event);
+        AgentState state = AgentGetState();
+        if (!((state == trace[i].state && message.type == trace[i].message) ||
+                (state == trace[i].altState && message.type == trace[i].altMessage))) {
+            printf("\tstep %d: got state %d message %d\n", i, state, message.type);
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
 int main() {    
     printf("Testing AgentSetSate and AgentGetState:\n");    
     
@@ -39,5 +187,181 @@ int main() {
     if(AgentGetState() == AGENT_STATE_CHALLENGING) testercount++;        
     if(testercount == 1) printf("\nSUCCESS\n");    
     
+    printf("Testing AgentRun against recorded traces:\n");
+    AgentInit();
+    testercount = ReplayTrace(challengerTrace, sizeof (challengerTrace) / sizeof (challengerTrace[0]));
+    testercount += ReplayTrace(accepterTrace, sizeof (accepterTrace) / sizeof (accepterTrace[0]));
+    if(testercount == 0) printf("SUCCESS\n");
+    
+    // every pair without a handler was recorded as leaving the state alone and sending nothing
+    printf("Testing rejected transitions:\n");
+    testercount = 0;
+    int state, type;
+    for (state = 0; state < AGENT_NUM_STATES; state++) {
+        for (type = 0; type < BB_NUM_EVENTS; type++) {
+            if (AgentIsTransitionDefined(state, type)) continue;
+            BB_Event rejected = {type, 2, 3, 1};
+            AgentSetState(state);
+            if (AgentRun(rejected).type != MESSAGE_NONE || AgentGetState() != state) testercount++;
+        }
+    }
+    if(AgentIsTransitionDefined(AGENT_STATE_START, BB_EVENT_START_BUTTON) &&
+            !AgentIsTransitionDefined(AGENT_STATE_START, BB_EVENT_SHO_RECEIVED) &&
+            testercount == 0) printf("SUCCESS\n");
+    
+    // a guess worked out while defending is served only if our knowledge has not changed since
+    printf("Testing speculative guesses:\n");
+    AgentSpeculationStats before, after;
+    BB_Event sent = {BB_EVENT_MESSAGE_SENT, 0, 0, 0};
+    BB_Event result = {BB_EVENT_RES_RECEIVED, 2, 3, 1};
+    AgentInit();
+    AgentGetSpeculationStats(&before);
+    AgentSetState(AGENT_STATE_DEFENDING);
+    AgentIdle();
+    AgentSetState(AGENT_STATE_WAITING_TO_SEND);
+    testercount = (AgentRun(sent).type == MESSAGE_SHO);
+    AgentGetSpeculationStats(&after);
+    testercount += (after.hits == before.hits + 1 && after.misses == before.misses);
+    AgentSetState(AGENT_STATE_WAITING_TO_SEND);
+    AgentRun(sent);
+    AgentSetState(AGENT_STATE_DEFENDING);
+    AgentIdle();
+    AgentSetState(AGENT_STATE_ATTACKING);
+    AgentRun(result);
+    AgentSetState(AGENT_STATE_WAITING_TO_SEND);
+    AgentRun(sent);
+    AgentGetSpeculationStats(&before);
+    testercount += (before.hits == after.hits && before.misses == after.misses + 2);
+    if(testercount == 3) printf("SUCCESS\n");
+    printf("\t%lu hits, %lu misses, %lu ms saved\n", (unsigned long) before.hits,
+            (unsigned long) before.misses, (unsigned long) (before.savedTicks / before.ticksPerMs));
+    
+    // the combined result/shot message is only used once both sides have agreed to it
+    printf("Testing combined result/shot messages:\n");
+    BB_Event challenge = {BB_EVENT_CHA_RECEIVED, 49, MESSAGE_CAPABILITY_RSH};
+    BB_Event shot = {BB_EVENT_SHO_RECEIVED, 4, 5};
+    BB_Event combined = {BB_EVENT_RSH_RECEIVED, 2, 3, RESULT_MISS, 1, 1};
+    Message reply;
+    AgentInit();
+    reply = AgentRun(challenge);
+    testercount = (reply.type == MESSAGE_ACC && reply.param1 == MESSAGE_CAPABILITY_RSH);
+    AgentSetState(AGENT_STATE_DEFENDING);
+    reply = AgentRun(shot);
+    testercount += (reply.type == MESSAGE_RSH && reply.param0 == 4 && reply.param1 == 5 &&
+            AgentGetState() == AGENT_STATE_ATTACKING);
+    reply = AgentRun(combined);
+    testercount += (reply.type == MESSAGE_RSH && reply.param0 == 1 && reply.param1 == 1 &&
+            AgentGetState() == AGENT_STATE_ATTACKING);
+    challenge.param1 = 0;
+    AgentInit();
+    reply = AgentRun(challenge);
+    testercount += (reply.type == MESSAGE_ACC && reply.param1 == 0);
+    AgentSetState(AGENT_STATE_DEFENDING);
+    testercount += (AgentRun(shot).type == MESSAGE_RES);
+    AgentSetState(AGENT_STATE_ATTACKING);
+    testercount += (AgentRun(combined).type == MESSAGE_NONE && AgentGetState() == AGENT_STATE_ATTACKING);
+    if(testercount == 6) printf("SUCCESS\n");
+    
+    // with salvos, a whole volley of shots and all of its results each take one message
+    printf("Testing salvos:\n");
+    BB_Event salvo = {BB_EVENT_SAL_RECEIVED, 2, MESSAGE_PACK_SHOT(4, 5), MESSAGE_PACK_SHOT(1, 1)};
+    BB_Event results = {BB_EVENT_SRS_RECEIVED, 1, MESSAGE_PACK_RESULT(2, 3, RESULT_HIT)};
+    challenge.param1 = MESSAGE_CAPABILITY_RSH | MESSAGE_CAPABILITY_SALVO;
+    AgentInit();
+    reply = AgentRun(challenge);
+    testercount = (reply.type == MESSAGE_ACC && reply.param1 == MESSAGE_CAPABILITY_SALVO);
+    AgentSetState(AGENT_STATE_DEFENDING);
+    reply = AgentRun(salvo);
+    testercount += (reply.type == MESSAGE_SRS && reply.param0 == 2 &&
+            MESSAGE_RESULT_SHOT(reply.param1) == MESSAGE_PACK_SHOT(4, 5) &&
+            MESSAGE_RESULT_SHOT(reply.param2) == MESSAGE_PACK_SHOT(1, 1) &&
+            AgentGetState() == AGENT_STATE_WAITING_TO_SEND);
+    reply = AgentRun(sent);
+    testercount += (reply.type == MESSAGE_SAL && reply.param0 == 4 && AgentGetState() == AGENT_STATE_ATTACKING);
+    AgentRun(results);
+    testercount += (AgentGetState() == AGENT_STATE_DEFENDING);
+    if(testercount == 4) printf("SUCCESS\n");
+    
+    // a fast link runs at the slower of the two rates offered, and only if both sides agree
+    printf("Testing fast link negotiation:\n");
+    uint16_t brg;
+    challenge.param1 = MESSAGE_CAPABILITY_FAST_LINK;
+    challenge.param2 = AGENT_FASTEST_BRG + 3;
+    AgentInit();
+    reply = AgentRun(challenge);
+    testercount = (reply.type == MESSAGE_ACC && reply.param1 == MESSAGE_CAPABILITY_FAST_LINK &&
+            reply.param2 == AGENT_FASTEST_BRG);
+    testercount += (AgentGetFastLink(&brg) == TRUE && brg == AGENT_FASTEST_BRG + 3);
+    challenge.param1 = 0;
+    AgentInit();
+    AgentRun(challenge);
+    testercount += (AgentGetFastLink(&brg) == FALSE);
+    if(testercount == 3) printf("SUCCESS\n");
+    
+    // once a CRC is agreed on, even the ACC is framed with one
+    printf("Testing CRC negotiation:\n");
+    char frame[MESSAGE_MAX_LEN + 1];
+    challenge.param1 = MESSAGE_CAPABILITY_CRC;
+    AgentInit();
+    reply = AgentRun(challenge);
+    Message_Encode(frame, reply);
+    testercount = (reply.param1 == MESSAGE_CAPABILITY_CRC && strchr(frame, '#') != NULL);
+    AgentInit();
+    Message_Encode(frame, reply);
+    testercount += (strchr(frame, '*') != NULL);
+    if(testercount == 2) printf("SUCCESS\n");
+    
+    // the link layer is on while a challenge offering it is open, and stays on once agreed
+    printf("Testing link layer negotiation:\n");
+    challenge.param1 = MESSAGE_CAPABILITY_RELIABLE;
+    AgentInit();
+    testercount = (LinkLayerIsEnabled() == FALSE);
+    AgentRun(challenge);
+    testercount += (LinkLayerIsEnabled() == TRUE);
+    AgentSetOfferedCapabilities(MESSAGE_CAPABILITY_RELIABLE);
+    AgentInit();
+    testercount += (LinkLayerIsEnabled() == TRUE);
+    AgentSetOfferedCapabilities(0);
+    testercount += (LinkLayerIsEnabled() == FALSE);
+    if(testercount == 4) printf("SUCCESS\n");
+    
+    // with the strong commitment, a challenger's reveal passes its own accepter's check, and
+    // any other secret fails it
+    printf("Testing strong commitment negotiation:\n");
+    BB_Event start = {BB_EVENT_START_BUTTON};
+    BB_Event accept = {BB_EVENT_ACC_RECEIVED, 0x5678, MESSAGE_CAPABILITY_STRONG_COMMIT, 0, 0x1234};
+    Message cha, rev;
+    AgentSetOfferedCapabilities(MESSAGE_CAPABILITY_STRONG_COMMIT);
+    AgentInit();
+    cha = AgentRun(start);
+    rev = AgentRun(accept);
+    NegotiationWideData A = ((NegotiationWideData) rev.param1 << 16) | rev.param0;
+    testercount = (cha.param1 == MESSAGE_CAPABILITY_STRONG_COMMIT &&
+            NegotiationVerifyCommit(A, ((NegotiationWideData) cha.param3 << 16) | cha.param4));
+    testercount += (AgentGetState() == (NegotiateCoinFlipWide(A, 0x12345678) == HEADS ?
+            AGENT_STATE_WAITING_TO_SEND : AGENT_STATE_DEFENDING));
+    AgentSetOfferedCapabilities(0);
+    challenge = (BB_Event) {BB_EVENT_CHA_RECEIVED, cha.param0, cha.param1, cha.param2, cha.param3,
+        cha.param4};
+    BB_Event reveal = {BB_EVENT_REV_RECEIVED, rev.param0, rev.param1};
+    AgentInit();
+    reply = AgentRun(challenge);
+    testercount += (reply.type == MESSAGE_ACC && reply.param1 == MESSAGE_CAPABILITY_STRONG_COMMIT);
+    AgentRun(reveal);
+    testercount += (AgentGetState() != AGENT_STATE_END_SCREEN);
+    reveal.param1 ^= 1;
+    AgentInit();
+    AgentRun(challenge);
+    AgentRun(reveal);
+    testercount += (AgentGetState() == AGENT_STATE_END_SCREEN);
+    if(testercount == 5) printf("SUCCESS\n");
+    
+    // built with AGENT_COVERAGE, the test also reports how much of the table it exercised
+#ifdef AGENT_COVERAGE
+    AgentPrintTransitionCoverage();
+    AgentPrintTransitionGraph();
+#endif
+    
     while(1);    
-}
\ No newline at end of file
+}
+#endif // AGENT_TEST_RECORD
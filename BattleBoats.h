@@ -23,8 +23,22 @@ typedef enum {
     BB_EVENT_SOUTH_BUTTON, //10
     BB_EVENT_EAST_BUTTON, //11
 
+    //only used when the matching protocol extension has been negotiated:
+    BB_EVENT_RSH_RECEIVED, //12
+    BB_EVENT_SAL_RECEIVED, //13
+    BB_EVENT_SRS_RECEIVED, //14
+
+    //only used by the link layer, these never reach the agent:
+    BB_EVENT_ACK_RECEIVED, //15
+    BB_EVENT_NAK_RECEIVED, //16
+
 } BB_EventType;
 
+/**
+ * The number of BB_EventType values, used to size tables indexed by event type.
+ */
+#define BB_NUM_EVENTS 17
+
 /**
 All BB events use this struct:
  */
@@ -33,6 +47,9 @@ typedef struct {
     uint16_t param0; //defined in Message.h
     uint16_t param1;
     uint16_t param2;
+    uint16_t param3;
+    uint16_t param4;
+    uint8_t link; //link layer header, 0 if the message had none
 } BB_Event;
 
 /**
@@ -49,6 +66,8 @@ typedef enum {
     BB_ERROR_CHECKSUM_LEN_INSUFFICIENT, //3
     BB_ERROR_INVALID_MESSAGE_TYPE, //4
     BB_ERROR_MESSAGE_PARSE_FAILURE,
+    BB_ERROR_LINK_TIMEOUT, //nothing valid arrived after a fast link fell back
+    BB_ERROR_LINK_WINDOW_FULL, //the link layer had too many messages waiting to send another
 } BB_Error;
 
 
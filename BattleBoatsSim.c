@@ -0,0 +1,479 @@
+/*
+ * File:   BattleBoatsSim.c
+ * Author: jwang456
+ *
+ * Purpose: Host simulator that plays two agents against each other
+ *
+ * Each agent runs in its own process (the Agent module keeps its state in statics), and the
+ * two are connected by pipes standing in for the UART.  Game duration is estimated from the
+ * bytes sent, at the pacing Lab09_main.c uses: one byte every TRANSMIT_PERIOD hundredths of a
+ * second, plus one period per message to notice it has been sent.  Once a fast link is up,
+ * bytes are sent unthrottled and take 10 bit times each at the agreed rate.  Like Lab09_main.c,
+ * an agent on a fast link falls back to the default rate on a bad message or on
+ * LINK_SILENCE_TIMEOUT without a valid one, and without the link layer gives up on the game after
+ * LINK_RETRY_TIMEOUT more without one.  Every byte carries the rate it was sent at, and a byte
+ * that arrives at an agent listening at the other rate is garbled.
+ *
+ * Bits can be flipped on the way at a given bit error rate.  An agent whose opponent has gone
+ * quiet for IDLE_POLL_MS of real time assumes a message was lost and moves its clock forward
+ * by IDLE_STEP, so that the link layer's timers can fire, and gives up on any message that has
+ * stopped partway through, like RECEIVE_TIMEOUT in Lab09_main.c.  With the link layer on, the
+ * longer of the two agents' waits is added to the game duration.
+ *
+ * The UART ring buffers are sized by soaking them in every mode: the most bytes an agent sends
+ * in one go, without hearing anything back or going idle, is the most that can pile up in its
+ * TX ring, or in the other agent's RX ring while it is busy.  Each mode reports that, rounded up
+ * to the power of two a ring needs, and the largest over all modes is checked against
+ * UART1_RX_BUFFER_SIZE and UART1_TX_BUFFER_SIZE.
+ *
+ * A game that neither agent finishes or ends on an error has stalled, and the simulator exits
+ * with an error if any game in any mode stalled.
+ *
+ * Run with `./sim stats` to also print the link statistics (see LinkStats.h) of every run,
+ * totalled over both agents and averaged per game.  The UART ring buffers are not simulated.
+ *
+ * Build and run on x86 with (the field AI sources are listed in Field.h):
+ * `gcc BattleBoatsSim.c Agent.c <field AI sources> LinkLayer.c LinkStats.c Message.c
+ *      Negotiation.c FieldOled.c Oled.c Ascii.c -o sim && ./sim`
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "BOARD.h"
+#include "BattleBoats.h"
+#include "Agent.h"
+#include "GuessEngine.h"
+#include "LinkLayer.h"
+#include "LinkStats.h"
+#include "Message.h"
+#include "OledDriver.h"
+#include "Uart1.h"
+
+// must match Lab09_main.c
+#define TRANSMIT_PERIOD 10
+#define LINK_SILENCE_TIMEOUT 100
+#define LINK_RESEND_DELAY 50
+#define LINK_RETRY_TIMEOUT 1000
+
+// must match BOARD.c, the UART runs at PB_CLOCK / 16 / (BRG + 1) baud
+#define PB_CLOCK 20000000
+
+#define GAMES 200
+
+// enough AgentIdle() calls between messages to finish a guess search
+#define IDLE_CALLS (GUESS_ENGINE_MAX_PLACEMENTS / 32 + 1)
+
+// how long the opponent has to be quiet before the clock is moved on, and by how much (ticks)
+#define IDLE_POLL_MS 5
+#define IDLE_STEP 50
+
+// a game is abandoned once an agent has waited this long in a row (ticks)
+#define MAX_WAIT 6000
+
+/**
+ * What one agent reports back to the simulator after a game.
+ */
+typedef struct {
+    uint32_t messages; // sent by the agent
+    uint32_t bytes; // of the agent's messages, the first time they were sent
+    uint32_t linkBytes; // of ACKs, NAKs and retransmissions
+    uint64_t micros; // time spent sending
+    uint64_t waitMicros; // time spent waiting on lost messages
+    uint32_t finished; // games, or whether this agent reached the end screen
+    uint32_t aborted; // games, or whether this agent ended the game on an error
+    uint32_t maxBurst; // most bytes sent in one go
+    uint32_t stats[LINK_STATS_NUM_COUNTERS];
+} SimReport;
+
+/**
+ * One agent's end of the simulated UART.
+ */
+typedef struct {
+    int tx;
+    uint32_t baud; // 0 until the link is upgraded, and again once it falls back
+    uint32_t now; // in ticks of 10ms, like freerunning_timer in Lab09_main.c
+    uint32_t deadline; // when an upgraded link falls back, or when to resend after falling back
+    uint8_t resendPending;
+    Message lastSent; // the agent's last message, to send again after falling back
+    uint8_t retrying; // fallen back without the link layer, and nothing valid since
+    uint32_t retryDeadline; // when to give up on the game if still retrying
+    uint32_t burst; // bytes sent since the last one was received or the link went quiet
+    unsigned int noiseSeed;
+    double bitErrorRate;
+} SimLink;
+
+// whether to print the link statistics
+static uint8_t printStats = FALSE;
+
+// the most bytes sent in one go in any mode so far
+static uint32_t largestBurst = 0;
+
+// games in any mode so far that neither agent finished or ended on an error
+static uint32_t stalledGames = 0;
+
+// the OLED is not simulated
+uint8_t rgbOledBmp[OLED_DRIVER_BUFFER_SIZE];
+
+void OledHostInit(void) {
+}
+
+void OledDriverInitDisplay(void) {
+}
+
+void OledDriverDisableDisplay(void) {
+}
+
+void OledDriverUpdateDisplay(void) {
+}
+
+void OledDriverSetDisplayInverted(void) {
+}
+
+void OledDriverSetDisplayNormal(void) {
+}
+
+/**
+ * Encodes a message and writes it to the link, flipping bits at the link's bit error rate.
+ * @return The length of the encoded message.
+ */
+static int SimSend(SimLink *link, const Message *message, SimReport *report) {
+    char encoded[MESSAGE_MAX_LEN + 1];
+    int length = Message_Encode(encoded, *message);
+    int i, bit;
+
+    if (link->bitErrorRate > 0) {
+        for (i = 0; i < length; i++) {
+            for (bit = 0; bit < 8; bit++) {
+                if (rand_r(&link->noiseSeed) < link->bitErrorRate * ((double) RAND_MAX + 1)) {
+                    encoded[i] ^= 1 << bit;
+                }
+            }
+        }
+    }
+    // each byte is followed by whether it was sent at the fast rate
+    char tagged[2 * (MESSAGE_MAX_LEN + 1)];
+    for (i = 0; i < length; i++) {
+        tagged[2 * i] = encoded[i];
+        tagged[2 * i + 1] = link->baud != 0;
+    }
+    write(link->tx, tagged, 2 * length);
+    LinkStatsCount(LINK_STATS_BYTES_OUT, length);
+    link->burst += length;
+    if (link->burst > report->maxBurst) {
+        report->maxBurst = link->burst;
+    }
+
+    uint64_t micros;
+    if (link->baud) {
+        micros = length * 10000000ull / link->baud;
+    } else {
+        micros = (length + 1) * TRANSMIT_PERIOD * 10000ull;
+    }
+    report->micros += micros;
+    link->now += (micros + 9999) / 10000;
+    return length;
+}
+
+/**
+ * Switches the link to the rate the agents agreed on, if they agreed on a fast link, like
+ * Link_Upgrade() in Lab09_main.c.
+ */
+static void SimLinkUpgrade(SimLink *link) {
+    uint16_t brg;
+    if (link->baud || !AgentGetFastLink(&brg)) {
+        return;
+    }
+    link->baud = PB_CLOCK / 16 / (brg + 1);
+    link->deadline = link->now + LINK_SILENCE_TIMEOUT;
+}
+
+/**
+ * Switches the link back to the default rate, like Link_Fallback() in Lab09_main.c.
+ */
+static void SimLinkFallback(SimLink *link) {
+    link->baud = 0;
+    LinkStatsCount(LINK_STATS_RATE_FALLBACKS, 1);
+    link->resendPending = (AgentGetState() == AGENT_STATE_ATTACKING) && !LinkLayerIsEnabled();
+    link->deadline = link->now + LINK_RESEND_DELAY;
+    link->retrying = !LinkLayerIsEnabled();
+    link->retryDeadline = link->now + LINK_RETRY_TIMEOUT;
+}
+
+/**
+ * Runs one agent until it reaches the end screen or its opponent hangs up.  Every message the
+ * agent sends is written to the link in full, followed by a MESSAGE_SENT event.
+ */
+static SimReport SimRunAgent(int rx, SimLink *link, BB_EventType firstEvent) {
+    SimReport report = {0, 0, 0, 0, 0, FALSE, FALSE};
+    BB_Event event = {firstEvent};
+    struct pollfd incoming = {rx, POLLIN};
+    Message frame;
+    unsigned char c[2];
+    uint32_t waited = 0;
+    int i;
+
+    while (1) {
+        while (event.type != BB_EVENT_NO_EVENT) {
+            if (link->baud && event.type == BB_EVENT_ERROR) {
+                SimLinkFallback(link);
+                event.type = BB_EVENT_NO_EVENT;
+                break;
+            } else if (event.type != BB_EVENT_MESSAGE_SENT && event.type != BB_EVENT_ERROR) {
+                link->retrying = FALSE;
+                if (link->baud) {
+                    link->deadline = link->now + LINK_SILENCE_TIMEOUT;
+                }
+            }
+            if (!LinkLayerReceive(&event, link->now)) {
+                break;
+            }
+            if (event.type == BB_EVENT_ERROR) {
+                report.aborted = TRUE;
+            }
+            Message message = AgentRun(event);
+            if (event.type == BB_EVENT_REV_RECEIVED) {
+                SimLinkUpgrade(link);
+            }
+            event.type = BB_EVENT_NO_EVENT;
+            if (message.type == MESSAGE_NONE || message.type == MESSAGE_ERROR) {
+                continue;
+            }
+            if (LinkLayerSend(&message, link->now) != SUCCESS) {
+                // like Lab09_main.c, the game cannot go on without room for the message
+                BB_Event windowFull = {
+                    .type = BB_EVENT_ERROR, .param0 = BB_ERROR_LINK_WINDOW_FULL
+                };
+                report.aborted = TRUE;
+                AgentRun(windowFull);
+            } else {
+                report.messages++;
+                report.bytes += SimSend(link, &message, &report);
+                link->lastSent = message;
+                if (message.type == MESSAGE_REV) {
+                    SimLinkUpgrade(link);
+                }
+                event.type = BB_EVENT_MESSAGE_SENT;
+            }
+        }
+        while (LinkLayerPoll(&frame, link->now)) {
+            report.linkBytes += SimSend(link, &frame, &report);
+        }
+        if (AgentGetState() == AGENT_STATE_END_SCREEN) {
+            report.finished = TRUE;
+        }
+
+        for (i = 0; i < IDLE_CALLS; i++) {
+            AgentIdle();
+        }
+
+        // if the opponent has nothing more to say, something got lost or the game is over
+        if (poll(&incoming, 1, IDLE_POLL_MS) == 0) {
+            if (report.finished || report.aborted || waited >= MAX_WAIT) {
+                break;
+            }
+            link->now += IDLE_STEP;
+            link->burst = 0;
+            waited += IDLE_STEP;
+            if (LinkLayerIsEnabled() || link->resendPending || link->retrying) {
+                report.waitMicros += IDLE_STEP * 10000ull;
+            }
+            // a message that stopped partway through has lost its end
+            if (Message_DecodeTimeout(&event) == STANDARD_ERROR) {
+                continue;
+            }
+            if (link->baud && (int32_t) (link->deadline - link->now) <= 0) {
+                SimLinkFallback(link);
+            } else if (link->resendPending && (int32_t) (link->deadline - link->now) <= 0) {
+                link->resendPending = FALSE;
+                report.linkBytes += SimSend(link, &link->lastSent, &report);
+            } else if (link->retrying && (int32_t) (link->retryDeadline - link->now) <= 0) {
+                link->retrying = FALSE;
+                event.type = BB_EVENT_ERROR;
+                event.param0 = BB_ERROR_LINK_TIMEOUT;
+            }
+            continue;
+        }
+        if (read(rx, c, 2) != 2) {
+            break;
+        }
+        waited = 0;
+        link->burst = 0;
+        LinkStatsCount(LINK_STATS_BYTES_IN, 1);
+        if (c[1] != (link->baud != 0)) {
+            c[0] = rand_r(&link->noiseSeed);
+        }
+        Message_Decode(c[0], &event);
+        LinkStatsCountDecode(&event);
+    }
+
+    for (i = 0; i < LINK_STATS_NUM_COUNTERS; i++) {
+        report.stats[i] = LinkStatsGet(i);
+    }
+    return report;
+}
+
+/**
+ * Plays one game in two child processes and adds both reports to total.
+ */
+static void SimPlayGame(unsigned int seed, uint8_t capabilities, double bitErrorRate,
+        SimReport *total) {
+    int toChallenger[2], toAccepter[2], reports[2];
+    int player;
+    pipe(toChallenger);
+    pipe(toAccepter);
+    pipe(reports);
+    fflush(stdout);
+
+    for (player = 0; player < 2; player++) {
+        if (fork() == 0) {
+            SimReport report;
+            SimLink link = {0};
+            link.noiseSeed = seed * 2 + player;
+            link.bitErrorRate = bitErrorRate;
+            signal(SIGPIPE, SIG_IGN);
+            srand(seed * 2 + player);
+            LinkStatsInit();
+            AgentInit();
+            AgentSetOfferedCapabilities(capabilities);
+            if (player == 0) {
+                close(toChallenger[1]);
+                close(toAccepter[0]);
+                link.tx = toAccepter[1];
+                report = SimRunAgent(toChallenger[0], &link, BB_EVENT_START_BUTTON);
+            } else {
+                close(toAccepter[1]);
+                close(toChallenger[0]);
+                link.tx = toChallenger[1];
+                report = SimRunAgent(toAccepter[0], &link, BB_EVENT_NO_EVENT);
+            }
+            write(reports[1], &report, sizeof (report));
+            _exit(0);
+        }
+    }
+    close(toChallenger[0]);
+    close(toChallenger[1]);
+    close(toAccepter[0]);
+    close(toAccepter[1]);
+    close(reports[1]);
+
+    SimReport report;
+    uint8_t finished = FALSE, aborted = FALSE;
+    uint64_t waitMicros = 0;
+    while (read(reports[0], &report, sizeof (report)) == sizeof (report)) {
+        int i;
+        for (i = 0; i < LINK_STATS_NUM_COUNTERS; i++) {
+            total->stats[i] += report.stats[i];
+        }
+        total->messages += report.messages;
+        total->bytes += report.bytes;
+        total->linkBytes += report.linkBytes;
+        total->micros += report.micros;
+        if (report.waitMicros > waitMicros) {
+            waitMicros = report.waitMicros;
+        }
+        if (report.maxBurst > total->maxBurst) {
+            total->maxBurst = report.maxBurst;
+        }
+        finished |= report.finished;
+        aborted |= report.aborted;
+    }
+    total->waitMicros += waitMicros;
+    total->finished += finished && !aborted;
+    total->aborted += aborted;
+    close(reports[0]);
+    while (wait(NULL) > 0);
+}
+
+/**
+ * @return The smallest power of two ring buffer that holds the given number of bytes.
+ */
+static uint32_t SimRingSize(uint32_t bytes) {
+    uint32_t size = 2;
+    while (size < bytes) {
+        size <<= 1;
+    }
+    return size;
+}
+
+/**
+ * Plays GAMES games with the given extensions offered and prints the averages.  Goodput is the
+ * bytes of the agents' own messages sent per second of game.
+ * @return The average game duration in seconds.
+ */
+static double SimRunMode(const char *name, uint8_t capabilities, double bitErrorRate) {
+    SimReport total = {0, 0, 0, 0, 0, 0, 0, 0};
+    unsigned int game;
+    int i;
+    for (game = 0; game < GAMES; game++) {
+        SimPlayGame(game, capabilities, bitErrorRate, &total);
+    }
+
+    double seconds = (total.micros + total.waitMicros) / 1e6 / GAMES;
+    printf("%-10s %8.0e %8u %8u %10.1f %8.1f %8.1f %10.2f %8.2f %6u\n", name, bitErrorRate,
+            total.finished, total.aborted, (double) total.messages / GAMES,
+            (double) total.bytes / GAMES, (double) total.linkBytes / GAMES, seconds,
+            (double) total.bytes / GAMES / seconds, SimRingSize(total.maxBurst));
+    if (total.maxBurst > largestBurst) {
+        largestBurst = total.maxBurst;
+    }
+    stalledGames += GAMES - total.finished - total.aborted;
+
+    if (printStats) {
+        for (i = 0; i < LINK_STATS_NUM_COUNTERS; i++) {
+            if (total.stats[i]) {
+                printf("    %-22s %10.1f\n", LinkStatsName(i), (double) total.stats[i] / GAMES);
+            }
+        }
+    }
+    return seconds;
+}
+
+int main(int argc, char **argv) {
+    static const double bitErrorRates[] = {1e-4, 3e-4, 1e-3, 3e-3};
+    int i;
+
+    printStats = (argc > 1 && strcmp(argv[1], "stats") == 0);
+
+    printf("%-10s %8s %8s %8s %10s %8s %8s %10s %8s %6s\n", "protocol", "BER", "finished",
+            "aborted", "messages", "bytes", "link", "seconds", "goodput", "ring");
+    double legacy = SimRunMode("legacy", 0, 0);
+    double combined = SimRunMode("RSH", MESSAGE_CAPABILITY_RSH, 0);
+    double salvo = SimRunMode("salvo", MESSAGE_CAPABILITY_SALVO, 0);
+    double fast = SimRunMode("fast link", MESSAGE_CAPABILITY_FAST_LINK, 0);
+    double crc = SimRunMode("CRC", MESSAGE_CAPABILITY_CRC, 0);
+    double reliable = SimRunMode("reliable", MESSAGE_CAPABILITY_RELIABLE, 0);
+    double strong = SimRunMode("strong", MESSAGE_CAPABILITY_STRONG_COMMIT, 0);
+    printf("combined result/shot messages cut game duration by %.1f%%\n",
+            100.0 * (legacy - combined) / legacy);
+    printf("salvos cut game duration by %.1f%%\n", 100.0 * (legacy - salvo) / legacy);
+    printf("a fast link cuts game duration by %.1f%%\n", 100.0 * (legacy - fast) / legacy);
+    printf("CRC framing adds %.1f%% to game duration\n", 100.0 * (crc - legacy) / legacy);
+    printf("the link layer adds %.1f%% to game duration\n", 100.0 * (reliable - legacy) / legacy);
+    printf("the strong commitment adds %.1f%% to game duration\n\n",
+            100.0 * (strong - legacy) / legacy);
+
+    for (i = 0; i < sizeof (bitErrorRates) / sizeof (bitErrorRates[0]); i++) {
+        SimRunMode("legacy", 0, bitErrorRates[i]);
+        SimRunMode("reliable", MESSAGE_CAPABILITY_RELIABLE, bitErrorRates[i]);
+        SimRunMode("rel+CRC", MESSAGE_CAPABILITY_RELIABLE | MESSAGE_CAPABILITY_CRC,
+                bitErrorRates[i]);
+        SimRunMode("fast link", MESSAGE_CAPABILITY_FAST_LINK, bitErrorRates[i]);
+    }
+
+    printf("\nat most %u bytes sent in one go, UART rings of %u bytes are safe\n",
+            largestBurst, SimRingSize(largestBurst));
+    printf("UART1_RX_BUFFER_SIZE is %u, UART1_TX_BUFFER_SIZE is %u\n", UART1_RX_BUFFER_SIZE,
+            UART1_TX_BUFFER_SIZE);
+    if (stalledGames) {
+        printf("%u games stalled\n", stalledGames);
+        return 1;
+    }
+    printf("no game stalled\n");
+    return 0;
+}
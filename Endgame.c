@@ -0,0 +1,451 @@
+/*
+ * File:   Endgame.c
+ * Author: jwang456
+ *
+ * Purpose: Exact search for the last shots of a game
+ *
+ *
+ */
+#include "Endgame.h"
+
+#include <stdint.h>
+
+#include "BOARD.h"
+#include "Field.h"
+
+#define NUM_DIRS 2
+#define NO_COST 0xFFFF
+
+struct Endgame {
+    // the boats still afloat, largest first
+    uint8_t boats[FIELD_NUM_BOATS];
+    uint8_t numBoats;
+    // the squares a boat can cover, and the hits they have to
+    FieldBitboard open;
+    FieldBitboard hits;
+    // the placement being listed, and the boats placed in it so far
+    FieldBitboard current[FIELD_NUM_BOATS];
+    uint8_t placed;
+    // every placement of the fleet found: the squares of each boat, and all of them together
+    FieldBitboard squares[ENDGAME_MAX_PLACEMENTS][FIELD_NUM_BOATS];
+    FieldBitboard occupied[ENDGAME_MAX_PLACEMENTS];
+    uint8_t count;
+    uint8_t limit;
+    uint16_t nodes;
+    uint8_t abandoned;
+    // searched positions, by the placements left and the squares of theirs not yet shot
+    struct {
+        uint64_t placements;
+        uint32_t shot;
+        uint16_t cost;
+        uint8_t exact;
+    } memo[ENDGAME_MEMO_SIZE];
+};
+
+static struct Endgame endgame;
+
+static uint16_t EndgameCountSquares(const FieldBitboard *b) {
+    uint16_t count = 0;
+    int i;
+    for (i = 0; i < FIELD_BITBOARD_WORDS; i++) {
+        count += __builtin_popcountll(b->words[i]);
+    }
+    return count;
+}
+
+// counts a node, and gives up once the budget is spent
+static uint8_t EndgameVisit(void) {
+    if (endgame.abandoned || ++endgame.nodes > ENDGAME_NODE_BUDGET) {
+        endgame.abandoned = TRUE;
+    }
+    return !endgame.abandoned;
+}
+
+// tries a boat in one placement, with the rest placed around it
+static void EndgamePlace(uint8_t i, const FieldBitboard *occupied, uint8_t lengthLeft,
+        uint8_t row, uint8_t col, uint8_t dir);
+
+// lists the placements of the boats not yet placed that fit around those already placed, each
+// one once: the first hit left over is covered before anything else is placed
+static void EndgameList(const FieldBitboard *occupied, uint8_t lengthLeft) {
+    FieldBitboard uncovered;
+    uint8_t i, j;
+    int w;
+
+    if (!EndgameVisit()) {
+        return;
+    }
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        uncovered.words[w] = endgame.hits.words[w] & ~occupied->words[w];
+    }
+    if (EndgameCountSquares(&uncovered) > lengthLeft) {
+        return;
+    }
+    if (lengthLeft == 0) {
+        if (endgame.count == endgame.limit) {
+            endgame.abandoned = TRUE;
+            return;
+        }
+        for (i = 0; i < endgame.numBoats; i++) {
+            endgame.squares[endgame.count][i] = endgame.current[i];
+        }
+        endgame.occupied[endgame.count++] = *occupied;
+        return;
+    }
+
+    for (w = 0; w < FIELD_BITBOARD_WORDS && uncovered.words[w] == 0; w++);
+    if (w == FIELD_BITBOARD_WORDS) {
+        // nothing left to cover, so the boats are placed in order
+        for (i = 0; endgame.placed & (1 << i); i++);
+        uint8_t length = fieldBoatSizes[endgame.boats[i]];
+        uint8_t dir, row, col;
+        for (dir = 0; dir < NUM_DIRS && !endgame.abandoned; dir++) {
+            uint8_t dRow = (dir == FIELD_DIR_SOUTH), dCol = (dir == FIELD_DIR_EAST);
+            for (row = 0; row + dRow * (length - 1) < FIELD_ROWS && !endgame.abandoned; row++) {
+                for (col = 0; col + dCol * (length - 1) < FIELD_COLS; col++) {
+                    EndgamePlace(i, occupied, lengthLeft, row, col, dir);
+                }
+            }
+        }
+        return;
+    }
+
+    // some boat not yet placed has to cover the first hit, along its row or column
+    uint16_t bit = w * 64 + __builtin_ctzll(uncovered.words[w]);
+    uint8_t hitRow = FIELD_BITBOARD_ROW(bit), hitCol = FIELD_BITBOARD_COL(bit);
+    for (i = 0; i < endgame.numBoats && !endgame.abandoned; i++) {
+        if (endgame.placed & (1 << i)) {
+            continue;
+        }
+        uint8_t length = fieldBoatSizes[endgame.boats[i]];
+        for (j = 0; j < length; j++) {
+            if (hitCol >= j && hitCol - j + length <= FIELD_COLS) {
+                EndgamePlace(i, occupied, lengthLeft, hitRow, hitCol - j, FIELD_DIR_EAST);
+            }
+            if (hitRow >= j && hitRow - j + length <= FIELD_ROWS) {
+                EndgamePlace(i, occupied, lengthLeft, hitRow - j, hitCol, FIELD_DIR_SOUTH);
+            }
+        }
+    }
+}
+
+static void EndgamePlace(uint8_t i, const FieldBitboard *occupied, uint8_t lengthLeft,
+        uint8_t row, uint8_t col, uint8_t dir) {
+    FieldBitboard *p = &endgame.current[i], next;
+    uint8_t length = fieldBoatSizes[endgame.boats[i]];
+    uint8_t dRow = (dir == FIELD_DIR_SOUTH), dCol = (dir == FIELD_DIR_EAST);
+    uint8_t j, allHits = TRUE;
+    int w;
+
+    if (endgame.abandoned) {
+        return;
+    }
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        p->words[w] = 0;
+    }
+    for (j = 0; j < length; j++) {
+        uint16_t bit = FIELD_BITBOARD_BIT(row + dRow * j, col + dCol * j);
+        if (!FIELD_BITBOARD_TEST(&endgame.open, bit) || FIELD_BITBOARD_TEST(occupied, bit)) {
+            return;
+        }
+        allHits &= FIELD_BITBOARD_TEST(&endgame.hits, bit);
+        FIELD_BITBOARD_SET(p, bit);
+    }
+    // a boat that had been hit on every square would have been reported sunk
+    if (allHits) {
+        return;
+    }
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        next.words[w] = occupied->words[w] | p->words[w];
+    }
+    endgame.placed |= 1 << i;
+    EndgameList(&next, lengthLeft - length);
+    endgame.placed &= ~(1 << i);
+}
+
+/*
+ * Returns the fewest shots, summed over a set of placements, that sink every boat in all of them
+ * once some squares have been shot, and fills in the first of those shots if asked.  Once it is
+ * clear that it takes at least a ceiling, the search stops and returns something at least that.
+ */
+static uint16_t EndgameSolve(uint64_t placements, const FieldBitboard *shot, uint16_t ceiling,
+        GuessData *guess) {
+    FieldBitboard all = {{0}}, next;
+    uint8_t order[FIELD_SQUARES], under[FIELD_BITBOARD_WORDS * 64] = {0};
+    uint16_t bound = 0, best = ceiling;
+    uint8_t count = 0, candidates = 0;
+    uint64_t left, bits;
+    int c, i, w;
+
+    if (!EndgameVisit()) {
+        return 0;
+    }
+
+    // every placement still needs a shot on each of its squares not yet shot
+    for (left = placements; left; left &= left - 1) {
+        c = __builtin_ctzll(left);
+        for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+            bits = endgame.occupied[c].words[w] & ~shot->words[w];
+            all.words[w] |= bits;
+            bound += __builtin_popcountll(bits);
+            for (; bits; bits &= bits - 1) {
+                under[w * 64 + __builtin_ctzll(bits)]++;
+            }
+        }
+        count++;
+    }
+    if (bound == 0 || (count == 1 && !guess)) {
+        return bound;
+    }
+
+    // only the squares left under some placement matter
+    uint32_t key = 0;
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        uint64_t h = (all.words[w] ^ w) * 0x9E3779B97F4A7C15ull;
+        key ^= (uint32_t) (h >> 32);
+    }
+    uint16_t slot = (uint16_t) ((placements * 0xFF51AFD7ED558CCDull ^ key) >> 48) &
+            (ENDGAME_MEMO_SIZE - 1);
+    if (!guess && endgame.memo[slot].placements == placements && endgame.memo[slot].shot == key &&
+            (endgame.memo[slot].exact || endgame.memo[slot].cost >= ceiling)) {
+        return endgame.memo[slot].cost;
+    }
+
+    // squares under the most placements first, since they lower the bound the most
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        for (bits = all.words[w]; bits; bits &= bits - 1) {
+            uint8_t bit = w * 64 + __builtin_ctzll(bits);
+            for (i = candidates++; i > 0 && under[order[i - 1]] < under[bit]; i--) {
+                order[i] = order[i - 1];
+            }
+            order[i] = bit;
+        }
+    }
+
+    // a square under every placement has to be shot anyway, and shooting it first can only tell
+    // us more, so nothing else needs to be tried
+    if (under[order[0]] == count) {
+        candidates = 1;
+    }
+
+    // whatever is shot first misses the placements it is not under
+    if (bound + count - under[order[0]] >= ceiling) {
+        return bound + count - under[order[0]];
+    }
+
+    for (i = 0; i < candidates; i++) {
+        uint8_t bit = order[i];
+        if (count + bound - under[bit] >= best) {
+            break;
+        }
+
+        // split the placements by what the shot would be told
+        uint64_t miss = 0, hit = 0, sunk[FIELD_NUM_BOATS] = {0};
+        next = *shot;
+        FIELD_BITBOARD_SET(&next, bit);
+        for (left = placements; left; left &= left - 1) {
+            c = __builtin_ctzll(left);
+            uint64_t mask = (uint64_t) 1 << c;
+            if (!FIELD_BITBOARD_TEST(&endgame.occupied[c], bit)) {
+                miss |= mask;
+                continue;
+            }
+            uint8_t boat = 0;
+            while (!FIELD_BITBOARD_TEST(&endgame.squares[c][boat], bit)) {
+                boat++;
+            }
+            uint64_t afloat = 0;
+            for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+                afloat |= endgame.squares[c][boat].words[w] & ~next.words[w];
+            }
+            if (afloat) {
+                hit |= mask;
+            } else {
+                sunk[boat] |= mask;
+            }
+        }
+
+        // each outcome only has to be searched as far as this shot could still be the best
+        uint16_t cost = count;
+        uint8_t boat;
+        if (miss && cost < best) cost += EndgameSolve(miss, &next, best - cost, NULL);
+        if (hit && cost < best) cost += EndgameSolve(hit, &next, best - cost, NULL);
+        for (boat = 0; boat < endgame.numBoats && cost < best; boat++) {
+            if (sunk[boat]) cost += EndgameSolve(sunk[boat], &next, best - cost, NULL);
+        }
+        if (endgame.abandoned) {
+            return 0;
+        }
+        if (cost < best) {
+            best = cost;
+            if (guess) {
+                guess->row = FIELD_BITBOARD_ROW(bit);
+                guess->col = FIELD_BITBOARD_COL(bit);
+            }
+        }
+    }
+
+    // if nothing came in under the ceiling, all that is known is that it takes at least that
+    endgame.memo[slot].placements = placements;
+    endgame.memo[slot].shot = key;
+    endgame.memo[slot].cost = best;
+    endgame.memo[slot].exact = (best < ceiling);
+    return best;
+}
+
+/**
+ * EndgameDecideGuess() finds the shot that sinks the remaining boats in the fewest shots on
+ * average, if there are few enough ways for them to lie.
+ *
+ * Nothing is solved while a sunk boat has squares that have not been placed, since the hits left
+ * over could belong to it or to a boat still afloat.
+ *
+ * @param opp_field The opponent's field.
+ * @param max_placements The most placements of the remaining boats to solve, up to
+ *                       ENDGAME_MAX_PLACEMENTS.
+ * @param guess Filled with the shot.
+ * @return TRUE if the shot was found, FALSE if there are too many placements or the node budget
+ *         ran out.
+ */
+uint8_t EndgameDecideGuess(const Field *opp_field, uint8_t max_placements, GuessData *guess) {
+    FieldBitboard unknown, none = {{0}};
+    uint8_t boat, lengthLeft = 0;
+    int i, w;
+
+    // with many boats afloat there are nearly always too many placements, so they are not listed
+    for (boat = 0, i = 0; boat < FIELD_NUM_BOATS; boat++) {
+        i += (opp_field->boatLives[boat] != 0);
+    }
+    if (i == 0 || i > ENDGAME_MAX_BOATS) {
+        return FALSE;
+    }
+
+    // one pass over the field for the squares boats can cover and the squares of sunk boats
+    uint8_t placed[FIELD_NUM_BOATS] = {0};
+    uint8_t row, col;
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        unknown.words[w] = 0;
+        endgame.hits.words[w] = 0;
+    }
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            SquareStatus s = FIELD_SQUARE(opp_field, row, col);
+            if (s == FIELD_SQUARE_UNKNOWN) {
+                FIELD_BITBOARD_SET(&unknown, FIELD_BITBOARD_BIT(row, col));
+            } else if (s == FIELD_SQUARE_HIT) {
+                FIELD_BITBOARD_SET(&endgame.hits, FIELD_BITBOARD_BIT(row, col));
+            } else if (FIELD_SQUARE_IS_BOAT(s)) {
+                placed[FIELD_SQUARE_BOAT_TYPE(s)]++;
+            }
+        }
+    }
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        endgame.open.words[w] = unknown.words[w] | endgame.hits.words[w];
+    }
+
+    endgame.numBoats = 0;
+    for (boat = 0; boat < FIELD_NUM_BOATS; boat++) {
+        uint8_t length = fieldBoatSizes[boat];
+        if (opp_field->boatLives[boat] == 0) {
+            if (placed[boat] != length) {
+                return FALSE;
+            }
+            continue;
+        }
+        for (i = endgame.numBoats++; i > 0 && fieldBoatSizes[endgame.boats[i - 1]] < length;
+                i--) {
+            endgame.boats[i] = endgame.boats[i - 1];
+        }
+        endgame.boats[i] = boat;
+        lengthLeft += length;
+    }
+
+    endgame.count = 0;
+    endgame.limit = max_placements < ENDGAME_MAX_PLACEMENTS ? max_placements :
+            ENDGAME_MAX_PLACEMENTS;
+    endgame.nodes = 0;
+    endgame.abandoned = FALSE;
+    endgame.placed = 0;
+    EndgameList(&none, lengthLeft);
+    if (endgame.abandoned || endgame.count == 0) {
+        return FALSE;
+    }
+
+    // everything but the unknown squares has been shot
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        unknown.words[w] = ~unknown.words[w];
+    }
+    for (i = 0; i < ENDGAME_MEMO_SIZE; i++) {
+        endgame.memo[i].placements = 0;
+    }
+    uint64_t placements = endgame.count == 64 ? ~(uint64_t) 0 :
+            ((uint64_t) 1 << endgame.count) - 1;
+    guess->result = RESULT_MISS;
+    EndgameSolve(placements, &unknown, NO_COST, guess);
+    return !endgame.abandoned;
+}
+
+#ifdef ENDGAME_BENCHMARK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "GuessEngine.h"
+
+#define GAMES 1000
+
+static const uint8_t limits[] = {0, 2, 4, 8, 16, 32, 64};
+#define NUM_LIMITS (sizeof (limits) / sizeof (limits[0]))
+
+// plays one game against a random placement, solving exactly with up to a number of placements
+static int PlayGame(uint8_t limit, long *solved) {
+    Field own, opp;
+    FieldInit(&own, &opp);
+    FieldAIPlaceAllBoats(&own);
+    int shots = 0;
+    while (FieldGetBoatStates(&own)) {
+        GuessData guess;
+        if (limit && EndgameDecideGuess(&opp, limit, &guess)) {
+            (*solved)++;
+        } else {
+            GuessEngineBegin(&opp);
+            while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+            guess = GuessEngineResult();
+        }
+        FieldRegisterEnemyAttack(&own, &guess);
+        FieldUpdateKnowledge(&opp, &guess);
+        shots++;
+    }
+    return shots;
+}
+
+int main(void) {
+    static int heuristic[GAMES];
+    int i, game;
+
+    // the time per shot includes playing it, which is the same whichever way it was decided
+    printf("placements    mean shots    win rate    us per shot    solved exactly\n");
+    for (i = 0; i < NUM_LIMITS; i++) {
+        long shots = 0, solved = 0;
+        double wins = 0;
+        clock_t start = clock();
+        for (game = 0; game < GAMES; game++) {
+            srand(game);
+            int s = PlayGame(limits[i], &solved);
+            if (i == 0) {
+                heuristic[game] = s;
+            }
+            // against the guess engine on the same placement, a tie is half a win
+            wins += (s < heuristic[game]) + 0.5 * (s == heuristic[game]);
+            shots += s;
+        }
+        double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+        printf("%10d    %10.2f    %7.1f%%    %11.2f    %13.1f%%\n", limits[i],
+                (double) shots / GAMES, 100.0 * wins / GAMES, 1e6 * seconds / shots,
+                100.0 * solved / shots);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include <stdint.h>
+#include "Field.h"
+
+/**
+ * The endgame solver plays the last few shots exactly.  It lists every way the boats still
+ * afloat can lie on the opponent's field, each equally likely, and searches for the shot that
+ * needs the fewest shots on average to sink all of them.  The guess engine only looks one shot
+ * ahead, so near the end of a game it can take a shot that tells it less than another would.
+ *
+ * The search is over sets of placements that are still possible and the squares shot so far.
+ * Each shot splits the set by what would be reported: a miss, a hit, or which boat was sunk.
+ * The total number of shots over every placement is kept instead of the average, so everything
+ * is an integer.  Results are memoised, and the search gives up once it has looked at a fixed
+ * number of nodes so that a shot is never held up for long.
+ *
+ * The crossover against the guess engine can be measured on x86 by compiling with the
+ * ENDGAME_BENCHMARK macro, and ENDGAME_MAX_PLACEMENTS raised to try every threshold.
+ * With gcc: `gcc <field AI sources> -DENDGAME_BENCHMARK -DENDGAME_MAX_PLACEMENTS=64`, see Field.h
+ */
+
+/**
+ * The most placements of the boats still afloat that are solved exactly, anything with more is
+ * left to the guess engine.  No more than 64.
+ */
+#ifndef ENDGAME_MAX_PLACEMENTS
+#define ENDGAME_MAX_PLACEMENTS 4
+#endif
+
+/**
+ * The most boats still afloat for the placements to be listed at all.  With more there are
+ * nearly always too many of them, and finding that out costs more than the exact shots save.
+ */
+#ifndef ENDGAME_MAX_BOATS
+#define ENDGAME_MAX_BOATS 1
+#endif
+
+/**
+ * The most nodes visited, listing placements and searching, before giving up.
+ */
+#ifndef ENDGAME_NODE_BUDGET
+#define ENDGAME_NODE_BUDGET 1000
+#endif
+
+/**
+ * The number of searched positions remembered.  A power of 2.
+ */
+#ifndef ENDGAME_MEMO_SIZE
+#define ENDGAME_MEMO_SIZE 32
+#endif
+
+#if ENDGAME_MAX_PLACEMENTS < 1 || ENDGAME_MAX_PLACEMENTS > 64
+#error "ENDGAME_MAX_PLACEMENTS must be between 1 and 64"
+#endif
+
+/**
+ * EndgameDecideGuess() finds the shot that sinks the remaining boats in the fewest shots on
+ * average, if there are few enough ways for them to lie.
+ *
+ * Nothing is solved while a sunk boat has squares that have not been placed, since the hits left
+ * over could belong to it or to a boat still afloat.
+ *
+ * @param opp_field The opponent's field.
+ * @param max_placements The most placements of the remaining boats to solve, up to
+ *                       ENDGAME_MAX_PLACEMENTS.
+ * @param guess Filled with the shot.
+ * @return TRUE if the shot was found, FALSE if there are too many placements or the node budget
+ *         ran out.
+ */
+uint8_t EndgameDecideGuess(const Field *opp_field, uint8_t max_placements, GuessData *guess);
+
+#endif // ENDGAME_H
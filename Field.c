@@ -2,9 +2,73 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "BOARD.h"
+#include "GuessEngine.h"
+#include "FieldInference.h"
+#include "Endgame.h"
+#include "OpeningBook.h"
+#include "LayoutPool.h"
+#include "OpponentModel.h"
+#include "PlacementSampler.h"
 
 #define dos 2
 
+const uint8_t fieldBoatSizes[FIELD_NUM_BOATS] = FIELD_BOAT_SIZES;
+
+#ifdef FIELD_PACKED
+// the low bit of every nibble in a row
+#define NIBBLE_LOW_BITS 0x1111111111111111ull
+#define ROW_MASK (NIBBLE_LOW_BITS >> (64 - 4 * FIELD_COLS))
+
+// writes a square, which must be on the field
+static inline void FieldSetCell(Field *f, uint8_t row, uint8_t col, SquareStatus p)
+{
+    uint8_t shift = (col & 1) * 4;
+    f->grid[row][col >> 1] = (f->grid[row][col >> 1] & ~(0x0F << shift)) | (p << shift);
+}
+
+// there is no room for the boat on a square, it is only known from the square's status
+#define FieldSetBoatCell(f, row, col, b) ((void) 0)
+#define FieldGetBoatCell(f, row, col) (FIELD_SQUARE_IS_BOAT(FIELD_SQUARE(f, row, col)) ? \
+        FIELD_SQUARE(f, row, col) - FIELD_SQUARE_SMALL_BOAT + 1 : 0)
+
+// gathers a row into one word, a nibble per square
+static inline uint64_t FieldGetRow(const Field *f, uint8_t row)
+{
+    uint64_t word = 0;
+    int i;
+    for (i = FIELD_ROW_BYTES - 1; i >= 0; i--) {
+        word = (word << 8) | f->grid[row][i];
+    }
+    return word;
+}
+#else
+#define FieldSetCell(f, row, col, p) ((f)->grid[row][col] = ((f)->grid[row][col] & 0xF0) | (p))
+#define FieldSetBoatCell(f, row, col, b) \
+    ((f)->grid[row][col] = ((f)->grid[row][col] & 0x0F) | ((b) << 4))
+#define FieldGetBoatCell(f, row, col) ((f)->grid[row][col] >> 4)
+#endif
+
+// the Zobrist key of a square's status, 0 for unknown so that a fresh field's key is 0
+static inline uint32_t FieldZobrist(uint8_t row, uint8_t col, SquareStatus p)
+{
+    uint32_t x = ((row * FIELD_COLS + col) << 4 | p) + 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return p == FIELD_SQUARE_UNKNOWN ? 0 : x;
+}
+
+// writes a square of an opponent's field, keeping its key up to date
+static inline SquareStatus FieldSetKnown(Field *f, uint8_t row, uint8_t col, SquareStatus p)
+{
+    SquareStatus prev = FIELD_SQUARE(f, row, col);
+    f->key ^= FieldZobrist(row, col, prev) ^ FieldZobrist(row, col, p);
+    FieldSetCell(f, row, col, p);
+    return prev;
+}
+
 // This simply prints the representation of both fields
 void FieldPrint_UART(Field *own_field, Field * opp_field)
 {
@@ -12,7 +76,7 @@ void FieldPrint_UART(Field *own_field, Field * opp_field)
     int x, y;
     for (x = 0; x < FIELD_ROWS; x++) {
         for (y = 0; y < FIELD_COLS; y++) {
-            printf(" %d", own_field->grid[x][y]);
+            printf(" %d", FIELD_SQUARE(own_field, x, y));
         }
         printf("\n");
     }
@@ -20,7 +84,7 @@ void FieldPrint_UART(Field *own_field, Field * opp_field)
     // second field
     for (x = 0; x < FIELD_ROWS; x++) {
         for (y = 0; y < FIELD_COLS; y++) {
-            printf(" %d", opp_field->grid[x][y]);
+            printf(" %d", FIELD_SQUARE(opp_field, x, y));
         }
         printf("\n");
     }
@@ -33,62 +97,100 @@ void FieldInit(Field *own_field, Field * opp_field)
     int i, j;
     for (i = 0; i < FIELD_ROWS; i++) {
         for (j = 0; j < FIELD_COLS; j++) {
-            own_field->grid[i][j] = FIELD_SQUARE_EMPTY;
-            opp_field->grid[i][j] = FIELD_SQUARE_UNKNOWN;
+            FieldSetCell(own_field, i, j, FIELD_SQUARE_EMPTY);
+            FieldSetCell(opp_field, i, j, FIELD_SQUARE_UNKNOWN);
+            FieldSetBoatCell(own_field, i, j, 0);
+            FieldSetBoatCell(opp_field, i, j, 0);
         }
     }
-    opp_field->smallBoatLives = FIELD_BOAT_SIZE_SMALL;
-    opp_field->mediumBoatLives = FIELD_BOAT_SIZE_MEDIUM;
-    opp_field->largeBoatLives = FIELD_BOAT_SIZE_LARGE;
-    opp_field->hugeBoatLives = FIELD_BOAT_SIZE_HUGE;
-
-    own_field->smallBoatLives = 0;
-    own_field->mediumBoatLives = 0;
-    own_field->largeBoatLives = 0;
-    own_field->hugeBoatLives = 0;
+    for (i = 0; i < FIELD_NUM_BOATS; i++) {
+        opp_field->boatLives[i] = fieldBoatSizes[i];
+        own_field->boatLives[i] = 0;
+    }
+    own_field->key = 0;
+    opp_field->key = 0;
 }
 
 SquareStatus FieldGetSquareStatus(const Field *f, uint8_t row, uint8_t col)
 {
-    if (row > FIELD_ROWS || row < 0 || col > FIELD_COLS || col < 0) {
+    if (row >= FIELD_ROWS || col >= FIELD_COLS) {
         return FIELD_SQUARE_INVALID;
     } else {
-        return f->grid[row][col];
+        return FIELD_SQUARE(f, row, col);
     }
 }
 
 SquareStatus FieldSetSquareStatus(Field *f, uint8_t row, uint8_t col, SquareStatus p)
 {
-    SquareStatus prevstat = f->grid[row][col];
-    f->grid[row][col] = p;
-    return prevstat;
+    // off the field there is no square to set, nor a key for one
+    if (row >= FIELD_ROWS || col >= FIELD_COLS) {
+        return FIELD_SQUARE_INVALID;
+    }
+    return FieldSetKnown(f, row, col, p);
+}
+
+uint8_t FieldGetBoatAt(const Field *f, uint8_t row, uint8_t col)
+{
+    if (row >= FIELD_ROWS || col >= FIELD_COLS) {
+        return FIELD_NO_BOAT;
+    }
+    uint8_t boat = FieldGetBoatCell(f, row, col);
+    return boat ? boat - 1 : FIELD_NO_BOAT;
+}
+
+uint8_t FieldCountInRow(const Field *f, uint8_t row, SquareStatus p)
+{
+    if (row >= FIELD_ROWS) {
+        return 0;
+    }
+#ifdef FIELD_PACKED
+    // nibbles equal to p become 0, then every nibble that is not 0 sets its low bit
+    uint64_t differ = FieldGetRow(f, row) ^ (NIBBLE_LOW_BITS * p);
+    differ = (differ | (differ >> 1) | (differ >> 2) | (differ >> 3)) & ROW_MASK;
+    return FIELD_COLS - __builtin_popcountll(differ);
+#else
+    uint8_t col, count = 0;
+    for (col = 0; col < FIELD_COLS; col++) {
+        count += (FIELD_SQUARE(f, row, col) == p);
+    }
+    return count;
+#endif
+}
+
+void FieldGetBitboard(const Field *f, SquareStatus p, FieldBitboard *by_row, FieldBitboard *by_col)
+{
+    uint8_t row, col;
+    int i;
+    for (i = 0; i < FIELD_BITBOARD_WORDS; i++) {
+        by_row->words[i] = 0;
+        if (by_col) {
+            by_col->words[i] = 0;
+        }
+    }
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            // no branch on the square, it is as likely to match as not
+            uint64_t match = (FIELD_SQUARE(f, row, col) == p);
+            uint16_t bit = FIELD_BITBOARD_BIT(row, col);
+            by_row->words[bit >> 6] |= match << (bit & 63);
+            if (by_col) {
+                bit = FIELD_BITBOARD_BIT_BY_COL(row, col);
+                by_col->words[bit >> 6] |= match << (bit & 63);
+            }
+        }
+    }
 }
 
 uint8_t FieldAddBoat(Field *own_field, uint8_t row, uint8_t col, BoatDirection dir, BoatType boat_type)
 {
 
-    int i, length = 0;
-    SquareStatus type = FIELD_SQUARE_INVALID;
-    switch (boat_type) {
-    case FIELD_BOAT_TYPE_SMALL:
-        length = FIELD_BOAT_SIZE_SMALL;
-        type = FIELD_SQUARE_SMALL_BOAT;
-        break;
-    case FIELD_BOAT_TYPE_MEDIUM:
-        length = FIELD_BOAT_SIZE_MEDIUM;
-        type = FIELD_SQUARE_MEDIUM_BOAT;
-        break;
-    case FIELD_BOAT_TYPE_LARGE:
-        length = FIELD_BOAT_SIZE_LARGE;
-        type = FIELD_SQUARE_LARGE_BOAT;
-        break;
-    case FIELD_BOAT_TYPE_HUGE:
-        length = FIELD_BOAT_SIZE_HUGE;
-        type = FIELD_SQUARE_HUGE_BOAT;
-        break;
-    default:
+    int i, length;
+    SquareStatus type;
+    if (boat_type >= FIELD_NUM_BOATS) {
         return STANDARD_ERROR;
     }
+    length = fieldBoatSizes[boat_type];
+    type = FIELD_SQUARE_BOAT(boat_type);
 
     if (row >= FIELD_ROWS || col >= FIELD_COLS || row < 0 || col < 0) {
         return STANDARD_ERROR;
@@ -101,27 +203,15 @@ uint8_t FieldAddBoat(Field *own_field, uint8_t row, uint8_t col, BoatDirection d
         }
 
         for (i = 0; i < (length); i++) {
-            if (own_field->grid[row][col + i] != FIELD_SQUARE_EMPTY) {
+            if (FIELD_SQUARE(own_field, row, col + i) != FIELD_SQUARE_EMPTY) {
                 return STANDARD_ERROR;
             }
         }
 
         for (i = 0; i < (length); i++) {
-            own_field->grid[row][col + i] = type;
+            FieldSetCell(own_field, row, col + i, type);
+            FieldSetBoatCell(own_field, row, col + i, boat_type + 1);
         }
-
-        if (boat_type == FIELD_BOAT_TYPE_SMALL) {
-            own_field->smallBoatLives = FIELD_BOAT_SIZE_SMALL;
-        } else if (boat_type == FIELD_BOAT_TYPE_MEDIUM) {
-            own_field->mediumBoatLives = FIELD_BOAT_SIZE_MEDIUM;
-        } else if (boat_type == FIELD_BOAT_TYPE_LARGE) {
-            own_field->largeBoatLives = FIELD_BOAT_SIZE_LARGE;
-        } else if (boat_type == FIELD_BOAT_TYPE_HUGE) {
-            own_field->hugeBoatLives = FIELD_BOAT_SIZE_HUGE;
-        } else {
-            return STANDARD_ERROR;
-        }
-        return SUCCESS;
     } else if (dir == FIELD_DIR_SOUTH) {
 
         if (row + length - 1 >= FIELD_ROWS) {
@@ -129,165 +219,353 @@ uint8_t FieldAddBoat(Field *own_field, uint8_t row, uint8_t col, BoatDirection d
         }
 
         for (i = 0; i < (length); i++) {
-            if (own_field->grid[row + i][col] != FIELD_SQUARE_EMPTY) {
+            if (FIELD_SQUARE(own_field, row + i, col) != FIELD_SQUARE_EMPTY) {
                 return STANDARD_ERROR;
             }
         }
 
         for (i = 0; i < (length); i++) {
-            own_field->grid[row + i][col] = type;
+            FieldSetCell(own_field, row + i, col, type);
+            FieldSetBoatCell(own_field, row + i, col, boat_type + 1);
         }
-
-        if (boat_type == FIELD_BOAT_TYPE_SMALL) {
-            own_field->smallBoatLives = FIELD_BOAT_SIZE_SMALL;
-        } else if (boat_type == FIELD_BOAT_TYPE_MEDIUM) {
-            own_field->mediumBoatLives = FIELD_BOAT_SIZE_MEDIUM;
-        } else if (boat_type == FIELD_BOAT_TYPE_LARGE) {
-            own_field->largeBoatLives = FIELD_BOAT_SIZE_LARGE;
-        } else if (boat_type == FIELD_BOAT_TYPE_HUGE) {
-            own_field->hugeBoatLives = FIELD_BOAT_SIZE_HUGE;
-        } else {
-            return STANDARD_ERROR;
-        }
-        return SUCCESS;
     } else {
         return STANDARD_ERROR;
     }
+    own_field->boatLives[boat_type] = length;
+    return SUCCESS;
 }
 
 SquareStatus FieldRegisterEnemyAttack(Field *own_field, GuessData *opp_guess)
 {
-    SquareStatus prevstst = own_field->grid[opp_guess->row][opp_guess->col];
-
-    switch (own_field->grid[opp_guess->row][opp_guess->col]) {
-    case FIELD_BOAT_SIZE_SMALL:
-        if ((own_field->smallBoatLives) > 0) {
-            opp_guess->result = RESULT_HIT;
-        } else {
-            opp_guess->result = RESULT_SMALL_BOAT_SUNK;
-        }
-        own_field->grid[opp_guess->row][opp_guess->col] = RESULT_HIT;
-
-    case FIELD_BOAT_SIZE_MEDIUM:
-        if ((own_field->mediumBoatLives) > 0) {
-            opp_guess->result = RESULT_HIT;
-        } else {
-            opp_guess->result = RESULT_MEDIUM_BOAT_SUNK;
-        }
-        own_field->grid[opp_guess->row][opp_guess->col] = RESULT_HIT;
-
-    case FIELD_BOAT_SIZE_LARGE:
-        if ((own_field->largeBoatLives) > 0) {
-            opp_guess->result = RESULT_HIT;
-        } else {
-            opp_guess->result = RESULT_LARGE_BOAT_SUNK;
+    // shots come from the other agent, so they may be off the field
+    if (opp_guess->row >= FIELD_ROWS || opp_guess->col >= FIELD_COLS) {
+        opp_guess->result = RESULT_MISS;
+        return FIELD_SQUARE_INVALID;
+    }
+    SquareStatus prevstst = FIELD_SQUARE(own_field, opp_guess->row, opp_guess->col);
+    uint8_t boat = FieldGetBoatCell(own_field, opp_guess->row, opp_guess->col);
+
+    // squares already hit still have their boat, but only the first hit counts
+    if (!FIELD_SQUARE_IS_BOAT(prevstst) || boat == 0) {
+        opp_guess->result = RESULT_MISS;
+        if (prevstst == FIELD_SQUARE_EMPTY) {
+            FieldSetCell(own_field, opp_guess->row, opp_guess->col, FIELD_SQUARE_MISS);
         }
-        own_field->grid[opp_guess->row][opp_guess->col] = RESULT_HIT;
+        return prevstst;
+    }
 
-    case FIELD_BOAT_SIZE_HUGE:
-        if ((own_field->hugeBoatLives) > 0) {
-            opp_guess->result = RESULT_HIT;
-        } else {
-            opp_guess->result = RESULT_HUGE_BOAT_SUNK;
-        }
-        own_field->grid[opp_guess->row][opp_guess->col] = RESULT_HIT;
+    boat--;
+    if (--own_field->boatLives[boat] > 0) {
+        opp_guess->result = RESULT_HIT;
+    } else {
+        opp_guess->result = RESULT_BOAT_SUNK(boat);
     }
+    FieldSetCell(own_field, opp_guess->row, opp_guess->col, FIELD_SQUARE_HIT);
     return prevstst;
 }
 
 SquareStatus FieldUpdateKnowledge(Field *opp_field, const GuessData *own_guess)
 {
-    SquareStatus prevalue = opp_field->grid[own_guess->row][own_guess->col];
+    if (own_guess->row >= FIELD_ROWS || own_guess->col >= FIELD_COLS) {
+        return FIELD_SQUARE_INVALID;
+    }
+    SquareStatus prevalue = FIELD_SQUARE(opp_field, own_guess->row, own_guess->col);
 
     if (own_guess->result == RESULT_HIT) {
-        opp_field->grid[own_guess->row][own_guess->col] = FIELD_SQUARE_HIT;
+        FieldSetKnown(opp_field, own_guess->row, own_guess->col, FIELD_SQUARE_HIT);
     }
 
     if (own_guess->result == RESULT_MISS) {
-        opp_field->grid[own_guess->row][own_guess->col] = FIELD_SQUARE_EMPTY;
+        FieldSetKnown(opp_field, own_guess->row, own_guess->col, FIELD_SQUARE_EMPTY);
     }
 
-    if (own_guess->result == RESULT_SMALL_BOAT_SUNK) {
-        opp_field->smallBoatLives = 0;
-        opp_field->grid[own_guess->row][own_guess->col] = FIELD_SQUARE_HIT;
-    }
-
-    if (own_guess->result == RESULT_MEDIUM_BOAT_SUNK) {
-        opp_field->mediumBoatLives = 0;
-        opp_field->grid[own_guess->row][own_guess->col] = FIELD_SQUARE_HIT;
+    if (RESULT_IS_BOAT_SUNK(own_guess->result)) {
+        opp_field->boatLives[RESULT_SUNK_BOAT_TYPE(own_guess->result)] = 0;
+        FieldSetKnown(opp_field, own_guess->row, own_guess->col, FIELD_SQUARE_HIT);
+        FieldInferenceSunk(opp_field, own_guess);
     }
+    return prevalue;
+}
 
-    if (own_guess->result == RESULT_LARGE_BOAT_SUNK) {
-        opp_field->largeBoatLives = 0;
-        opp_field->grid[own_guess->row][own_guess->col] = FIELD_SQUARE_HIT;
+uint8_t FieldRegisterEnemyAttackBatch(Field *own_field, GuessData *opp_guesses, uint8_t count)
+{
+    uint8_t i, hits = 0;
+    for (i = 0; i < count; i++) {
+        if (opp_guesses[i].row >= FIELD_ROWS || opp_guesses[i].col >= FIELD_COLS) {
+            opp_guesses[i].result = RESULT_MISS;
+            continue;
+        }
+        FieldRegisterEnemyAttack(own_field, &opp_guesses[i]);
+        if (opp_guesses[i].result != RESULT_MISS) {
+            hits++;
+        }
     }
+    return hits;
+}
 
-    if (own_guess->result == RESULT_HUGE_BOAT_SUNK) {
-        opp_field->hugeBoatLives = 0;
-        opp_field->grid[own_guess->row][own_guess->col] = FIELD_SQUARE_HIT;
+uint8_t FieldUpdateKnowledgeBatch(Field *opp_field, const GuessData *own_guesses, uint8_t count)
+{
+    uint8_t i, hits = 0;
+    for (i = 0; i < count; i++) {
+        if (own_guesses[i].row >= FIELD_ROWS || own_guesses[i].col >= FIELD_COLS) {
+            continue;
+        }
+        FieldUpdateKnowledge(opp_field, &own_guesses[i]);
+        if (own_guesses[i].result != RESULT_MISS) {
+            hits++;
+        }
     }
-    return prevalue;
+    return hits;
 }
 
 uint8_t FieldGetBoatStates(const Field *f)
 {
     uint8_t shipaon = 0;
+    int i;
 
-    if (f->smallBoatLives >= 0)
-        shipaon |= FIELD_BOAT_STATUS_SMALL;
-
-    if (f->mediumBoatLives >= 0)
-        shipaon |= FIELD_BOAT_STATUS_MEDIUM;
-
-    if (f->largeBoatLives >= 0)
-        shipaon |= FIELD_BOAT_STATUS_LARGE;
-
-    if (f->hugeBoatLives >= 0)
-        shipaon |= FIELD_BOAT_STATUS_HUGE;
+    for (i = 0; i < FIELD_NUM_BOATS; i++) {
+        if (f->boatLives[i] > 0)
+            shipaon |= FIELD_BOAT_STATUS(i);
+    }
 
     return shipaon;
 }
 
-uint8_t FieldAIPlaceAllBoats(Field *own_field)
+// places every boat, from the pool if there is one for this field and anywhere they fit if not
+static uint8_t FieldAIPlaceLayout(Field *own_field)
 {
-    int smallflag = FALSE;
-    int mediumflag = FALSE;
-    int largeflag = FALSE;
-    int hugeflag = FALSE;
+    // the next boat to place, from the last one in the fleet to the first
+    int boat = FIELD_NUM_BOATS - 1;
 
     uint8_t row;
     uint8_t col;
     uint8_t dire;
 
-    while (smallflag == FALSE || smallflag == SUCCESS) {
+    // a layout that lasts against a density-based attack, if there is a pool for this field
+    if (LayoutPoolPlaceAllBoats(own_field) == SUCCESS) {
+        return SUCCESS;
+    }
+    while (TRUE) {
         dire = rand() % dos;
         col = rand() % FIELD_COLS;
         row = rand() % FIELD_ROWS;
 
-        if (hugeflag == FALSE) {
-            hugeflag = FieldAddBoat(own_field, row, col, dire, FIELD_BOAT_TYPE_HUGE);
+        // the last boat is tried first, then the next one is tried at the same spot
+        if (boat == FIELD_NUM_BOATS - 1 &&
+                FieldAddBoat(own_field, row, col, dire, boat) == SUCCESS) {
+            boat--;
         }
-        if (hugeflag == SUCCESS && largeflag == FALSE && mediumflag == FALSE && smallflag == FALSE) {
-            largeflag = FieldAddBoat(own_field, row, col, dire, FIELD_BOAT_TYPE_LARGE);
-        } else if (largeflag == SUCCESS && mediumflag == FALSE && smallflag == FALSE) {
-            mediumflag = FieldAddBoat(own_field, row, col, dire, FIELD_BOAT_TYPE_MEDIUM);
-        } else if (mediumflag == SUCCESS && smallflag == FALSE) {
-            smallflag = FieldAddBoat(own_field, row, col, dire, FIELD_BOAT_TYPE_SMALL);
-        } else if (smallflag == SUCCESS) {
+        if (boat < 0) {
             return SUCCESS;
+        } else if (boat < FIELD_NUM_BOATS - 1 &&
+                FieldAddBoat(own_field, row, col, dire, boat) == SUCCESS) {
+            boat--;
         }
     }
     return STANDARD_ERROR;
 }
 
+uint8_t FieldAIPlaceAllBoats(Field *own_field)
+{
+    Field best, layout;
+    uint32_t bestScore = 0;
+    uint8_t i;
+
+    if (OpponentModelPrior() == NULL) {
+        return FieldAIPlaceLayout(own_field);
+    }
+    // with a model of the opponent, the layout it has been slowest to reach of a few
+    for (i = 0; i < OPPONENT_MODEL_LAYOUTS; i++) {
+        layout = *own_field;
+        FieldAIPlaceLayout(&layout);
+        uint32_t score = OpponentModelLayoutScore(&layout);
+        if (i == 0 || score > bestScore) {
+            best = layout;
+            bestScore = score;
+        }
+    }
+    *own_field = best;
+    return SUCCESS;
+}
+
 GuessData FieldAIDecideGuess(const Field *opp_field)
 {
-    while (1) {
-        int row = rand() % FIELD_ROWS;
-        int col = rand() % FIELD_COLS;
-        if (opp_field->grid[row][col] == FIELD_SQUARE_UNKNOWN) {
-            GuessData gData = {row, col, RESULT_MISS};
-            return gData;
+    GuessData guess;
+    if (FieldAIDecideGuessWithoutSearch(opp_field, &guess)) {
+        return guess;
+    }
+#if FIELD_AI_SAMPLES > 0
+    // a budget of draws too, in case nothing fits
+    PlacementSamplerBegin(opp_field, FIELD_AI_SAMPLES);
+    PlacementSamplerStep(UINT16_MAX);
+    return PlacementSamplerResult();
+#else
+    GuessEngineBegin(opp_field);
+    while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+    return GuessEngineResult();
+#endif
+}
+
+uint8_t FieldAIDecideGuessWithoutSearch(const Field *opp_field, GuessData *guess)
+{
+    // the first few shots are looked up, unless a model of the opponent knows better, and the
+    // last few worked out exactly when they can be
+    if (OpponentModelPrior() == NULL && OpeningBookDecideGuess(opp_field, guess)) {
+        return TRUE;
+    }
+    return EndgameDecideGuess(opp_field, ENDGAME_MAX_PLACEMENTS, guess);
+}
+
+#ifdef FIELD_BENCHMARK
+
+#include <time.h>
+
+static volatile uint32_t sink;
+
+// counts a row one square at a time, for comparison
+static uint8_t CountInRowBySquare(const Field *f, uint8_t row, SquareStatus p)
+{
+    uint8_t col, count = 0;
+    for (col = 0; col < FIELD_COLS; col++) {
+        count += (FieldGetSquareStatus(f, row, col) == p);
+    }
+    return count;
+}
+
+// resolves an attack by switching on the square instead of reading the boat on it, for comparison
+static SquareStatus RegisterEnemyAttackBySwitch(Field *own_field, GuessData *opp_guess)
+{
+    SquareStatus prevstst = FieldGetSquareStatus(own_field, opp_guess->row, opp_guess->col);
+    uint8_t *lives;
+    ShotResult sunk;
+
+    switch (prevstst) {
+    case FIELD_SQUARE_SMALL_BOAT:
+        lives = &own_field->boatLives[FIELD_BOAT_TYPE_SMALL];
+        sunk = RESULT_SMALL_BOAT_SUNK;
+        break;
+    case FIELD_SQUARE_MEDIUM_BOAT:
+        lives = &own_field->boatLives[FIELD_BOAT_TYPE_MEDIUM];
+        sunk = RESULT_MEDIUM_BOAT_SUNK;
+        break;
+    case FIELD_SQUARE_LARGE_BOAT:
+        lives = &own_field->boatLives[FIELD_BOAT_TYPE_LARGE];
+        sunk = RESULT_LARGE_BOAT_SUNK;
+        break;
+    case FIELD_SQUARE_HUGE_BOAT:
+        lives = &own_field->boatLives[FIELD_BOAT_TYPE_HUGE];
+        sunk = RESULT_HUGE_BOAT_SUNK;
+        break;
+    default:
+        opp_guess->result = RESULT_MISS;
+        if (prevstst == FIELD_SQUARE_EMPTY) {
+            FieldSetCell(own_field, opp_guess->row, opp_guess->col, FIELD_SQUARE_MISS);
         }
+        return prevstst;
+    }
+
+    (*lives)--;
+    if (*lives > 0) {
+        opp_guess->result = RESULT_HIT;
+    } else {
+        opp_guess->result = sunk;
+    }
+    FieldSetCell(own_field, opp_guess->row, opp_guess->col, FIELD_SQUARE_HIT);
+    return prevstst;
+}
+
+// measures how long one pass of an expression over every square or row takes, in ns per item
+#define TIME_PASSES(items, expression, ns) do { \
+    long passes = 0; \
+    clock_t start = clock(); \
+    while (clock() - start < CLOCKS_PER_SEC / 10) { \
+        uint8_t row, col; \
+        int repeat; \
+        for (repeat = 0; repeat < 1000; repeat++, passes++) { \
+            for (row = 0; row < FIELD_ROWS; row++) { \
+                for (col = 0; col < FIELD_COLS; col++) { \
+                    expression; \
+                } \
+            } \
+        } \
+    } \
+    ns = 1e9 * (clock() - start) / CLOCKS_PER_SEC / passes / (items); \
+} while (0)
+
+int main(void)
+{
+    Field own, opp;
+    int i, mismatches = 0;
+    double ns;
+
+#ifdef FIELD_PACKED
+    printf("packed fields\n");
+#else
+    printf("byte per square fields\n");
+#endif
+    printf("sizeof(Field): %u bytes, %u for an agent's two fields\n", (unsigned) sizeof (Field),
+            (unsigned) (2 * sizeof (Field)));
+
+    // a game's worth of random knowledge, counted both ways
+    srand(1);
+    FieldInit(&own, &opp);
+    FieldAIPlaceAllBoats(&own);
+    for (i = 0; i < 1000; i++) {
+        GuessData guess = {rand() % FIELD_ROWS, rand() % FIELD_COLS};
+        FieldRegisterEnemyAttack(&own, &guess);
+        FieldUpdateKnowledge(&opp, &guess);
+        uint8_t row = rand() % FIELD_ROWS, p = rand() % FIELD_SQUARE_CURSOR;
+        mismatches += FieldCountInRow(&opp, row, p) != CountInRowBySquare(&opp, row, p);
+        mismatches += FieldCountInRow(&own, row, p) != CountInRowBySquare(&own, row, p);
+    }
+    printf("row counts checked square by square: %d, mismatches: %d\n", 2 * i, mismatches);
+
+    TIME_PASSES(FIELD_ROWS * FIELD_COLS, sink += FieldGetSquareStatus(&opp, row, col), ns);
+    printf("FieldGetSquareStatus()    %6.2f ns per square\n", ns);
+    TIME_PASSES(FIELD_ROWS * FIELD_COLS, sink += FieldSetSquareStatus(&own, row, col,
+            FieldGetSquareStatus(&opp, row, col)), ns);
+    printf("FieldSetSquareStatus()    %6.2f ns per square\n", ns);
+    TIME_PASSES(FIELD_ROWS * FIELD_COLS, if (col == 0) sink += CountInRowBySquare(&opp, row,
+            FIELD_SQUARE_UNKNOWN), ns);
+    printf("unknowns counted by square %5.2f ns per square\n", ns);
+    TIME_PASSES(FIELD_ROWS * FIELD_COLS, if (col == 0) sink += FieldCountInRow(&opp, row,
+            FIELD_SQUARE_UNKNOWN), ns);
+    printf("FieldCountInRow()         %6.2f ns per square\n", ns);
+
+    // attacks on every square of a fresh field, resolved both ways
+    Field fresh, byBoat, bySwitch;
+    GuessData guess;
+    FieldInit(&fresh, &opp);
+    FieldAIPlaceAllBoats(&fresh);
+    byBoat = bySwitch = fresh;
+    mismatches = 0;
+    for (i = 0; i < FIELD_ROWS * FIELD_COLS * 2; i++) {
+        GuessData a = {rand() % FIELD_ROWS, rand() % FIELD_COLS}, b = a;
+        mismatches += FieldRegisterEnemyAttack(&byBoat, &a) != RegisterEnemyAttackBySwitch(&bySwitch, &b);
+        mismatches += a.result != b.result;
     }
-}
\ No newline at end of file
+    printf("attacks checked against the switch: %d, mismatches: %d\n", i, mismatches);
+    TIME_PASSES(FIELD_ROWS * FIELD_COLS, if (row == 0 && col == 0) bySwitch = fresh;
+            guess.row = row; guess.col = col;
+            sink += RegisterEnemyAttackBySwitch(&bySwitch, &guess) + guess.result, ns);
+    printf("attacks by switch         %6.2f ns per attack, %.1f million per second\n", ns, 1e3 / ns);
+    TIME_PASSES(FIELD_ROWS * FIELD_COLS, if (row == 0 && col == 0) byBoat = fresh;
+            guess.row = row; guess.col = col;
+            sink += FieldRegisterEnemyAttack(&byBoat, &guess) + guess.result, ns);
+    printf("FieldRegisterEnemyAttack() %5.2f ns per attack, %.1f million per second\n", ns, 1e3 / ns);
+
+    // the guess engine reads every square through FIELD_SQUARE()
+    FieldInit(&own, &opp);
+    long placements = 0;
+    clock_t start = clock();
+    while (clock() - start < CLOCKS_PER_SEC / 10) {
+        GuessEngineBegin(&opp);
+        GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS);
+        placements += GUESS_ENGINE_MAX_PLACEMENTS;
+    }
+    printf("guess engine: %.0f placements per ms\n",
+            placements / (1000.0 * (clock() - start) / CLOCKS_PER_SEC));
+    return 0;
+}
+
+#endif
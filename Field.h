@@ -15,6 +15,67 @@
 #define FIELD_ROWS 6
 #endif
 
+/**
+ * Fields can be up to 16x16: shots are sent with a row and a column of 4 bits each (see
+ * MESSAGE_PACK_SHOT()), and FIELD_PACKED rows have to fit in a 64-bit word.  Only the standard
+ * 10x6 field fits the OLED with a symbol per square, bigger ones are drawn with a block of pixels
+ * per square (see FieldOled.c) and are mostly useful in simulation.
+ */
+#if FIELD_ROWS < 1 || FIELD_ROWS > 16 || FIELD_COLS < 1 || FIELD_COLS > 16
+#error "fields can have 1 to 16 rows and columns"
+#endif
+#define FIELD_SQUARES (FIELD_ROWS * FIELD_COLS)
+
+/**
+ * The fleet each agent places is described by a table of boat sizes, indexed by BoatType.  It
+ * defaults to the standard fleet of one small, medium, large and huge boat, and can be overridden
+ * at compile time for simulation, for example with
+ * `-DFIELD_NUM_BOATS=5 -DFIELD_BOAT_SIZES="{2, 3, 3, 4, 5}"`.  Boats are placed from the last
+ * one in the table to the first, so it is best to list them from smallest to biggest.
+ *
+ * There can be at most 8 boats, so that FieldGetBoatStates() has a bit for each.  The first four
+ * boats keep the names of the standard fleet, and a boat's square status, sunk result and status
+ * flag are found with FIELD_SQUARE_BOAT(), RESULT_BOAT_SUNK() and FIELD_BOAT_STATUS().
+ */
+#ifndef FIELD_NUM_BOATS
+#define FIELD_NUM_BOATS 4
+#endif
+#if FIELD_NUM_BOATS < 1 || FIELD_NUM_BOATS > 8
+#error "fleets can have 1 to 8 boats"
+#endif
+
+/**
+ * Constants for specifying which boat the current operation refers to. This is independent of the
+ * SquareStatus enum.  Boats after the huge one have no name of their own.
+ */
+typedef enum {
+    FIELD_BOAT_TYPE_SMALL,
+    FIELD_BOAT_TYPE_MEDIUM,
+    FIELD_BOAT_TYPE_LARGE,
+    FIELD_BOAT_TYPE_HUGE
+} BoatType;
+
+/**
+ * This enum lists the number of squares, each boat of the standard fleet occupies (and therefore,
+ * the number of lives) that each boat has.
+ */
+typedef enum {
+    FIELD_BOAT_SIZE_SMALL = 3,
+    FIELD_BOAT_SIZE_MEDIUM = 4,
+    FIELD_BOAT_SIZE_LARGE = 5,
+    FIELD_BOAT_SIZE_HUGE = 6
+} BoatSize;
+
+#ifndef FIELD_BOAT_SIZES
+#define FIELD_BOAT_SIZES \
+    {FIELD_BOAT_SIZE_SMALL, FIELD_BOAT_SIZE_MEDIUM, FIELD_BOAT_SIZE_LARGE, FIELD_BOAT_SIZE_HUGE}
+#endif
+
+/**
+ * The size of each boat of the fleet, indexed by BoatType.
+ */
+extern const uint8_t fieldBoatSizes[FIELD_NUM_BOATS];
+
 /**
  * Set different constants used for conveying different information about the different locations
  * of the field. These values should be used for the actual storage of the field state, which is
@@ -28,9 +89,11 @@ typedef enum {
     FIELD_SQUARE_MEDIUM_BOAT, 	// This position contains part of the medium boat.
     FIELD_SQUARE_LARGE_BOAT, 	// This position contains part of the large boat.
     FIELD_SQUARE_HUGE_BOAT, 	// This position contains part of the huge boat.
+								// Boats after the huge one follow it, see FIELD_SQUARE_BOAT().
 
     /// These denote field positions useful for representing the enemy's board
-    FIELD_SQUARE_UNKNOWN, 		// It is unknown what is here. Useful for denoting a position on the
+    FIELD_SQUARE_UNKNOWN = FIELD_SQUARE_SMALL_BOAT + (FIELD_NUM_BOATS > 4 ? FIELD_NUM_BOATS : 4),
+								// It is unknown what is here. Useful for denoting a position on the
 								// enemy's board that hasn't been checked.
 								
 	///these statuses may be used on either field:    
@@ -45,6 +108,14 @@ typedef enum {
     FIELD_SQUARE_INVALID,
 } SquareStatus;
 
+/**
+ * Converts between a BoatType and the SquareStatus of the squares it covers.
+ */
+#define FIELD_SQUARE_BOAT(type) ((SquareStatus) (FIELD_SQUARE_SMALL_BOAT + (type)))
+#define FIELD_SQUARE_IS_BOAT(s) ((s) >= FIELD_SQUARE_SMALL_BOAT && \
+        (s) < FIELD_SQUARE_SMALL_BOAT + FIELD_NUM_BOATS)
+#define FIELD_SQUARE_BOAT_TYPE(s) ((BoatType) ((s) - FIELD_SQUARE_SMALL_BOAT))
+
 /**
  * These are the possible results of shots:
  */
@@ -58,6 +129,15 @@ typedef enum {
     RESULT_HUGE_BOAT_SUNK,      //5
 } ShotResult;
 
+/**
+ * Converts between a BoatType and the result of the shot that sinks it.  Results are sent in 4
+ * bits (see MESSAGE_PACK_RESULT()), which is enough for 8 boats.
+ */
+#define RESULT_BOAT_SUNK(type) ((ShotResult) (RESULT_SMALL_BOAT_SUNK + (type)))
+#define RESULT_IS_BOAT_SUNK(r) ((r) >= RESULT_SMALL_BOAT_SUNK && \
+        (r) < RESULT_SMALL_BOAT_SUNK + FIELD_NUM_BOATS)
+#define RESULT_SUNK_BOAT_TYPE(r) ((BoatType) ((r) - RESULT_SMALL_BOAT_SUNK))
+
 /**
  * GuessData is used for exchanging coordinate data along with information about of coordinate.
  */
@@ -67,22 +147,107 @@ typedef struct {
     ShotResult result; // result of a shot at this coordinate
 } GuessData;
 
+/**
+ * With FIELD_PACKED defined, each square of a field is kept in 4 bits instead of a byte, two to a
+ * byte with the even column in the low nibble, which almost halves the size of a Field.  Squares
+ * should then only be read and written with FieldGetSquareStatus() and FieldSetSquareStatus(),
+ * and whole rows can be counted a word at a time with FieldCountInRow().
+ *
+ * It is off by default, as a byte per square is simpler to read in a debugger and a Field is
+ * small either way.
+ *
+ * The size of a Field and the speed of its accessors can be measured on x86 by compiling with the
+ * FIELD_BENCHMARK macro, with and without FIELD_PACKED.
+ * With gcc: `gcc <field AI sources> -DFIELD_BENCHMARK [-DFIELD_PACKED]`
+ *
+ * The field AI sources, which every program using Field.c is built from, are
+ *      Field.c FieldInference.c GuessEngine.c Endgame.c OpeningBook.c LayoutPool.c OpponentModel.c
+ *      PlacementSampler.c
+ * PlacementSampler.c is only searched with when FIELD_AI_SAMPLES is set, but FieldTest.c tests it
+ * either way.
+ */
+#ifdef FIELD_PACKED
+#define FIELD_ROW_BYTES ((FIELD_COLS + 1) / 2)
+#if FIELD_ROW_BYTES > 8
+#error "FIELD_PACKED rows have to fit in 64 bits"
+#endif
+#endif
+
+/**
+ * Every square also remembers which boat FieldAddBoat() put there, even once the square has been
+ * hit, so that an attack is resolved with a single lookup.  It is kept in the high nibble of the
+ * square's byte, which SquareStatus never uses, as the BoatType plus one, or 0 for no boat.
+ *
+ * FIELD_PACKED has no spare bits, and a second array would take back the space packing saves, so
+ * there the boat is found from the square's status and is forgotten once the square is hit.
+ */
+#define FIELD_NO_BOAT 0xFF
+
+/**
+ * FIELD_SQUARE() reads a square without checking that it is on the field, for loops that already
+ * keep to the field and cannot afford a call per square.  It works with or without FIELD_PACKED.
+ */
+#ifdef FIELD_PACKED
+#define FIELD_SQUARE(f, row, col) \
+    ((SquareStatus) (((f)->grid[row][(col) >> 1] >> (((col) & 1) * 4)) & 0x0F))
+#else
+#define FIELD_SQUARE(f, row, col) ((SquareStatus) ((f)->grid[row][col] & 0x0F))
+#endif
+
+/**
+ * An opponent's field keeps a Zobrist hash of what is known about it, so that work on it can be
+ * cached by its key.  Every square that is not FIELD_SQUARE_UNKNOWN XORs in a 32-bit key for its
+ * position and status, which is mixed from the two rather than kept in a table, so a fresh field's
+ * key is 0.  FieldUpdateKnowledge() and FieldSetSquareStatus() update it with the squares they
+ * change.  An agent's own field is also changed in other ways, so its key means nothing.
+ */
+
 /**
  * A struct for tracking all of the necessary data for an agent's field.
  */
 typedef struct {
+#ifdef FIELD_PACKED
+    uint8_t grid[FIELD_ROWS][FIELD_ROW_BYTES];
+#else
     uint8_t grid[FIELD_ROWS][FIELD_COLS];
-    uint8_t smallBoatLives;
-    uint8_t mediumBoatLives;
-    uint8_t largeBoatLives;
-    uint8_t hugeBoatLives;
+#endif
+    uint8_t boatLives[FIELD_NUM_BOATS]; // squares of each boat not hit yet, indexed by BoatType
+    uint32_t key; // Zobrist hash of the squares, for an opponent's field
 } Field;
 
 /**
- * Specify how many boats there exist on the field. There is 1 boat of each of the 4 types, so 4
- * total.
+ * A FieldBitboard has a bit for every square of a field, so that a row or column of squares can
+ * be tested at once.  Squares can be laid out row by row, square (row, col) being bit
+ * FIELD_BITBOARD_BIT(row, col), or column by column, being bit FIELD_BITBOARD_BIT_BY_COL(row, col).
+ * Either way, a run of squares in a row, or in a column, is a run of bits in a single word.
+ *
+ * Fields of up to 64 squares, such as the standard 10x6 field, take a single 64-bit word.  Bigger
+ * fields give each row or column 16 bits, four to a word, and take up to four words for a 16x16
+ * field.
  */
-#define FIELD_NUM_BOATS 4
+#if FIELD_SQUARES <= 64
+#define FIELD_BITBOARD_WORDS 1
+#define FIELD_BITBOARD_BIT(row, col) ((row) * FIELD_COLS + (col))
+#define FIELD_BITBOARD_BIT_BY_COL(row, col) ((col) * FIELD_ROWS + (row))
+#define FIELD_BITBOARD_STRIDE FIELD_COLS
+#else
+#define FIELD_BITBOARD_LANES (FIELD_ROWS > FIELD_COLS ? FIELD_ROWS : FIELD_COLS)
+#define FIELD_BITBOARD_WORDS ((16 * FIELD_BITBOARD_LANES + 63) / 64)
+#define FIELD_BITBOARD_BIT(row, col) ((row) * 16 + (col))
+#define FIELD_BITBOARD_BIT_BY_COL(row, col) ((col) * 16 + (row))
+#define FIELD_BITBOARD_STRIDE 16
+#endif
+
+// the square of a bit laid out row by row
+#define FIELD_BITBOARD_ROW(bit) ((bit) / FIELD_BITBOARD_STRIDE)
+#define FIELD_BITBOARD_COL(bit) ((bit) % FIELD_BITBOARD_STRIDE)
+
+typedef struct {
+    uint64_t words[FIELD_BITBOARD_WORDS];
+} FieldBitboard;
+
+#define FIELD_BITBOARD_TEST(b, bit) (((b)->words[(bit) >> 6] >> ((bit) & 63)) & 1)
+#define FIELD_BITBOARD_SET(b, bit) ((b)->words[(bit) >> 6] |= (uint64_t) 1 << ((bit) & 63))
 
 /**
  * Declares direction constants for use with FieldAddShip.
@@ -92,17 +257,6 @@ typedef enum {
     FIELD_DIR_EAST,
 } BoatDirection;
 
-/**
- * Constants for specifying which boat the current operation refers to. This is independent of the
- * SquareStatus enum.
- */
-typedef enum {
-    FIELD_BOAT_TYPE_SMALL,
-    FIELD_BOAT_TYPE_MEDIUM,
-    FIELD_BOAT_TYPE_LARGE,
-    FIELD_BOAT_TYPE_HUGE
-} BoatType;
-
 /**
  * Track the alive state of the boats. They are arranged as as mutually-exclusive bits so that they
  * can be bitwise ORed together. Used for checking the return value of  `FieldGetBoatStates()`. 
@@ -119,16 +273,7 @@ typedef enum {
     FIELD_BOAT_STATUS_HUGE = 0x08,
 } BoatStatusFlag;
 
-/**
- * This enum lists the number of squares, each boat occupies (and therefore, the number of 
- * lives) that each boat has.
- */
-typedef enum {
-    FIELD_BOAT_SIZE_SMALL = 3,
-    FIELD_BOAT_SIZE_MEDIUM = 4,
-    FIELD_BOAT_SIZE_LARGE = 5,
-    FIELD_BOAT_SIZE_HUGE = 6
-} BoatSize;
+#define FIELD_BOAT_STATUS(type) ((uint8_t) (1 << (type)))
 
 /**
  * This function is optional, but recommended.   It prints a representation of both
@@ -173,10 +318,44 @@ SquareStatus FieldGetSquareStatus(const Field *f, uint8_t row, uint8_t col);
  * @param row The row-component of the location to modify
  * @param col The column-component of the location to modify
  * @param p The new value of the field location
- * @return The old value at that field location
+ * @return The old value at that field location, or FIELD_SQUARE_INVALID if it is off the field,
+ *         in which case nothing is changed
  */
 SquareStatus FieldSetSquareStatus(Field *f, uint8_t row, uint8_t col, SquareStatus p);
 
+/**
+ * Finds the boat FieldAddBoat() placed on a square.  The boat is still known after the square has
+ * been hit, while its status is then FIELD_SQUARE_HIT, except with FIELD_PACKED.
+ *
+ * @param f The Field being referenced
+ * @param row The row-component of the location
+ * @param col The column-component of the location
+ * @return The BoatType of the boat on the square, FIELD_NO_BOAT if there is none or row and col
+ *          are not valid field locations
+ */
+uint8_t FieldGetBoatAt(const Field *f, uint8_t row, uint8_t col);
+
+/**
+ * Counts the squares of a row that have a given status, such as the FIELD_SQUARE_UNKNOWN squares
+ * left to shoot at.  With FIELD_PACKED, the whole row is compared at once.
+ *
+ * @param f The Field being referenced
+ * @param row The row to count in
+ * @param p The status to count
+ * @return The number of squares in the row with that status, 0 if row is not a valid row
+ */
+uint8_t FieldCountInRow(const Field *f, uint8_t row, SquareStatus p);
+
+/**
+ * Collects the squares of a field that have a given status into bitboards.
+ *
+ * @param f The Field being referenced
+ * @param p The status to look for
+ * @param by_row Filled with a bit set for every square with that status, laid out row by row
+ * @param by_col The same laid out column by column, may be NULL if it is not needed
+ */
+void FieldGetBitboard(const Field *f, SquareStatus p, FieldBitboard *by_row, FieldBitboard *by_col);
+
 /**
  * FieldAddBoat() places a single ship on the player's field based on arguments 2-5. Arguments 2, 3
  * represent the x, y coordinates of the pivot point of the ship.  Argument 4 represents the
@@ -229,7 +408,8 @@ uint8_t FieldAddBoat(Field *own_field, uint8_t row, uint8_t col, BoatDirection d
  * @param f The field to check against and update.
  * @param gData The coordinates that were guessed. The result is stored in gData->result as an
  *               output.  The result can be a RESULT_HIT, RESULT_MISS, or RESULT_***_SUNK.
- * @return The data that was stored at the field position indicated by gData before this attack.
+ * @return The data that was stored at the field position indicated by gData before this attack,
+ *          FIELD_SQUARE_INVALID for an attack outside the field, which is a RESULT_MISS.
  */
 SquareStatus FieldRegisterEnemyAttack(Field *own_field, GuessData *opp_guess);
 
@@ -244,10 +424,30 @@ SquareStatus FieldRegisterEnemyAttack(Field *own_field, GuessData *opp_guess);
  * @param f The field to grab data from.
  * @param gData The coordinates that were guessed along with their HitStatus.
  * @return The previous value of that coordinate position in the field before the hit/miss was
- * registered.
+ * registered, FIELD_SQUARE_INVALID for a guess outside the field, which is ignored.
  */
 SquareStatus FieldUpdateKnowledge(Field *opp_field, const GuessData *own_guess);
 
+/**
+ * Batch variant of FieldRegisterEnemyAttack() for salvos: registers each attack in turn. Attacks
+ * outside the field are a RESULT_MISS and leave the field alone.
+ * @param f The field to check against and update.
+ * @param gData The coordinates that were guessed.  Each result is stored in its result parameter.
+ * @param count The number of guesses in gData.
+ * @return The number of attacks that hit a boat.
+ */
+uint8_t FieldRegisterEnemyAttackBatch(Field *own_field, GuessData *opp_guesses, uint8_t count);
+
+/**
+ * Batch variant of FieldUpdateKnowledge() for salvos: records each result in turn.  Results
+ * outside the field are ignored.
+ * @param f The field to update.
+ * @param gData The coordinates that were guessed along with their HitStatus.
+ * @param count The number of guesses in gData.
+ * @return The number of guesses that hit a boat.
+ */
+uint8_t FieldUpdateKnowledgeBatch(Field *opp_field, const GuessData *own_guesses, uint8_t count);
+
 /**
  * This function returns the alive states of all 4 boats as a 4-bit bitfield (stored as a uint8).
  * The boats are ordered from smallest to largest starting at the least-significant bit. So that:
@@ -269,6 +469,18 @@ uint8_t FieldGetBoatStates(const Field *f);
  */
 uint8_t FieldAIPlaceAllBoats(Field *own_field);
 
+/**
+ * The number of placements of the whole fleet FieldAIDecideGuess() and the agent sample with the
+ * placement sampler to decide a shot that needs a search, or 0 to count each boat's placements
+ * with the guess engine instead.  Sampling does not count a square twice for two boats that could
+ * not both be there.  On the standard field 64 samples win in about 30.5 shots rather than 33.3,
+ * but take about ten times as long, in floating point the PIC32 does in software.  On a 16x16
+ * field with 7 boats they take about 5 shots more, see PLACEMENT_SAMPLER_BENCHMARK.
+ */
+#ifndef FIELD_AI_SAMPLES
+#define FIELD_AI_SAMPLES 0
+#endif
+
 /**
  * Given a field, decide the next guess.
  *
@@ -283,6 +495,17 @@ uint8_t FieldAIPlaceAllBoats(Field *own_field);
  */
 GuessData FieldAIDecideGuess(const Field *opp_field);
 
+/**
+ * Decides the next guess if it can be done without a search of the guess engine: the first few
+ * shots are looked up in the opening book, unless a model of the opponent knows better, and the
+ * last few are worked out exactly when they can be.  FieldAIDecideGuess() searches otherwise.
+ *
+ * @param opp_field an opponent's field.
+ * @param guess set to the guess, if one was decided.
+ * @return TRUE if a guess was decided, FALSE if a search is needed.
+ */
+uint8_t FieldAIDecideGuessWithoutSearch(const Field *opp_field, GuessData *guess);
+
 /** 
  * For Extra Credit:  Make the two "AI" functions above 
  * smart enough to beat our AI in more than 55% of games.
@@ -0,0 +1,186 @@
+/*
+ * File:   FieldInference.c
+ * Author: jwang456
+ *
+ * Purpose: Works out where sunk boats were on the opponent's field
+ *
+ *
+ */
+#include "FieldInference.h"
+
+#include <stdint.h>
+
+#include "BOARD.h"
+#include "Field.h"
+
+// whether a placement of a boat covers a square
+static uint8_t FieldInferenceCovers(const FieldPlacement *p, uint8_t length, uint8_t row,
+        uint8_t col) {
+    if (p->dir == FIELD_DIR_EAST) {
+        return row == p->row && col >= p->col && col < p->col + length;
+    }
+    return col == p->col && row >= p->row && row < p->row + length;
+}
+
+/**
+ * FieldInferenceCandidates() lists the placements of a sunk boat that are consistent with the
+ * opponent's field: those covering every square marked as part of it, and only hits otherwise.
+ *
+ * @param opp_field The opponent's field.
+ * @param boat The boat.
+ * @param candidates Filled with the placements, must have room for
+ *                   FIELD_INFERENCE_MAX_CANDIDATES.
+ * @return The number of placements, 0 if the boat is still afloat.
+ */
+uint8_t FieldInferenceCandidates(const Field *opp_field, BoatType boat,
+        FieldPlacement *candidates) {
+    SquareStatus mark = FIELD_SQUARE_BOAT(boat);
+    int length = fieldBoatSizes[boat];
+    int row, col, anchorRow = -1, anchorCol = -1, marked = 0;
+    uint8_t count = 0;
+
+    if (opp_field->boatLives[boat] != 0) {
+        return 0;
+    }
+
+    // every placement has to cover the first marked square, so only those through it are tried
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            if (FIELD_SQUARE(opp_field, row, col) == mark) {
+                if (marked++ == 0) {
+                    anchorRow = row;
+                    anchorCol = col;
+                }
+            }
+        }
+    }
+    if (marked == 0) {
+        return 0;
+    }
+
+    int dir, i, j;
+    for (dir = FIELD_DIR_SOUTH; dir <= FIELD_DIR_EAST; dir++) {
+        int dRow = (dir == FIELD_DIR_SOUTH), dCol = (dir == FIELD_DIR_EAST);
+        for (i = 0; i < length; i++) {
+            row = anchorRow - dRow * i;
+            col = anchorCol - dCol * i;
+            if (row < 0 || col < 0 || row + dRow * (length - 1) >= FIELD_ROWS ||
+                    col + dCol * (length - 1) >= FIELD_COLS) {
+                continue;
+            }
+            int covered = 0;
+            for (j = 0; j < length; j++) {
+                SquareStatus s = FIELD_SQUARE(opp_field, row + dRow * j, col + dCol * j);
+                if (s == mark) {
+                    covered++;
+                } else if (s != FIELD_SQUARE_HIT) {
+                    break;
+                }
+            }
+            if (j == length && covered == marked) {
+                candidates[count].row = row;
+                candidates[count].col = col;
+                candidates[count].dir = dir;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * FieldInferenceSunk() marks the square that sank a boat as part of it, and marks every other
+ * square that can now be placed.  FieldUpdateKnowledge() calls it for every RESULT_*_SUNK.
+ *
+ * @param opp_field The opponent's field, with the boat's lives already set to 0.
+ * @param own_guess The shot that sank the boat.
+ */
+void FieldInferenceSunk(Field *opp_field, const GuessData *own_guess) {
+    FieldPlacement candidates[FIELD_INFERENCE_MAX_CANDIDATES];
+    uint8_t boat, changed = TRUE;
+
+    FieldSetSquareStatus(opp_field, own_guess->row, own_guess->col,
+            FIELD_SQUARE_BOAT(RESULT_SUNK_BOAT_TYPE(own_guess->result)));
+
+    // a square every candidate covers is part of the boat, which can rule out other candidates
+    while (changed) {
+        changed = FALSE;
+        for (boat = 0; boat < FIELD_NUM_BOATS; boat++) {
+            uint8_t count = FieldInferenceCandidates(opp_field, boat, candidates);
+            uint8_t length = fieldBoatSizes[boat];
+            uint8_t i, j;
+            for (i = 0; count > 0 && i < length; i++) {
+                FieldPlacement *first = &candidates[0];
+                uint8_t row = first->row + (first->dir == FIELD_DIR_SOUTH) * i;
+                uint8_t col = first->col + (first->dir == FIELD_DIR_EAST) * i;
+                if (FIELD_SQUARE(opp_field, row, col) != FIELD_SQUARE_HIT) continue;
+                for (j = 1; j < count; j++) {
+                    if (!FieldInferenceCovers(&candidates[j], length, row, col)) break;
+                }
+                if (j == count) {
+                    FieldSetSquareStatus(opp_field, row, col, FIELD_SQUARE_BOAT(boat));
+                    changed = TRUE;
+                }
+            }
+        }
+    }
+}
+
+#ifdef FIELD_INFERENCE_BENCHMARK
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GAMES 1000
+
+// plays one game against a random placement, with or without the sunk boats marked, and counts
+// the squares of each boat that were placed when it was sunk
+static int PlayGame(uint8_t infer, long *placed, long *squares) {
+    Field own, opp, seen;
+    uint8_t row, col;
+    FieldInit(&own, &opp);
+    FieldAIPlaceAllBoats(&own);
+    int shots = 0;
+    while (FieldGetBoatStates(&own)) {
+        // without inference every square of a boat looks like any other hit
+        seen = opp;
+        for (row = 0; row < FIELD_ROWS; row++) {
+            for (col = 0; col < FIELD_COLS; col++) {
+                if (!infer && FIELD_SQUARE_IS_BOAT(FIELD_SQUARE(&seen, row, col))) {
+                    FieldSetSquareStatus(&seen, row, col, FIELD_SQUARE_HIT);
+                }
+            }
+        }
+        GuessData guess = FieldAIDecideGuess(&seen);
+        FieldRegisterEnemyAttack(&own, &guess);
+        FieldUpdateKnowledge(&opp, &guess);
+        shots++;
+
+        if (RESULT_IS_BOAT_SUNK(guess.result)) {
+            BoatType boat = RESULT_SUNK_BOAT_TYPE(guess.result);
+            *squares += fieldBoatSizes[boat];
+            for (row = 0; row < FIELD_ROWS; row++) {
+                *placed += FieldCountInRow(&opp, row, FIELD_SQUARE_BOAT(boat));
+            }
+        }
+    }
+    return shots;
+}
+
+int main(void) {
+    int infer, game;
+
+    printf("sunk boats    mean shots to win    squares placed when sunk\n");
+    for (infer = 0; infer <= 1; infer++) {
+        long shots = 0, placed = 0, squares = 0;
+        for (game = 0; game < GAMES; game++) {
+            srand(game);
+            shots += PlayGame(infer, &placed, &squares);
+        }
+        printf("%10s    %17.2f    %23.1f%%\n", infer ? "marked" : "as hits",
+                (double) shots / GAMES, 100.0 * placed / squares);
+    }
+    return 0;
+}
+
+#endif
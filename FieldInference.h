@@ -0,0 +1,59 @@
+#ifndef FIELD_INFERENCE_H
+#define FIELD_INFERENCE_H
+
+#include <stdint.h>
+#include "Field.h"
+
+/**
+ * FieldInference works out which hits on the opponent's field belong to boats that have been
+ * sunk, so that the guess engine only takes the hits left over as evidence of boats still afloat.
+ *
+ * Squares known to be part of a boat are marked on the opponent's field with the boat's own
+ * status, such as FIELD_SQUARE_SMALL_BOAT, and are no longer hits.  The shot that sinks a boat is
+ * always one of its squares.  The rest of the boat lies along a line of hits through it: every
+ * placement that fits is a candidate, and the squares common to all of a boat's candidates are
+ * marked.  Marking squares can rule out candidates of other sunk boats, so this is repeated until
+ * nothing changes.  A boat with a single candidate ends up with all of its squares marked.
+ *
+ * The effect on the number of shots to win can be measured on x86 by compiling with the
+ * FIELD_INFERENCE_BENCHMARK macro.
+ * With gcc: `gcc <field AI sources> -DFIELD_INFERENCE_BENCHMARK`, see Field.h
+ */
+
+/**
+ * A boat placement: the square at its top left, and the direction it extends in from there.
+ */
+typedef struct {
+    uint8_t row;
+    uint8_t col;
+    BoatDirection dir;
+} FieldPlacement;
+
+/**
+ * The most candidates a boat can have: a placement in each direction for each of its squares.
+ */
+#define FIELD_INFERENCE_MAX_CANDIDATES (2 * 16)
+
+/**
+ * FieldInferenceSunk() marks the square that sank a boat as part of it, and marks every other
+ * square that can now be placed.  FieldUpdateKnowledge() calls it for every RESULT_*_SUNK.
+ *
+ * @param opp_field The opponent's field, with the boat's lives already set to 0.
+ * @param own_guess The shot that sank the boat.
+ */
+void FieldInferenceSunk(Field *opp_field, const GuessData *own_guess);
+
+/**
+ * FieldInferenceCandidates() lists the placements of a sunk boat that are consistent with the
+ * opponent's field: those covering every square marked as part of it, and only hits otherwise.
+ *
+ * @param opp_field The opponent's field.
+ * @param boat The boat.
+ * @param candidates Filled with the placements, must have room for
+ *                   FIELD_INFERENCE_MAX_CANDIDATES.
+ * @return The number of placements, 0 if the boat is still afloat.
+ */
+uint8_t FieldInferenceCandidates(const Field *opp_field, BoatType boat,
+        FieldPlacement *candidates);
+
+#endif // FIELD_INFERENCE_H
@@ -8,7 +8,7 @@
 
 #define FIELD_SYMBOL_WIDTH 3
 #define FIELD_SYMBOL_HEIGHT 4
-const uint8_t gridSymbols[10][FIELD_SYMBOL_WIDTH] = {
+const uint8_t gridSymbols[FIELD_SQUARE_INVALID + 1][FIELD_SYMBOL_WIDTH] = {
     [FIELD_SQUARE_EMPTY] =
     {
         0b0000,
@@ -73,7 +73,21 @@ const uint8_t gridSymbols[10][FIELD_SYMBOL_WIDTH] = {
     }
 };
 
+// the middle of the screen is kept for the labels and turn number, four characters wide, and
+// each field is drawn in a frame to one side of it, with squares at most 5 pixels a side
+#define FIELD_OLED_MIDDLE_WIDTH (ASCII_FONT_WIDTH * 4)
+#define FIELD_OLED_MAX_FRAME_WIDTH ((OLED_DRIVER_PIXEL_COLUMNS - FIELD_OLED_MIDDLE_WIDTH) / 2)
+#define FIELD_OLED_FIT_WIDTH ((FIELD_OLED_MAX_FRAME_WIDTH - 2) / FIELD_COLS)
+#define FIELD_OLED_FIT_HEIGHT ((OLED_DRIVER_PIXEL_ROWS - 2) / FIELD_ROWS)
+#define FIELD_OLED_SQUARE_WIDTH (FIELD_OLED_FIT_WIDTH < 5 ? FIELD_OLED_FIT_WIDTH : 5)
+#define FIELD_OLED_SQUARE_HEIGHT (FIELD_OLED_FIT_HEIGHT < 5 ? FIELD_OLED_FIT_HEIGHT : 5)
+#define FIELD_OLED_FRAME_WIDTH (FIELD_COLS * FIELD_OLED_SQUARE_WIDTH + 2)
+
+// the opponent's field is drawn against the right edge of the screen
+#define FIELD_OLED_THEIR_X (OLED_DRIVER_PIXEL_COLUMNS - FIELD_OLED_FRAME_WIDTH)
+
 uint8_t _FieldOledDrawSymbol(int x, int y, SquareStatus s);
+void _FieldOledDrawBlock(int x, int y, SquareStatus s);
 void _FieldOledDrawField(const Field *f, int xOffset);
 
 void FieldOledDrawScreen(const Field *myField, const Field *theirField,
@@ -83,24 +97,24 @@ void FieldOledDrawScreen(const Field *myField, const Field *theirField,
     OledClear(OLED_COLOR_BLACK);
     _FieldOledDrawField(myField, 0);
     if (theirField) {
-        _FieldOledDrawField(theirField, 76);
+        _FieldOledDrawField(theirField, FIELD_OLED_THEIR_X);
     } else {
         OledUpdate();
         return;
     }
 
     //draw inner artwork
-    OledDrawChar(53, 1, 'P');
-    OledDrawChar(76 - ASCII_FONT_WIDTH - 1, 1, 'O');
+    OledDrawChar(FIELD_OLED_FRAME_WIDTH + 1, 1, 'P');
+    OledDrawChar(FIELD_OLED_THEIR_X - ASCII_FONT_WIDTH - 1, 1, 'O');
     if (playerTurn == FIELD_OLED_TURN_MINE) {
-        OledDrawChar(53, ASCII_FONT_HEIGHT + 1, '<');
+        OledDrawChar(FIELD_OLED_FRAME_WIDTH + 1, ASCII_FONT_HEIGHT + 1, '<');
     } else if (playerTurn == FIELD_OLED_TURN_THEIRS) {
-        OledDrawChar(76 - ASCII_FONT_WIDTH - 1, ASCII_FONT_HEIGHT + 1, '>');
+        OledDrawChar(FIELD_OLED_THEIR_X - ASCII_FONT_WIDTH - 1, ASCII_FONT_HEIGHT + 1, '>');
     }
 
     //draw turn number:
     int x;
-    x = 76 - ASCII_FONT_WIDTH * 2;
+    x = FIELD_OLED_THEIR_X - ASCII_FONT_WIDTH * 2;
     OledDrawChar(x, ASCII_FONT_HEIGHT * 3, turn_number % 10 + '0');
     x -= ASCII_FONT_WIDTH;
     turn_number /= 10;
@@ -116,7 +130,7 @@ void FieldOledDrawScreen(const Field *myField, const Field *theirField,
 void _FieldOledDrawField(const Field *f, int xOffset)
 {
     int i;
-    int finalCol = 10 * 5 + 2;
+    int finalCol = FIELD_OLED_FRAME_WIDTH;
 
     int finalRowOffset = (OLED_DRIVER_PIXEL_ROWS / OLED_DRIVER_BUFFER_LINE_HEIGHT - 1) *
             OLED_DRIVER_PIXEL_COLUMNS;
@@ -138,7 +152,18 @@ void _FieldOledDrawField(const Field *f, int xOffset)
     for (i = 0; i < FIELD_COLS; ++i) {
         int j;
         for (j = 0; j < FIELD_ROWS; ++j) {
-            _FieldOledDrawSymbol(xOffset + 1 + 5 * i, yOffset + 5 * j, f->grid[j][i]);
+            int x = xOffset + 1 + FIELD_OLED_SQUARE_WIDTH * i;
+            int y = yOffset + FIELD_OLED_SQUARE_HEIGHT * j;
+            SquareStatus s = FieldGetSquareStatus(f, j, i);
+            if (FIELD_OLED_SQUARE_WIDTH == 5 && FIELD_OLED_SQUARE_HEIGHT == 5) {
+                // boats after the huge one have no symbol of their own
+                if (FIELD_SQUARE_IS_BOAT(s) && s > FIELD_SQUARE_HUGE_BOAT) {
+                    s = FIELD_SQUARE_HUGE_BOAT;
+                }
+                _FieldOledDrawSymbol(x, y, s);
+            } else {
+                _FieldOledDrawBlock(x, y, s);
+            }
         }
     }
 }
@@ -186,3 +211,33 @@ uint8_t _FieldOledDrawSymbol(int x, int y, SquareStatus s)
 
     return FALSE;
 }
+
+/**
+ * Draw a square too small for its symbol as a block at the given x/y coordinates: solid for boats,
+ * hits and the cursor, a checkerboard for unknown squares, and blank for everything else.
+ */
+void _FieldOledDrawBlock(int x, int y, SquareStatus s)
+{
+    // leave a pixel between squares if there is room for one
+    int width = FIELD_OLED_SQUARE_WIDTH > 1 ? FIELD_OLED_SQUARE_WIDTH - 1 : 1;
+    int height = FIELD_OLED_SQUARE_HEIGHT > 1 ? FIELD_OLED_SQUARE_HEIGHT - 1 : 1;
+    int i, j;
+    for (i = 0; i < width; ++i) {
+        for (j = 0; j < height; ++j) {
+            uint8_t on;
+            switch (s) {
+            case FIELD_SQUARE_EMPTY:
+            case FIELD_SQUARE_MISS:
+                on = FALSE;
+                break;
+            case FIELD_SQUARE_UNKNOWN:
+                on = ((x + i + y + j) & 1) == 0;
+                break;
+            default:
+                on = TRUE;
+                break;
+            }
+            OledSetPixel(x + i, y + j, on ? OLED_COLOR_WHITE : OLED_COLOR_BLACK);
+        }
+    }
+}
@@ -10,6 +10,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "Field.h"
+#include "FieldInference.h"
+#include "Endgame.h"
+#include "OpeningBook.h"
+#include "OpponentModel.h"
+#include "GuessEngine.h"
+#include "PlacementSampler.h"
 #include "Uart1.h"
 #include "BOARD.h"
 
@@ -40,9 +46,12 @@ int main() {
         printf("\nFieldGetSquareStatus() (or possibly FieldInit()): failed\n");
     }
     
-    // set square test
+    // set square test, a square off the field is refused and leaves the key as it was
     FieldSetSquareStatus(&testFieldOwn, 0, 0, FIELD_SQUARE_SMALL_BOAT);
-    if (FieldGetSquareStatus(&testFieldOwn, 0, 0) == FIELD_SQUARE_SMALL_BOAT) {
+    uint32_t key = testFieldOwn.key;
+    if (FieldGetSquareStatus(&testFieldOwn, 0, 0) == FIELD_SQUARE_SMALL_BOAT &&
+            FieldSetSquareStatus(&testFieldOwn, FIELD_ROWS, 0, FIELD_SQUARE_MISS) ==
+            FIELD_SQUARE_INVALID && testFieldOwn.key == key) {
         printf("FieldSetSquareStatus(): success\n");
     } else {
         printf("FieldSetSquareStatus() (or possibly GetSquareStatus()): failed\n");
@@ -62,6 +71,181 @@ int main() {
     
     FieldPrint_UART(&testFieldOwn, &testFieldOther);
     
+    // row count test, the first row has the horizontal small boat and the top of the vertical one
+    if (FieldCountInRow(&testFieldOwn, 0, FIELD_SQUARE_SMALL_BOAT) == 4 &&
+            FieldCountInRow(&testFieldOwn, 0, FIELD_SQUARE_EMPTY) == FIELD_COLS - 4 &&
+            FieldCountInRow(&testFieldOther, FIELD_ROWS, FIELD_SQUARE_UNKNOWN) == 0) {
+        printf("\nFieldCountInRow(): success\n");
+    } else {
+        printf("\nFieldCountInRow(): failed\n");
+    }
+    
+    // bitboard test, the vertical small boat is in both layouts and the medium boat is in neither
+    FieldBitboard byRow, byCol;
+    FieldGetBitboard(&testFieldOwn, FIELD_SQUARE_SMALL_BOAT, &byRow, &byCol);
+    if (FIELD_BITBOARD_TEST(&byRow, FIELD_BITBOARD_BIT(2, 6)) &&
+            FIELD_BITBOARD_TEST(&byCol, FIELD_BITBOARD_BIT_BY_COL(2, 6)) &&
+            !FIELD_BITBOARD_TEST(&byRow, FIELD_BITBOARD_BIT(1, 0)) &&
+            !FIELD_BITBOARD_TEST(&byCol, FIELD_BITBOARD_BIT_BY_COL(1, 0))) {
+        printf("FieldGetBitboard(): success\n");
+    } else {
+        printf("FieldGetBitboard(): failed\n");
+    }
+    
+    // boat test, the medium boat is known from its squares and a shot at it is a hit
+    guess.row = 1;
+    guess.col = 0;
+    if (FieldGetBoatAt(&testFieldOwn, 1, 0) == FIELD_BOAT_TYPE_MEDIUM &&
+            FieldGetBoatAt(&testFieldOwn, 3, 3) == FIELD_NO_BOAT &&
+            FieldRegisterEnemyAttack(&testFieldOwn, &guess) == FIELD_SQUARE_MEDIUM_BOAT &&
+            guess.result == RESULT_HIT) {
+        printf("FieldGetBoatAt(): success\n");
+    } else {
+        printf("FieldGetBoatAt(): failed\n");
+    }
+    
+    // key test, a field with nothing known has key 0, and the same knowledge learnt in either
+    // order has the same key, which is no longer 0
+    Field first, second;
+    FieldInit(&testFieldOther, &first);
+    FieldInit(&testFieldOther, &second);
+    uint32_t freshKey = first.key;
+    GuessData miss = {0, 0, RESULT_MISS}, hit = {2, 3, RESULT_HIT};
+    FieldUpdateKnowledge(&first, &miss);
+    FieldUpdateKnowledge(&first, &hit);
+    FieldUpdateKnowledge(&second, &hit);
+    FieldUpdateKnowledge(&second, &miss);
+    if (freshKey == 0 && first.key == second.key && first.key != 0) {
+        printf("Field key: success\n");
+    } else {
+        printf("Field key: failed\n");
+    }
+    
+    // inference test, a small boat sunk in the middle of four hits in a row could be at either end
+    // of them, until a medium boat sunk across the last one takes it
+    FieldPlacement candidates[FIELD_INFERENCE_MAX_CANDIDATES];
+    FieldInit(&testFieldOther, &otherRepr);
+    for (guess.col = 0; guess.col < 4; guess.col++) {
+        guess.row = 0;
+        guess.result = RESULT_HIT;
+        FieldUpdateKnowledge(&otherRepr, &guess);
+    }
+    guess.col = 2;
+    guess.result = RESULT_SMALL_BOAT_SUNK;
+    FieldUpdateKnowledge(&otherRepr, &guess);
+    uint8_t ambiguous = FieldInferenceCandidates(&otherRepr, FIELD_BOAT_TYPE_SMALL, candidates);
+    uint8_t placed = FieldGetSquareStatus(&otherRepr, 0, 1) == FIELD_SQUARE_SMALL_BOAT &&
+            FieldGetSquareStatus(&otherRepr, 0, 0) == FIELD_SQUARE_HIT;
+    guess.col = 3;
+    for (guess.row = 2; guess.row < 4; guess.row++) {
+        guess.result = RESULT_HIT;
+        FieldUpdateKnowledge(&otherRepr, &guess);
+    }
+    guess.row = 1;
+    guess.result = RESULT_MEDIUM_BOAT_SUNK;
+    FieldUpdateKnowledge(&otherRepr, &guess);
+    if (ambiguous == 2 && placed &&
+            FieldInferenceCandidates(&otherRepr, FIELD_BOAT_TYPE_SMALL, candidates) == 1 &&
+            FieldGetSquareStatus(&otherRepr, 0, 0) == FIELD_SQUARE_SMALL_BOAT &&
+            FieldGetSquareStatus(&otherRepr, 0, 3) == FIELD_SQUARE_MEDIUM_BOAT) {
+        printf("FieldInferenceSunk(): success\n");
+    } else {
+        printf("FieldInferenceSunk(): failed\n");
+    }
+
+    // endgame test, with every boat but the huge one sunk and placed and only the start of the
+    // bottom row left, it can only be at either end of it, so the shot has to be in the middle
+    FieldInit(&testFieldOther, &otherRepr);
+    uint8_t tooMany = EndgameDecideGuess(&otherRepr, ENDGAME_MAX_PLACEMENTS, &guess);
+    uint8_t row, col;
+    for (row = 0; row < FIELD_ROWS - 1; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            FieldSetSquareStatus(&otherRepr, row, col, FIELD_SQUARE_MISS);
+        }
+    }
+    FieldSetSquareStatus(&otherRepr, FIELD_ROWS - 1, FIELD_COLS - 3, FIELD_SQUARE_MISS);
+    FieldSetSquareStatus(&otherRepr, FIELD_ROWS - 1, FIELD_COLS - 2, FIELD_SQUARE_MISS);
+    FieldSetSquareStatus(&otherRepr, FIELD_ROWS - 1, FIELD_COLS - 1, FIELD_SQUARE_MISS);
+    BoatType boat;
+    for (boat = FIELD_BOAT_TYPE_SMALL; boat <= FIELD_BOAT_TYPE_LARGE; boat++) {
+        otherRepr.boatLives[boat] = 0;
+        for (col = 0; col < fieldBoatSizes[boat]; col++) {
+            FieldSetSquareStatus(&otherRepr, boat, col, FIELD_SQUARE_BOAT(boat));
+        }
+    }
+    if (!tooMany && EndgameDecideGuess(&otherRepr, ENDGAME_MAX_PLACEMENTS, &guess) &&
+            guess.row == FIELD_ROWS - 1 && guess.col >= 1 && guess.col <= 5) {
+        printf("EndgameDecideGuess(): success\n");
+    } else {
+        printf("EndgameDecideGuess(): failed\n");
+    }
+
+    // sampler test, on the same field every sample covers the middle of the bottom row and half
+    // of them cover each end
+    PlacementSamplerBegin(&otherRepr, 64);
+    while (!PlacementSamplerStep(64));
+    guess = PlacementSamplerResult();
+    float end = PlacementSamplerFrequency(FIELD_ROWS - 1, 0);
+    if (guess.row == FIELD_ROWS - 1 && guess.col >= 1 && guess.col <= 5 &&
+            PlacementSamplerFrequency(FIELD_ROWS - 1, 3) == 1 && end > 0 && end < 1) {
+        printf("PlacementSamplerResult(): success\n");
+    } else {
+        printf("PlacementSamplerResult(): failed\n");
+    }
+
+    // information test, with only the small boat left and the start of the top row unknown, the
+    // second square is certain to be hit and tells nothing, so the first is shot, an even chance,
+    // while by density the second is; with the next two squares hits, the fourth is shot, which
+    // can miss, hit or sink it, rather than the first, which can only miss or sink it
+    FieldInit(&testFieldOther, &otherRepr);
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = row ? 0 : 4; col < FIELD_COLS; col++) {
+            FieldSetSquareStatus(&otherRepr, row, col, FIELD_SQUARE_MISS);
+        }
+    }
+    for (boat = FIELD_BOAT_TYPE_MEDIUM; boat < FIELD_NUM_BOATS; boat++) {
+        otherRepr.boatLives[boat] = 0;
+    }
+    GuessData informative, densest, sinking;
+    GuessEngineSetMode(GUESS_ENGINE_INFORMATION);
+    GuessEngineBegin(&otherRepr);
+    while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+    informative = GuessEngineResult();
+    GuessEngineSetMode(GUESS_ENGINE_DENSITY);
+    GuessEngineBegin(&otherRepr);
+    while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+    densest = GuessEngineResult();
+    FieldSetSquareStatus(&otherRepr, 0, 1, FIELD_SQUARE_HIT);
+    FieldSetSquareStatus(&otherRepr, 0, 2, FIELD_SQUARE_HIT);
+    FieldSetSquareStatus(&otherRepr, 0, 4, FIELD_SQUARE_UNKNOWN);
+    GuessEngineSetMode(GUESS_ENGINE_INFORMATION);
+    GuessEngineBegin(&otherRepr);
+    while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+    sinking = GuessEngineResult();
+    GuessEngineSetMode(GUESS_ENGINE_DENSITY);
+    if (informative.row == 0 && informative.col == 0 && densest.row == 0 && densest.col == 1 &&
+            sinking.row == 0 && sinking.col == 3) {
+        printf("GUESS_ENGINE_INFORMATION: success\n");
+    } else {
+        printf("GUESS_ENGINE_INFORMATION: failed\n");
+    }
+
+    // opening book test, the first shot and the one after it missed come from the book, but not
+    // once a square is known that the book's shots could not have found
+    FieldInit(&testFieldOther, &otherRepr);
+    GuessData opening, reply;
+    uint8_t inBook = OpeningBookDecideGuess(&otherRepr, &opening);
+    opening.result = RESULT_MISS;
+    FieldUpdateKnowledge(&otherRepr, &opening);
+    inBook = inBook && OpeningBookDecideGuess(&otherRepr, &reply) &&
+            FieldGetSquareStatus(&otherRepr, reply.row, reply.col) == FIELD_SQUARE_UNKNOWN;
+    FieldSetSquareStatus(&otherRepr, reply.row, reply.col, FIELD_SQUARE_SMALL_BOAT);
+    if (inBook && !OpeningBookDecideGuess(&otherRepr, &guess)) {
+        printf("OpeningBookDecideGuess(): success\n");
+    } else {
+        printf("OpeningBookDecideGuess(): failed\n");
+    }
+    
     // calling field init just to clear the fields
     FieldInit(&testFieldOwn, &otherRepr);
     FieldInit(&testFieldOther, &otherRepr);
@@ -109,6 +293,31 @@ int main() {
     
     FieldPrint_UART(&test2, &test3);
     
+    // opponent model test, after a game with the huge boat along the top row, the top row is
+    // shot first and a layout gets a score from when our squares were shot
+    FieldInit(&testFieldOther, &otherRepr);
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            FieldSetSquareStatus(&otherRepr, row, col, row == 0 && col < 6 ? FIELD_SQUARE_HIT :
+                    FIELD_SQUARE_MISS);
+        }
+    }
+    for (boat = FIELD_BOAT_TYPE_SMALL; boat <= FIELD_BOAT_TYPE_HUGE; boat++) {
+        otherRepr.boatLives[boat] = 0;
+    }
+    guess.row = 0;
+    guess.col = 0;
+    OpponentModelRecordShot(&guess);
+    OpponentModelEndGame(&otherRepr);
+    FieldInit(&testFieldOther, &otherRepr);
+    guess = FieldAIDecideGuess(&otherRepr);
+    if (OpponentModelPrior()[0] > GUESS_ENGINE_PRIOR_ONE && guess.row == 0 &&
+            OpponentModelLayoutScore(&test2) > 0) {
+        printf("OpponentModelEndGame(): success\n");
+    } else {
+        printf("OpponentModelEndGame(): failed\n");
+    }
+
     // READ THIS!!!!!!!!!!!!!!!!!
     // CURRENT STATE OF THE FIELDS
     // testFieldOwn and testFieldOther and test2 and test3 HAVE BOATS IN THEM PLACED
@@ -0,0 +1,578 @@
+/*
+ * File:   GuessEngine.c
+ * Author: jwang456
+ *
+ * Purpose: Incremental placement-counting guess engine for the field AI
+ *
+ *
+ */
+#include "GuessEngine.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "BOARD.h"
+#include "Field.h"
+
+#define NUM_DIRS 2
+
+// chances are in fixed point, 1 being ONE, and information in 1/256ths of a bit times ONE
+#define ONE ((uint32_t) 1 << 15)
+
+struct GuessEngine {
+    const Field *field;
+    GuessEngineMode mode;
+    // the next placement to evaluate
+    uint8_t boat;
+    uint8_t dir;
+    uint8_t row;
+    uint8_t col;
+    // the squares no boat can cover and the known hits, laid out by row for boats facing east
+    // and by column for boats facing south, see FieldBitboard
+    FieldBitboard blocked[NUM_DIRS];
+    FieldBitboard hits[NUM_DIRS];
+    uint16_t density[FIELD_SQUARES];
+    uint16_t bestDensity;
+    GuessData best;
+    // whether the search came from the table, or has been put in it
+    uint8_t cached;
+    // whether the information is counted, see GuessEngineMode, and if so the weighted placements
+    // of the boat under the cursor covering each square, sinking it there, and in all, and for
+    // the boats finished so far the chance each square is covered, the chance it sinks one, and
+    // the information in which one it sinks
+    uint8_t informed;
+    uint16_t boatCover[FIELD_SQUARES];
+    uint16_t boatSink[FIELD_SQUARES];
+    uint32_t boatPlacements;
+    uint16_t cover[FIELD_SQUARES];
+    uint16_t sink[FIELD_SQUARES];
+    uint32_t sinkInformation[FIELD_SQUARES];
+    // the factor each square's density is scaled by, see GuessEngineSetPrior(), and the number
+    // the searches made with it are kept under in the table, 0 for none
+    const uint8_t *prior;
+    uint16_t priorTag;
+};
+
+static struct GuessEngine engine;
+
+#if GUESS_ENGINE_CACHE_SIZE > 0
+// finished searches, by the key of the field they were of
+static struct {
+    uint8_t valid;
+    uint8_t mode;
+    uint16_t prior;
+    uint32_t key;
+    uint16_t bestDensity;
+    GuessData best;
+    uint16_t density[FIELD_SQUARES];
+} cache[GUESS_ENGINE_CACHE_SIZE];
+#endif
+
+static uint32_t cacheHits, cacheLookups;
+
+// the last tag handed to a prior
+static uint16_t priorTags;
+
+// a boat is still worth searching for until we are told it has been sunk
+#define GuessEngineBoatAlive(boat) (engine.field->boatLives[boat] != 0)
+
+// log2 of x, in 1/256ths of a bit, for x > 0
+static uint16_t GuessEngineLog2(uint32_t x) {
+    uint8_t whole = 31 - __builtin_clz(x), i;
+    uint16_t fraction = 0;
+    // the mantissa, from ONE up to 2 ONE, gives a bit of the fraction each time it is squared
+    uint32_t m = (x << (31 - whole)) >> 16;
+    for (i = 0; i < 8; i++) {
+        m = (m * m) >> 15;
+        fraction <<= 1;
+        if (m >= 2 * ONE) {
+            m >>= 1;
+            fraction |= 1;
+        }
+    }
+    return whole << 8 | fraction;
+}
+
+// the information in an outcome with chance p, -p log2 p
+static uint32_t GuessEngineEntropy(uint32_t p) {
+    if (p == 0 || p >= ONE) return 0;
+    return p * (15 * 256 - GuessEngineLog2(p));
+}
+
+// adds the chances of the boat under the cursor, now that all its placements have been counted
+static void GuessEngineFinishBoat(void) {
+    // a single division, the squares are scaled by multiplying
+    uint32_t scale = (ONE << 16) / engine.boatPlacements;
+    uint16_t i;
+    for (i = 0; i < FIELD_SQUARES; i++) {
+        if (engine.boatCover[i] == 0) continue;
+        // boats cannot overlap, so the chances add up, though they are counted independently
+        uint32_t cover = engine.cover[i] + ((engine.boatCover[i] * scale) >> 16);
+        engine.cover[i] = cover < ONE ? cover : ONE;
+        engine.boatCover[i] = 0;
+        if (engine.boatSink[i] == 0) continue;
+        uint32_t sink = (engine.boatSink[i] * scale) >> 16;
+        engine.sink[i] += sink;
+        engine.sinkInformation[i] += GuessEngineEntropy(sink);
+        engine.boatSink[i] = 0;
+    }
+    engine.boatPlacements = 0;
+}
+
+// replaces the best guess with the unknown square whose result tells the most
+static void GuessEngineMostInformation(void) {
+    uint32_t bestInformation = 0;
+    uint8_t row, col;
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            uint16_t i = row * FIELD_COLS + col;
+            if (FIELD_SQUARE(engine.field, row, col) != FIELD_SQUARE_UNKNOWN) continue;
+            // a miss, a hit that sinks nothing, or one of the boats sunk
+            uint16_t hit = engine.cover[i] > engine.sink[i] ? engine.cover[i] - engine.sink[i] : 0;
+            uint32_t information = GuessEngineEntropy(ONE - engine.cover[i]) +
+                    GuessEngineEntropy(hit) + engine.sinkInformation[i];
+            if (information > bestInformation) {
+                bestInformation = information;
+                engine.best.row = row;
+                engine.best.col = col;
+            }
+        }
+    }
+}
+
+// replaces the best guess with the unknown square whose density, scaled by the prior, is highest
+static void GuessEngineMostLikely(void) {
+    uint32_t bestScore = 0;
+    uint8_t row, col;
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            uint16_t i = row * FIELD_COLS + col;
+            uint32_t score = (uint32_t) engine.density[i] * engine.prior[i];
+            if (FIELD_SQUARE(engine.field, row, col) == FIELD_SQUARE_UNKNOWN &&
+                    score > bestScore) {
+                bestScore = score;
+                engine.best.row = row;
+                engine.best.col = col;
+            }
+        }
+    }
+}
+
+// moves the cursor to the next placement, skipping boats that are already sunk
+static void GuessEngineAdvance(void) {
+    if (++engine.col < FIELD_COLS) return;
+    engine.col = 0;
+    if (++engine.row < FIELD_ROWS) return;
+    engine.row = 0;
+    if (++engine.dir < NUM_DIRS) return;
+    engine.dir = 0;
+    if (engine.informed && engine.boatPlacements) {
+        GuessEngineFinishBoat();
+    }
+    do {
+        engine.boat++;
+    } while (engine.boat < FIELD_NUM_BOATS && !GuessEngineBoatAlive(engine.boat));
+}
+
+// adds the placement under the cursor to the density, if it is still possible
+static void GuessEngineEvaluate(void) {
+    uint8_t length = fieldBoatSizes[engine.boat];
+    uint8_t dRow = (engine.dir == FIELD_DIR_SOUTH);
+    uint8_t dCol = (engine.dir == FIELD_DIR_EAST);
+    if (engine.row + dRow * (length - 1) >= FIELD_ROWS ||
+            engine.col + dCol * (length - 1) >= FIELD_COLS) {
+        return;
+    }
+
+    // the boat covers a run of bits in a single word
+    uint16_t start = dCol ? FIELD_BITBOARD_BIT(engine.row, engine.col) :
+            FIELD_BITBOARD_BIT_BY_COL(engine.row, engine.col);
+    uint8_t word = start >> 6, shift = start & 63;
+    uint64_t placement = (((uint64_t) 1 << length) - 1) << shift;
+    uint64_t hits = engine.hits[engine.dir].words[word];
+    if (placement & engine.blocked[engine.dir].words[word]) {
+        return;
+    }
+    uint16_t weight = 1 + GUESS_ENGINE_HIT_WEIGHT * __builtin_popcountll(placement & hits);
+
+    // every square left is unknown, from the top left so that ties go to the first one
+    uint64_t unknown = placement & ~hits;
+    // shooting the last unknown square of a placement sinks the boat
+    uint16_t sinks = (unknown & (unknown - 1)) == 0 ? weight * engine.informed : 0;
+    engine.boatPlacements += weight * engine.informed;
+    while (unknown) {
+        uint8_t i = __builtin_ctzll(unknown) - shift;
+        uint8_t row = engine.row + dRow * i;
+        uint8_t col = engine.col + dCol * i;
+        uint16_t *density = &engine.density[row * FIELD_COLS + col];
+        unknown &= unknown - 1;
+        engine.boatCover[row * FIELD_COLS + col] += weight * engine.informed;
+        engine.boatSink[row * FIELD_COLS + col] += sinks;
+        *density += weight;
+        if (*density > engine.bestDensity) {
+            engine.bestDensity = *density;
+            engine.best.row = row;
+            engine.best.col = col;
+        }
+    }
+}
+
+/**
+ * GuessEngineSetMode() picks how the square is chosen, from the next search on.  The mode is
+ * GUESS_ENGINE_DENSITY until it is set.
+ *
+ * @param mode The targeting mode.
+ */
+void GuessEngineSetMode(GuessEngineMode mode) {
+    engine.mode = mode;
+}
+
+/**
+ * GuessEngineSetPrior() scales the density of every square by a factor, from the next search on.
+ * The prior is read by every search until another is set, so it must be set again whenever it
+ * changes.  There is none until it is set.
+ *
+ * With a prior the best square is picked once the search is done, by density times its factor,
+ * and GuessEngineResults() picks the others the same way.  It is not used while
+ * GUESS_ENGINE_UNCERTAINTY or GUESS_ENGINE_INFORMATION picks by information.  Searches are kept
+ * in the table with the prior they were made with, and setting a new one, or the same one again,
+ * leaves them there unused.
+ *
+ * @param prior A factor for each square, row * FIELD_COLS + col, in units of
+ *        GUESS_ENGINE_PRIOR_ONE, or NULL for none.
+ */
+void GuessEngineSetPrior(const uint8_t *prior) {
+    engine.prior = prior;
+    engine.priorTag = 0;
+    if (prior == NULL) return;
+
+    // searches made with an older prior are left in the table, but never match again
+    if (++priorTags == 0) {
+        priorTags = 1;
+#if GUESS_ENGINE_CACHE_SIZE > 0
+        uint16_t i;
+        for (i = 0; i < GUESS_ENGINE_CACHE_SIZE; i++) {
+            cache[i].valid = FALSE;
+        }
+#endif
+    }
+    engine.priorTag = priorTags;
+}
+
+/**
+ * @return The prior set by GuessEngineSetPrior(), or NULL for none.
+ */
+const uint8_t *GuessEngineGetPrior(void) {
+    return engine.prior;
+}
+
+/**
+ * GuessEngineBegin() starts a new search.  The field must not change until the search is done
+ * or abandoned.  Until the first step, the result is a random square that has not been guessed.
+ *
+ * @param opp_field The opponent's field.
+ */
+void GuessEngineBegin(const Field *opp_field) {
+    int i, j;
+    engine.field = opp_field;
+    engine.cached = FALSE;
+
+#if GUESS_ENGINE_CACHE_SIZE > 0
+    // a search of the same knowledge may have been done, unless the key collides with another
+    cacheLookups++;
+    i = opp_field->key & (GUESS_ENGINE_CACHE_SIZE - 1);
+    if (cache[i].valid && cache[i].key == opp_field->key && cache[i].mode == engine.mode &&
+            cache[i].prior == engine.priorTag &&
+            FIELD_SQUARE(opp_field, cache[i].best.row, cache[i].best.col) ==
+            FIELD_SQUARE_UNKNOWN) {
+        for (j = 0; j < FIELD_SQUARES; j++) {
+            engine.density[j] = cache[i].density[j];
+        }
+        engine.bestDensity = cache[i].bestDensity;
+        engine.best = cache[i].best;
+        engine.boat = FIELD_NUM_BOATS;
+        engine.cached = TRUE;
+        cacheHits++;
+        // the random start is still drawn, so that the same games are played either way
+        rand();
+        return;
+    }
+#endif
+
+    for (i = 0; i < FIELD_SQUARES; i++) {
+        engine.density[i] = 0;
+    }
+
+    // boats can only cover unknown squares and hits
+    FieldBitboard unknown[NUM_DIRS];
+    FieldGetBitboard(opp_field, FIELD_SQUARE_UNKNOWN, &unknown[FIELD_DIR_EAST],
+            &unknown[FIELD_DIR_SOUTH]);
+    FieldGetBitboard(opp_field, FIELD_SQUARE_HIT, &engine.hits[FIELD_DIR_EAST],
+            &engine.hits[FIELD_DIR_SOUTH]);
+
+    // a boat that has been found is sunk by hitting it, not by learning more about it, unless
+    // every result is scored
+    engine.informed = (engine.mode == GUESS_ENGINE_UNCERTAINTY);
+    for (i = 0; i < FIELD_BITBOARD_WORDS; i++) {
+        engine.informed &= !engine.hits[FIELD_DIR_EAST].words[i];
+    }
+    engine.informed |= (engine.mode == GUESS_ENGINE_INFORMATION);
+    if (engine.informed) {
+        for (i = 0; i < FIELD_SQUARES; i++) {
+            engine.boatCover[i] = 0;
+            engine.boatSink[i] = 0;
+            engine.cover[i] = 0;
+            engine.sink[i] = 0;
+            engine.sinkInformation[i] = 0;
+        }
+        engine.boatPlacements = 0;
+    }
+    for (i = 0; i < NUM_DIRS; i++) {
+        for (j = 0; j < FIELD_BITBOARD_WORDS; j++) {
+            engine.blocked[i].words[j] = ~(unknown[i].words[j] | engine.hits[i].words[j]);
+        }
+    }
+    engine.bestDensity = 0;
+    engine.best.result = RESULT_MISS;
+
+    // start from a random square and take the first one that has not been guessed
+    int start = rand() % (FIELD_ROWS * FIELD_COLS);
+    engine.best.row = start / FIELD_COLS;
+    engine.best.col = start % FIELD_COLS;
+    for (i = 0; i < FIELD_ROWS * FIELD_COLS; i++) {
+        j = (start + i) % (FIELD_ROWS * FIELD_COLS);
+        if (FIELD_SQUARE(opp_field, j / FIELD_COLS, j % FIELD_COLS) == FIELD_SQUARE_UNKNOWN) {
+            engine.best.row = j / FIELD_COLS;
+            engine.best.col = j % FIELD_COLS;
+            break;
+        }
+    }
+
+    engine.row = 0;
+    engine.col = 0;
+    engine.dir = 0;
+    engine.boat = 0;
+    while (engine.boat < FIELD_NUM_BOATS && !GuessEngineBoatAlive(engine.boat)) {
+        engine.boat++;
+    }
+}
+
+/**
+ * GuessEngineStep() continues the search.
+ *
+ * @param budget The maximum number of placements to evaluate.
+ * @return TRUE if the search is done, FALSE if there is more work to do.
+ */
+uint8_t GuessEngineStep(uint16_t budget) {
+    while (budget-- > 0 && engine.boat < FIELD_NUM_BOATS) {
+        GuessEngineEvaluate();
+        GuessEngineAdvance();
+        if (GuessEngineIsDone() && engine.informed) {
+            GuessEngineMostInformation();
+        } else if (GuessEngineIsDone() && engine.prior != NULL) {
+            GuessEngineMostLikely();
+        }
+    }
+#if GUESS_ENGINE_CACHE_SIZE > 0
+    if (GuessEngineIsDone() && !engine.cached) {
+        uint16_t i = engine.field->key & (GUESS_ENGINE_CACHE_SIZE - 1), j;
+        for (j = 0; j < FIELD_SQUARES; j++) {
+            cache[i].density[j] = engine.density[j];
+        }
+        cache[i].bestDensity = engine.bestDensity;
+        cache[i].best = engine.best;
+        cache[i].key = engine.field->key;
+        cache[i].mode = engine.mode;
+        cache[i].prior = engine.priorTag;
+        cache[i].valid = TRUE;
+        engine.cached = TRUE;
+    }
+#endif
+    return GuessEngineIsDone();
+}
+
+/**
+ * @return TRUE if the search is done, FALSE otherwise.
+ */
+uint8_t GuessEngineIsDone(void) {
+    return engine.boat >= FIELD_NUM_BOATS;
+}
+
+/**
+ * @return The best guess found so far.  The result parameter is irrelevant.
+ */
+GuessData GuessEngineResult(void) {
+    return engine.best;
+}
+
+/**
+ * GuessEngineResults() picks several different squares to shoot at once.  The first is
+ * GuessEngineResult(), the others are the next best squares found so far.
+ *
+ * @param guesses Filled with the guesses, result parameters are irrelevant.
+ * @param count The number of guesses wanted.
+ * @return The number of guesses filled in, less than count if there are not enough squares left.
+ */
+uint8_t GuessEngineResults(GuessData *guesses, uint8_t count) {
+    uint8_t found = 0;
+    if (count == 0 ||
+            FIELD_SQUARE(engine.field, engine.best.row, engine.best.col) != FIELD_SQUARE_UNKNOWN) {
+        return 0;
+    }
+    guesses[found++] = engine.best;
+
+    // take the densest squares not already picked, scaled by the prior if there is one, ties
+    // going to the first one
+    while (found < count) {
+        int32_t bestScore = -1;
+        uint8_t row, col, i;
+        for (row = 0; row < FIELD_ROWS; row++) {
+            if (FieldCountInRow(engine.field, row, FIELD_SQUARE_UNKNOWN) == 0) continue;
+            for (col = 0; col < FIELD_COLS; col++) {
+                uint16_t square = row * FIELD_COLS + col;
+                int32_t score = (int32_t) engine.density[square] *
+                        (engine.prior ? engine.prior[square] : 1);
+                if (FIELD_SQUARE(engine.field, row, col) != FIELD_SQUARE_UNKNOWN ||
+                        score <= bestScore) {
+                    continue;
+                }
+                for (i = 0; i < found; i++) {
+                    if (guesses[i].row == row && guesses[i].col == col) break;
+                }
+                if (i == found) {
+                    bestScore = score;
+                    guesses[found].row = row;
+                    guesses[found].col = col;
+                    guesses[found].result = RESULT_MISS;
+                }
+            }
+        }
+        if (bestScore < 0) break;
+        found++;
+    }
+    return found;
+}
+
+/**
+ * GuessEngineCacheStats() reports how often GuessEngineBegin() found a search already done.
+ *
+ * @param hits Set to the number of searches found in the table.
+ * @param lookups Set to the number of searches begun with the table on.
+ */
+void GuessEngineCacheStats(uint32_t *hits, uint32_t *lookups) {
+    *hits = cacheHits;
+    *lookups = cacheLookups;
+}
+
+#ifdef GUESS_ENGINE_BENCHMARK
+
+#include <stdio.h>
+#include <time.h>
+
+#define GAMES 500
+#define SELF_PLAY_GAMES 2000
+
+// plays one game against a random placement, giving the engine `budget` placements per shot
+static int PlayGame(uint16_t budget, uint32_t salt) {
+    Field own, opp;
+    FieldInit(&own, &opp);
+    FieldAIPlaceAllBoats(&own);
+    // a key of its own for every game, so that no search is taken from the table
+    opp.key = salt;
+    int shots = 0;
+    while (FieldGetBoatStates(&own)) {
+        GuessEngineBegin(&opp);
+        GuessEngineStep(budget);
+        GuessData guess = GuessEngineResult();
+        FieldRegisterEnemyAttack(&own, &guess);
+        FieldUpdateKnowledge(&opp, &guess);
+        shots++;
+    }
+    return shots;
+}
+
+int main(void) {
+    static const uint16_t budgets[] = {0, 30, 60, 120, 240, GUESS_ENGINE_MAX_PLACEMENTS};
+    static int densityShots[GAMES];
+    int i, game, mode;
+
+    printf("placements per shot    mean shots to win    us per shot\n");
+    for (i = 0; i < sizeof (budgets) / sizeof (budgets[0]); i++) {
+        long shots = 0;
+        srand(1);
+        clock_t start = clock();
+        for (game = 0; game < GAMES; game++) {
+            shots += PlayGame(budgets[i], (uint32_t) i << 16 | game);
+        }
+        printf("%19u    %17.2f    %11.2f\n", budgets[i], (double) shots / GAMES,
+                1e6 * (clock() - start) / CLOCKS_PER_SEC / shots);
+    }
+
+    // the modes on the same placements, a tie against density counting as half a win
+    static const char *modeNames[] = {"density", "uncertainty", "information"};
+    printf("\n       mode    mean shots to win    win rate    us per shot\n");
+    for (mode = GUESS_ENGINE_DENSITY; mode <= GUESS_ENGINE_INFORMATION; mode++) {
+        long shots = 0;
+        double wins = 0;
+        GuessEngineSetMode(mode);
+        clock_t start = clock();
+        for (game = 0; game < GAMES; game++) {
+            srand(game);
+            int s = PlayGame(GUESS_ENGINE_MAX_PLACEMENTS, (uint32_t) 1 << 24 | game);
+            if (mode == GUESS_ENGINE_DENSITY) {
+                densityShots[game] = s;
+            }
+            wins += (s < densityShots[game]) + 0.5 * (s == densityShots[game]);
+            shots += s;
+        }
+        printf("%11s    %17.2f    %7.1f%%    %11.2f\n", modeNames[mode], (double) shots / GAMES,
+                100.0 * wins / GAMES, 1e6 * (clock() - start) / CLOCKS_PER_SEC / shots);
+    }
+    GuessEngineSetMode(GUESS_ENGINE_DENSITY);
+    printf("\n");
+
+    // the budget above is in placements; this converts it to time on this machine
+    Field own, opp;
+    FieldInit(&own, &opp);
+    long placements = 0;
+    clock_t start = clock();
+    while (clock() - start < CLOCKS_PER_SEC / 10) {
+        opp.key = placements;
+        GuessEngineBegin(&opp);
+        GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS);
+        placements += GUESS_ENGINE_MAX_PLACEMENTS;
+    }
+    printf("%.0f placements per ms\n", placements / (1000.0 * (clock() - start) / CLOCKS_PER_SEC));
+
+    // the field AI against itself, where the same knowledge comes up game after game
+    uint32_t hits, lookups, hitsBefore, lookupsBefore;
+    long shots = 0;
+    GuessEngineCacheStats(&hitsBefore, &lookupsBefore);
+    srand(1);
+    start = clock();
+    for (game = 0; game < SELF_PLAY_GAMES; game++) {
+        Field own[2], opp[2];
+        int turn = 0;
+        FieldInit(&own[0], &opp[0]);
+        FieldInit(&own[1], &opp[1]);
+        FieldAIPlaceAllBoats(&own[0]);
+        FieldAIPlaceAllBoats(&own[1]);
+        while (FieldGetBoatStates(&own[0]) && FieldGetBoatStates(&own[1])) {
+            GuessData guess = FieldAIDecideGuess(&opp[turn]);
+            FieldRegisterEnemyAttack(&own[!turn], &guess);
+            FieldUpdateKnowledge(&opp[turn], &guess);
+            turn = !turn;
+            shots++;
+        }
+    }
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    GuessEngineCacheStats(&hits, &lookups);
+    hits -= hitsBefore;
+    lookups -= lookupsBefore;
+    printf("self-play with %d cached searches: %.0f games per s, %ld shots, %.1f%% found\n",
+            GUESS_ENGINE_CACHE_SIZE, SELF_PLAY_GAMES / seconds, shots,
+            lookups ? 100.0 * hits / lookups : 0.0);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef GUESS_ENGINE_H
+#define GUESS_ENGINE_H
+
+#include <stdint.h>
+#include "Field.h"
+
+/**
+ * The guess engine decides a shot by counting, for every square, the boat placements that are
+ * still consistent with what we know about the opponent field.  Placements that cover known hits
+ * are weighted more heavily, so the engine homes in on a boat once it has been found.
+ *
+ * The work is split into steps so it can share the main loop with event handling: a step
+ * evaluates at most a fixed number of placements, and the best guess found so far can be read
+ * at any time.
+ *
+ * Guess quality against budget, the two targeting modes against each other, and self-play
+ * throughput with the transposition table, can be measured on x86 by compiling with the
+ * GUESS_ENGINE_BENCHMARK macro.  The throughput gain is found by comparing with a build with
+ * GUESS_ENGINE_CACHE_SIZE set to 0.
+ * With gcc: `gcc <field AI sources> -DGUESS_ENGINE_BENCHMARK`, see Field.h
+ */
+
+/**
+ * How much more a placement counts for each known hit it covers.
+ */
+#ifndef GUESS_ENGINE_HIT_WEIGHT
+#define GUESS_ENGINE_HIT_WEIGHT 16
+#endif
+
+/**
+ * How the engine picks a square once the search is done.
+ *
+ * GUESS_ENGINE_DENSITY shoots the square the most placements cover, the one most likely to be a
+ * hit.
+ *
+ * GUESS_ENGINE_INFORMATION shoots the square whose result tells the most about where the boats
+ * are.  The placements counted for the density, weighted the same way, give each boat's chance of
+ * covering a square, and of being sunk there because its other squares are all hits.  Those give
+ * the chance of each result of a shot, a miss, a hit, or each boat sunk, and since the result is
+ * known once the placement is, the expected gain is the entropy of the result, in fixed point.
+ * This costs a count per square of each boat's placements and sinks, and a pass over the squares
+ * per boat.
+ *
+ * GUESS_ENGINE_UNCERTAINTY shoots the square whose result is least certain while no hit is known,
+ * the one nearest an even chance of a hit, which is GUESS_ENGINE_INFORMATION before any hit, since
+ * then no shot can sink a boat.  Once a hit is known it picks by density, and costs no more than
+ * GUESS_ENGINE_DENSITY.
+ *
+ * Until the search is done, the best guess so far is by density in every mode.
+ */
+typedef enum {
+    GUESS_ENGINE_DENSITY,
+    GUESS_ENGINE_UNCERTAINTY,
+    GUESS_ENGINE_INFORMATION
+} GuessEngineMode;
+
+/**
+ * A prior, see GuessEngineSetPrior(), gives each square a factor in these units, so that this
+ * leaves its density as it is.
+ */
+#define GUESS_ENGINE_PRIOR_ONE 16
+
+/**
+ * Finished searches are kept in a transposition table, keyed by the opponent field's Zobrist key
+ * (see Field), with the best guess and the density of every square.  GuessEngineBegin() looks
+ * the field up, and a search found there is done before the first step.
+ *
+ * The table has GUESS_ENGINE_CACHE_SIZE slots, indexed by the low bits of the key, each taking
+ * about 2 bytes a square.  On the PIC32 a few are kept, enough for the first shots of every game,
+ * and on a host running self-play many more.  0 turns the table off.
+ */
+#ifndef GUESS_ENGINE_CACHE_SIZE
+#ifdef PIC32
+#define GUESS_ENGINE_CACHE_SIZE 4
+#else
+#define GUESS_ENGINE_CACHE_SIZE 4096
+#endif
+#endif
+
+#if GUESS_ENGINE_CACHE_SIZE & (GUESS_ENGINE_CACHE_SIZE - 1)
+#error "GUESS_ENGINE_CACHE_SIZE must be a power of 2, or 0"
+#endif
+
+/**
+ * The number of placements a full search evaluates: every boat, in both directions, from every
+ * square.  Passing this to GuessEngineStep() always finishes the search.
+ */
+#define GUESS_ENGINE_MAX_PLACEMENTS (FIELD_NUM_BOATS * 2 * FIELD_ROWS * FIELD_COLS)
+
+/**
+ * GuessEngineSetMode() picks how the square is chosen, from the next search on.  The mode is
+ * GUESS_ENGINE_DENSITY until it is set.
+ *
+ * @param mode The targeting mode.
+ */
+void GuessEngineSetMode(GuessEngineMode mode);
+
+/**
+ * GuessEngineSetPrior() scales the density of every square by a factor, from the next search on.
+ * The prior is read by every search until another is set, so it must be set again whenever it
+ * changes.  There is none until it is set.
+ *
+ * With a prior the best square is picked once the search is done, by density times its factor,
+ * and GuessEngineResults() picks the others the same way.  It is not used while
+ * GUESS_ENGINE_UNCERTAINTY or GUESS_ENGINE_INFORMATION picks by information.  Searches are kept
+ * in the table with the prior they were made with, and setting a new one, or the same one again,
+ * leaves them there unused.
+ *
+ * @param prior A factor for each square, row * FIELD_COLS + col, in units of
+ *        GUESS_ENGINE_PRIOR_ONE, or NULL for none.
+ */
+void GuessEngineSetPrior(const uint8_t *prior);
+
+/**
+ * @return The prior set by GuessEngineSetPrior(), or NULL for none.
+ */
+const uint8_t *GuessEngineGetPrior(void);
+
+/**
+ * GuessEngineBegin() starts a new search.  The field must not change until the search is done
+ * or abandoned.  Until the first step, the result is a random square that has not been guessed.
+ *
+ * @param opp_field The opponent's field.
+ */
+void GuessEngineBegin(const Field *opp_field);
+
+/**
+ * GuessEngineStep() continues the search.
+ *
+ * @param budget The maximum number of placements to evaluate.
+ * @return TRUE if the search is done, FALSE if there is more work to do.
+ */
+uint8_t GuessEngineStep(uint16_t budget);
+
+/**
+ * @return TRUE if the search is done, FALSE otherwise.
+ */
+uint8_t GuessEngineIsDone(void);
+
+/**
+ * @return The best guess found so far.  The result parameter is irrelevant.
+ */
+GuessData GuessEngineResult(void);
+
+/**
+ * GuessEngineResults() picks several different squares to shoot at once.  The first is
+ * GuessEngineResult(), the others are the next best squares found so far.
+ *
+ * @param guesses Filled with the guesses, result parameters are irrelevant.
+ * @param count The number of guesses wanted.
+ * @return The number of guesses filled in, less than count if there are not enough squares left.
+ */
+uint8_t GuessEngineResults(GuessData *guesses, uint8_t count);
+
+/**
+ * GuessEngineCacheStats() reports how often GuessEngineBegin() found a search already done.
+ *
+ * @param hits Set to the number of searches found in the table.
+ * @param lookups Set to the number of searches begun with the table on.
+ */
+void GuessEngineCacheStats(uint32_t *hits, uint32_t *lookups);
+
+#endif // GUESS_ENGINE_H
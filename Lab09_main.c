@@ -22,6 +22,8 @@
 #include "Negotiation.h"
 #include "Message.h"
 #include "Field.h"
+#include "LinkLayer.h"
+#include "LinkStats.h"
 
 //The following Macro switches provide useful debugging tools:
 
@@ -52,6 +54,18 @@
 //The amount of time between UART updates (in 100ths of a second)
 #define TRANSMIT_PERIOD 10
 
+//How long the line can go quiet in the middle of a message before the message is given up on (in
+//100ths of a second).  The sender never pauses longer than TRANSMIT_PERIOD within a message
+#define RECEIVE_TIMEOUT (5 * TRANSMIT_PERIOD)
+
+//How long an upgraded link can go without a valid message before falling back to the default
+//rate, how long to wait after falling back before sending our last message again, and how long
+//after falling back to wait for a valid message before giving up on the game (in 100ths of a
+//second)
+#define LINK_SILENCE_TIMEOUT 100
+#define LINK_RESEND_DELAY 50
+#define LINK_RETRY_TIMEOUT 1000
+
 /**
  *  Static data for BattleBoats top level:
  */
@@ -63,6 +77,9 @@ static BB_Event battleboatEvent;
 //and to throttle the outgoing transmission speed:
 static uint32_t freerunning_timer = 0;
 
+//when the last byte was received, to notice a message that stops partway through:
+static uint32_t receive_time = 0;
+
 /*
  * The Transmission Outgoing submodule has two states.  It can only send one message at a time,
  * so new outgoing messages can only be started when it is in IDLE mode. 
@@ -74,6 +91,39 @@ enum {
 } transmission_state = IDLE;
 static char outgoing_message_buffer[MESSAGE_MAX_LEN + 1];
 static int outgoing_index = 0;
+static MessageType outgoing_type = MESSAGE_NONE;
+static uint8_t outgoing_silent = FALSE; //TRUE if no MESSAGE_SENT event should follow
+
+//a message from the agent that has to wait for the link layer to finish sending:
+static Message pending_message;
+static uint8_t message_pending = FALSE;
+
+/*
+ * The Link submodule switches the UART to a faster rate once REV has gone by, if the agents
+ * agreed on a fast link, and then runs the Transmission module unthrottled from the main loop.
+ * 
+ * For as long as the new rate is in use, a bad message or a timeout without a valid message
+ * switches back to the default rate, and whoever is waiting on a reply sends its last message
+ * again.  Either board falling back garbles what it sends to the other, or leaves it waiting, so
+ * the other falls back too and the two never stay at different rates.
+ * 
+ * The attacker's message is the only one sent again, so a lost result would leave both boards
+ * waiting.  Without the link layer, if nothing valid arrives within LINK_RETRY_TIMEOUT of falling
+ * back, the agent is given an error and the game ends on the error screen instead.
+ */
+static enum {
+    LINK_DEFAULT, LINK_FAST
+} link_state = LINK_DEFAULT;
+static uint16_t link_default_brg;
+static uint32_t link_deadline;
+static uint8_t link_resend_pending = FALSE;
+static uint8_t link_retrying = FALSE;
+static uint32_t link_retry_deadline;
+
+//flipping SW4 on asks for the link statistics to be written out between messages, a line at
+//a time as the TX buffer has room:
+static uint8_t last_switches;
+static int stats_dump_line = LINK_STATS_NUM_COUNTERS;
 
 /**
  * This function copies a message into the Transmission outgoing message buffer and begins
@@ -96,6 +146,8 @@ void Transmission_StartSendingMessage(const Message * message_to_send)
     case IDLE:
         //copy message into sending buffer:
         Message_Encode(outgoing_message_buffer, *message_to_send);
+        outgoing_type = message_to_send->type;
+        outgoing_silent = FALSE;
         outgoing_index = 0;
         //switch into sending mode:
         transmission_state = SENDING;
@@ -116,7 +168,7 @@ void Transmission_SendChar(void)
     char to_send = outgoing_message_buffer[outgoing_index];
     if (to_send == '\0') {
         //this means our message is fully transmitted.
-        battleboatEvent.type = BB_EVENT_MESSAGE_SENT;
+        if (!outgoing_silent) battleboatEvent.type = BB_EVENT_MESSAGE_SENT;
         outgoing_index = 0;
         transmission_state = IDLE;
         return;
@@ -126,6 +178,30 @@ void Transmission_SendChar(void)
     }
 }
 
+/**
+ * Sends the message in the buffer again, without generating another MESSAGE_SENT event.
+ */
+void Transmission_Resend(void)
+{
+    if (transmission_state != IDLE || outgoing_type == MESSAGE_NONE) return;
+    outgoing_silent = TRUE;
+    outgoing_index = 0;
+    transmission_state = SENDING;
+}
+
+/**
+ * Sends a message from the link layer, without generating a MESSAGE_SENT event.  Like
+ * Transmission_StartSendingMessage(), this should only be called in the IDLE state.
+ */
+void Transmission_StartSendingLinkFrame(const Message * frame)
+{
+    if (transmission_state != IDLE) return;
+    Message_Encode(outgoing_message_buffer, *frame);
+    outgoing_silent = TRUE;
+    outgoing_index = 0;
+    transmission_state = SENDING;
+}
+
 /**
  * Check for incoming messages.  This module uses Message_Decode to parse messages
  * in the UART input stream, and generates events if any messages are detected.
@@ -134,9 +210,16 @@ void Transmission_ReceiveChar(void)
 {
     unsigned char incoming_char;
 
-    //read from the UART (if there is anything to read:
-    if (!Uart1HasData()) return;
+    //read from the UART (if there is anything to read, otherwise a message that has stopped
+    //partway through has lost its end:
+    if (!Uart1HasData()) {
+        if ((int32_t) (freerunning_timer - receive_time) >= RECEIVE_TIMEOUT) {
+            Message_DecodeTimeout(&battleboatEvent);
+        }
+        return;
+    }
     Uart1ReadByte(&incoming_char);
+    receive_time = freerunning_timer;
 
     // the commented line below is very handy for debugging Message_Decode
     debug_printf("%c | %02x\n", incoming_char, incoming_char);
@@ -144,12 +227,127 @@ void Transmission_ReceiveChar(void)
     //react to incoming char:
     if (incoming_char != '\0') {
         Message_Decode(incoming_char, &battleboatEvent);
+        LinkStatsCountDecode(&battleboatEvent);
     }
 
     //also, re-seed our random number using the time:
     seed_rand(rand() + freerunning_timer);
 }
 
+/**
+ * Switches the UART to the rate the agents agreed on, if they agreed on a fast link.  This must
+ * only be called once REV has been completely sent or received.
+ */
+void Link_Upgrade(void)
+{
+    uint16_t brg;
+    if (link_state != LINK_DEFAULT || !AgentGetFastLink(&brg)) return;
+
+    Uart1ChangeBaudRate(brg);
+    link_state = LINK_FAST;
+    link_deadline = freerunning_timer + LINK_SILENCE_TIMEOUT;
+}
+
+/**
+ * Switches the UART back to the default rate.  If the agent is waiting on a reply, our last
+ * message may have been lost, so it is sent again once the other board has had time to fall back.
+ * The link layer retransmits on its own, so this is only needed without it.
+ */
+void Link_Fallback(void)
+{
+    Uart1ChangeBaudRate(link_default_brg);
+    link_state = LINK_DEFAULT;
+    LinkStatsCount(LINK_STATS_RATE_FALLBACKS, 1);
+    link_resend_pending = (AgentGetState() == AGENT_STATE_ATTACKING) && !LinkLayerIsEnabled();
+    link_deadline = freerunning_timer + LINK_RESEND_DELAY;
+    link_retrying = !LinkLayerIsEnabled();
+    link_retry_deadline = freerunning_timer + LINK_RETRY_TIMEOUT;
+}
+
+/**
+ * Screens an event while the link is upgraded, and notices a valid message after falling back.
+ * @return TRUE if the event should be passed on to the agent, FALSE if it should be dropped.
+ */
+uint8_t Link_CheckEvent(const BB_Event *event)
+{
+    switch (event->type) {
+    case BB_EVENT_ERROR:
+        if (link_state != LINK_FAST) return TRUE;
+        Link_Fallback();
+        return FALSE;
+    case BB_EVENT_CHA_RECEIVED:
+    case BB_EVENT_ACC_RECEIVED:
+    case BB_EVENT_REV_RECEIVED:
+    case BB_EVENT_SHO_RECEIVED:
+    case BB_EVENT_RES_RECEIVED:
+    case BB_EVENT_RSH_RECEIVED:
+    case BB_EVENT_SAL_RECEIVED:
+    case BB_EVENT_SRS_RECEIVED:
+        link_retrying = FALSE;
+        if (link_state == LINK_FAST) link_deadline = freerunning_timer + LINK_SILENCE_TIMEOUT;
+        return TRUE;
+    default:
+        return TRUE;
+    }
+}
+
+/**
+ * Runs the Link submodule from the main loop: handles silence timeouts, resending and giving up,
+ * returns to the default rate when a new game starts, and runs the Transmission module while
+ * unthrottled.
+ */
+void Link_Update(void)
+{
+    int32_t until_deadline = (int32_t) (link_deadline - freerunning_timer);
+
+    if (link_state == LINK_FAST && until_deadline <= 0) {
+        Link_Fallback();
+    } else if (link_state != LINK_DEFAULT && AgentGetState() == AGENT_STATE_START) {
+        Uart1ChangeBaudRate(link_default_brg);
+        link_state = LINK_DEFAULT;
+    }
+
+    if (link_resend_pending && until_deadline <= 0 && transmission_state == IDLE) {
+        link_resend_pending = FALSE;
+        Transmission_Resend();
+    }
+
+    //a game that is over has nothing left to wait for, one that is not has waited long enough:
+    if (AgentGetState() == AGENT_STATE_START || AgentGetState() == AGENT_STATE_END_SCREEN) {
+        link_retrying = FALSE;
+    } else if (link_retrying && (int32_t) (link_retry_deadline - freerunning_timer) <= 0 &&
+            battleboatEvent.type == BB_EVENT_NO_EVENT) {
+        link_retrying = FALSE;
+        battleboatEvent.type = BB_EVENT_ERROR;
+        battleboatEvent.param0 = BB_ERROR_LINK_TIMEOUT;
+    }
+
+    if (link_state != LINK_DEFAULT && battleboatEvent.type == BB_EVENT_NO_EVENT) {
+        Transmission_SendChar();
+        if (battleboatEvent.type == BB_EVENT_MESSAGE_SENT) return;
+        Transmission_ReceiveChar();
+    }
+}
+
+/**
+ * Writes the next link statistics counter to the UART, if a dump is under way and the line fits
+ * in the TX buffer.  This should only be called in the IDLE state, so that it does not land in
+ * the middle of a message.  A board that skips noise between messages (see Message_UseResync()),
+ * which it only does once the link layer or CRC framing is agreed on, ignores the lines; any
+ * other board reports them as an error.
+ */
+void Stats_DumpNext(void)
+{
+    char line[64];
+    if (stats_dump_line >= LINK_STATS_NUM_COUNTERS) return;
+
+    int length = sprintf(line, "---STATS:  %s=%lu\n", LinkStatsName(stats_dump_line),
+            (unsigned long) LinkStatsGet(stats_dump_line));
+    if (length > Uart1TxSpace()) return;
+    Uart1WriteData(line, length);
+    stats_dump_line++;
+}
+
 //Functions that stringify state names and event names for display.
 // <editor-fold defaultstate="collapsed" desc="Trace Mode Functions">
 #ifdef TRACE_MODE
@@ -186,6 +384,11 @@ void TraceEvent(void)
         printcase(BB_EVENT_REV_RECEIVED);
         printcase(BB_EVENT_SHO_RECEIVED);
         printcase(BB_EVENT_RES_RECEIVED);
+        printcase(BB_EVENT_RSH_RECEIVED);
+        printcase(BB_EVENT_SAL_RECEIVED);
+        printcase(BB_EVENT_SRS_RECEIVED);
+        printcase(BB_EVENT_ACK_RECEIVED);
+        printcase(BB_EVENT_NAK_RECEIVED);
         printcase(BB_EVENT_MESSAGE_SENT);
         printcase(BB_EVENT_ERROR);
     }
@@ -203,6 +406,7 @@ void TraceEvent(void)
 int main()
 {
     BOARD_Init();
+    LinkStatsInit();
 
     // Set up UART1 for output.
     // <editor-fold defaultstate="collapsed" desc="Configure Timers and UART">
@@ -211,6 +415,8 @@ int main()
     // Configure Timer 2 using PBCLK as input. We configure it using a 1:16 prescalar, so each timer
     // tick is actually at F_PB / 16 Hz, so setting PR2 to F_PB / 16 / 100 yields a .01s timer.
 
+    link_default_brg = U1BRG; // remember the default rate in case an upgraded link falls back
+
     T2CON = 0; // everything should be off
     T2CONbits.TCKPS = 0b100; // 1:16 prescaler
     PR2 = BOARD_GetPBClock() / 16 / 100; // interrupt at .5s intervals
@@ -240,29 +446,83 @@ int main()
 
     //Initialize Agent module:
     AgentInit();
+    last_switches = SWITCH_STATES();
 
     TraceState();
 
     //Main loop:
     while (TRUE) {
 
+        Link_Update();
+
         //if there is a top-level event, the Agent module should respond to it:
         if (battleboatEvent.type != BB_EVENT_NO_EVENT) {
 
             TraceEvent();
 
+            //once our REV is out, the link can be upgraded:
+            if (battleboatEvent.type == BB_EVENT_MESSAGE_SENT && outgoing_type == MESSAGE_REV) {
+                Link_Upgrade();
+            }
+
+            //while the link is upgraded, errors are the link's problem:
+            if (!Link_CheckEvent(&battleboatEvent)) {
+                battleboatEvent.type = BB_EVENT_NO_EVENT;
+                continue;
+            }
+
+            //acknowledgements, duplicates and errors are the link layer's problem:
+            if (!LinkLayerReceive(&battleboatEvent, freerunning_timer)) {
+                battleboatEvent.type = BB_EVENT_NO_EVENT;
+                continue;
+            }
+
             Message message_to_send = AgentRun(battleboatEvent);
 
             TraceState();
 
-            //send a message, if there is one to send:
+            //once their REV is in, the link can be upgraded before we answer:
+            if (battleboatEvent.type == BB_EVENT_REV_RECEIVED) {
+                Link_Upgrade();
+            }
+
+            //send a message, if there is one to send, once the link layer is done sending.  If
+            //the link layer has no room for it, the game cannot go on:
             if (message_to_send.type != MESSAGE_NONE) {
-                Transmission_StartSendingMessage(&message_to_send);
+                if (LinkLayerSend(&message_to_send, freerunning_timer) == SUCCESS) {
+                    pending_message = message_to_send;
+                    message_pending = TRUE;
+                } else {
+                    BB_Event window_full = {
+                        .type = BB_EVENT_ERROR, .param0 = BB_ERROR_LINK_WINDOW_FULL
+                    };
+                    AgentRun(window_full);
+                }
             }
 
             //consume the event:
             battleboatEvent.type = BB_EVENT_NO_EVENT;
 
+        } else if (transmission_state == IDLE && !message_pending) {
+            //nothing to do, so let the agent work ahead:
+            AgentIdle();
+        }
+
+        //notice SW4 being flipped on:
+        uint8_t switches = SWITCH_STATES();
+        if (switches & ~last_switches & SWITCH_STATE_SW4) stats_dump_line = 0;
+        last_switches = switches;
+
+        //the agent's messages go first, then whatever the link layer has to send:
+        if (transmission_state == IDLE) {
+            Message link_frame;
+            Stats_DumpNext();
+            if (message_pending) {
+                message_pending = FALSE;
+                Transmission_StartSendingMessage(&pending_message);
+            } else if (LinkLayerPoll(&link_frame, freerunning_timer)) {
+                Transmission_StartSendingLinkFrame(&link_frame);
+            }
         }
 
         //update the LEDs to show the agent's current state:
@@ -294,7 +554,8 @@ void __ISR(_TIMER_2_VECTOR, ipl4auto) TimerInterrupt100Hz(void)
     if (buttonEvent) seed_rand(rand() + freerunning_timer);
 
     //every TRANSMIT_PERIOD cycles, attempt to run the transmission module.
-    if (freerunning_timer % TRANSMIT_PERIOD == 0) {
+    //an upgraded link is run unthrottled from the main loop instead.
+    if (link_state == LINK_DEFAULT && freerunning_timer % TRANSMIT_PERIOD == 0) {
         Transmission_SendChar();
         if (battleboatEvent.type == BB_EVENT_MESSAGE_SENT) return;
         Transmission_ReceiveChar();
@@ -0,0 +1,347 @@
+/*
+ * File:   LayoutPool.c
+ * Author: jwang456
+ *
+ * Purpose: Table of boat layouts that last long against a density-based attack
+ *
+ *
+ */
+#include "LayoutPool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "BOARD.h"
+#include "Field.h"
+
+// the field and fleet the table was generated for
+#define LAYOUT_POOL_ROWS 6
+#define LAYOUT_POOL_COLS 10
+#define LAYOUT_POOL_NUM_BOATS 4
+
+// the number of layouts kept
+#define LAYOUT_POOL_SIZE 64
+
+// each boat of a layout is a byte: the square at its top left, row * FIELD_COLS + col, with this
+// bit set if it faces east
+#define LAYOUT_POOL_EAST 0x80
+
+#if FIELD_ROWS == LAYOUT_POOL_ROWS && FIELD_COLS == LAYOUT_POOL_COLS && \
+        FIELD_NUM_BOATS == LAYOUT_POOL_NUM_BOATS
+#define LAYOUT_POOL_FITS
+#endif
+
+#ifdef LAYOUT_POOL_FITS
+/*
+ * Generated by compiling with LAYOUT_POOL_GENERATE.  Each line is a layout, a byte for each boat,
+ * longest lasting first.
+ */
+// 20000 candidates, 27.73 shots on average, 36.25 to 34.00 kept
+static const uint8_t layoutPoolSizes[LAYOUT_POOL_NUM_BOATS] = {3, 4, 5, 6};
+static const uint8_t layoutPool[LAYOUT_POOL_SIZE][LAYOUT_POOL_NUM_BOATS] = {
+    {0x9A, 0x09, 0x0F, 0x83},
+    {0x87, 0x90, 0x0F, 0x80},
+    {0xA5, 0xA0, 0xAC, 0xB6},
+    {0x8B, 0x0A, 0x04, 0xB3},
+    {0xA9, 0x0A, 0x04, 0xB3},
+    {0x87, 0x06, 0x00, 0xB6},
+    {0xAF, 0x8A, 0xB6, 0x80},
+    {0xB2, 0x94, 0x9E, 0x80},
+    {0xA8, 0x09, 0x0F, 0x03},
+    {0xB2, 0x80, 0xB6, 0xA8},
+    {0x8B, 0x9A, 0x0F, 0x00},
+    {0xB2, 0x1D, 0x0D, 0x80},
+    {0x8A, 0x80, 0x8E, 0xB2},
+    {0x8A, 0x90, 0x0D, 0x80},
+    {0x94, 0x1C, 0x0D, 0x80},
+    {0x87, 0x04, 0x0F, 0x06},
+    {0xB9, 0xAE, 0xB3, 0x8D},
+    {0x8A, 0x10, 0x05, 0x03},
+    {0xAF, 0x8E, 0x83, 0xB6},
+    {0xA8, 0x09, 0xB2, 0x08},
+    {0xB9, 0xA8, 0x81, 0xB2},
+    {0x1E, 0x08, 0x0F, 0x81},
+    {0x87, 0x06, 0x80, 0xB6},
+    {0xA8, 0xAE, 0xB3, 0x81},
+    {0xAE, 0xB8, 0x0A, 0x04},
+    {0x91, 0x0B, 0xB3, 0x84},
+    {0xB9, 0x1A, 0x8B, 0x84},
+    {0x8A, 0x80, 0xB7, 0x04},
+    {0xAE, 0x80, 0x09, 0x04},
+    {0x8A, 0x1D, 0x11, 0x94},
+    {0xAB, 0x15, 0x02, 0xA2},
+    {0x80, 0x8B, 0xA2, 0x84},
+    {0xB9, 0x03, 0x8F, 0xB2},
+    {0x8B, 0x80, 0x13, 0x05},
+    {0xAF, 0x90, 0x04, 0xB5},
+    {0xA4, 0x99, 0xAC, 0x09},
+    {0xA8, 0x90, 0x03, 0x04},
+    {0x87, 0x8E, 0x81, 0x00},
+    {0x8A, 0x18, 0x10, 0x03},
+    {0x8C, 0x0F, 0x01, 0x82},
+    {0xB8, 0x90, 0xB2, 0x05},
+    {0x90, 0x82, 0x0E, 0x09},
+    {0x91, 0x99, 0x9E, 0x8A},
+    {0xB9, 0xA8, 0x0E, 0x06},
+    {0xAF, 0xB8, 0xA8, 0x80},
+    {0x87, 0x03, 0x06, 0x05},
+    {0x87, 0x1D, 0x0F, 0x00},
+    {0xB8, 0x19, 0x13, 0x03},
+    {0x86, 0xB2, 0x05, 0xB6},
+    {0xAB, 0x9F, 0x09, 0xB2},
+    {0x1E, 0x85, 0xA9, 0x9F},
+    {0x91, 0x9A, 0x80, 0xAC},
+    {0xA5, 0xA0, 0x94, 0xAC},
+    {0x91, 0xA8, 0xB6, 0x84},
+    {0x9E, 0x13, 0x03, 0xB2},
+    {0x9A, 0xA3, 0x8F, 0xB5},
+    {0xB9, 0x9F, 0xB3, 0xAB},
+    {0x9B, 0x96, 0xA9, 0x8E},
+    {0x91, 0xAA, 0xB3, 0x00},
+    {0xB8, 0x9E, 0x94, 0x09},
+    {0x87, 0x90, 0x81, 0x96},
+    {0x81, 0x96, 0x00, 0x8E},
+    {0x00, 0xA8, 0x06, 0x05},
+    {0x08, 0x81, 0x05, 0x06},
+};
+#endif
+
+// a boat's placement, as read from a layout
+typedef struct {
+    uint8_t row;
+    uint8_t col;
+    BoatDirection dir;
+} LayoutPoolBoat;
+
+#if defined(LAYOUT_POOL_FITS) || defined(LAYOUT_POOL_GENERATE)
+// mirrors a layout top to bottom and left to right as asked
+static void LayoutPoolMirror(LayoutPoolBoat *boats, uint8_t flipRows, uint8_t flipCols) {
+    uint8_t boat;
+    for (boat = 0; boat < FIELD_NUM_BOATS; boat++) {
+        uint8_t length = fieldBoatSizes[boat];
+        LayoutPoolBoat *b = &boats[boat];
+        // the end that was at the bottom or the right is now at the top or the left
+        if (flipRows) {
+            b->row = FIELD_ROWS - b->row - (b->dir == FIELD_DIR_SOUTH ? length : 1);
+        }
+        if (flipCols) {
+            b->col = FIELD_COLS - b->col - (b->dir == FIELD_DIR_EAST ? length : 1);
+        }
+    }
+}
+#endif
+
+#ifdef LAYOUT_POOL_FITS
+// reads a layout from the pool
+static void LayoutPoolRead(uint8_t index, LayoutPoolBoat *boats) {
+    uint8_t boat;
+    for (boat = 0; boat < FIELD_NUM_BOATS; boat++) {
+        uint8_t entry = layoutPool[index][boat], square = entry & ~LAYOUT_POOL_EAST;
+        boats[boat].row = square / FIELD_COLS;
+        boats[boat].col = square % FIELD_COLS;
+        boats[boat].dir = (entry & LAYOUT_POOL_EAST) ? FIELD_DIR_EAST : FIELD_DIR_SOUTH;
+    }
+}
+#endif
+
+// places a layout from the pool, and moves one boat a square if mutate is set
+static uint8_t LayoutPoolPlace(Field *own_field, uint8_t mutate) {
+#ifdef LAYOUT_POOL_FITS
+    LayoutPoolBoat boats[FIELD_NUM_BOATS];
+    uint8_t boat;
+
+    for (boat = 0; boat < FIELD_NUM_BOATS; boat++) {
+        if (fieldBoatSizes[boat] != layoutPoolSizes[boat]) {
+            return STANDARD_ERROR;
+        }
+    }
+    uint8_t index = rand() % LAYOUT_POOL_SIZE, flips = rand();
+    LayoutPoolRead(index, boats);
+    if (mutate) {
+        LayoutPoolMirror(boats, flips & 1, flips & 2);
+    }
+
+    // the boat to move goes last, back where it was if it does not fit a square over
+    uint8_t moved = mutate ? rand() % FIELD_NUM_BOATS : FIELD_NUM_BOATS;
+    for (boat = 0; boat < FIELD_NUM_BOATS; boat++) {
+        if (boat != moved) {
+            FieldAddBoat(own_field, boats[boat].row, boats[boat].col, boats[boat].dir, boat);
+        }
+    }
+    if (moved < FIELD_NUM_BOATS) {
+        LayoutPoolBoat *b = &boats[moved];
+        uint8_t step = rand() % 4;
+        // a step off the top or the left wraps around to a square off the field
+        uint8_t row = b->row + (step == 0) - (step == 1);
+        uint8_t col = b->col + (step == 2) - (step == 3);
+        if (FieldAddBoat(own_field, row, col, b->dir, moved) != SUCCESS) {
+            FieldAddBoat(own_field, b->row, b->col, b->dir, moved);
+        }
+    }
+    return SUCCESS;
+#else
+    return STANDARD_ERROR;
+#endif
+}
+
+/**
+ * LayoutPoolPlaceAllBoats() places every boat on a field in a layout from the pool.
+ * FieldAIPlaceAllBoats() uses it when there is a pool for the field.
+ *
+ * @param own_field The agent's own field, freshly initialized.
+ * @return SUCCESS if the boats were placed, STANDARD_ERROR if there is no pool for this field,
+ *         in which case the field is left as it was.
+ */
+uint8_t LayoutPoolPlaceAllBoats(Field *own_field) {
+    return LayoutPoolPlace(own_field, TRUE);
+}
+
+#if defined(LAYOUT_POOL_GENERATE) || defined(LAYOUT_POOL_BENCHMARK)
+
+#include <stdio.h>
+
+#include "GuessEngine.h"
+
+// places the boats anywhere they fit, from the longest, noting where each went
+static void LayoutPoolPlaceRandomly(Field *own_field, LayoutPoolBoat *boats) {
+    int boat;
+    for (boat = FIELD_NUM_BOATS - 1; boat >= 0; boat--) {
+        LayoutPoolBoat *b = &boats[boat];
+        do {
+            b->dir = rand() % 2;
+            b->row = rand() % FIELD_ROWS;
+            b->col = rand() % FIELD_COLS;
+        } while (FieldAddBoat(own_field, b->row, b->col, b->dir, boat) != SUCCESS);
+    }
+}
+
+// the shots an attack takes to sink every boat on a field
+static int LayoutPoolSurvival(Field *own_field, GuessData (*attack)(const Field *)) {
+    Field unused, opp;
+    FieldInit(&unused, &opp);
+    int shots = 0;
+    while (FieldGetBoatStates(own_field)) {
+        GuessData guess = attack(&opp);
+        FieldRegisterEnemyAttack(own_field, &guess);
+        FieldUpdateKnowledge(&opp, &guess);
+        shots++;
+    }
+    return shots;
+}
+
+#endif
+
+#ifdef LAYOUT_POOL_GENERATE
+
+#define CANDIDATES 20000
+
+int main(void) {
+    static LayoutPoolBoat pool[LAYOUT_POOL_SIZE][FIELD_NUM_BOATS];
+    static int scores[LAYOUT_POOL_SIZE];
+    long total = 0;
+    int c, i, kept = 0;
+
+    srand(1);
+    for (c = 0; c < CANDIDATES; c++) {
+        LayoutPoolBoat boats[FIELD_NUM_BOATS], mirrored[FIELD_NUM_BOATS];
+        Field own, opp;
+        int score = 0, flips;
+        FieldInit(&own, &opp);
+        LayoutPoolPlaceRandomly(&own, boats);
+
+        // the attack, as placed and as each of its mirror images
+        for (flips = 0; flips < 4; flips++) {
+            for (i = 0; i < FIELD_NUM_BOATS; i++) {
+                mirrored[i] = boats[i];
+            }
+            LayoutPoolMirror(mirrored, flips & 1, flips & 2);
+            FieldInit(&own, &opp);
+            for (i = 0; i < FIELD_NUM_BOATS; i++) {
+                FieldAddBoat(&own, mirrored[i].row, mirrored[i].col, mirrored[i].dir, i);
+            }
+            score += LayoutPoolSurvival(&own, FieldAIDecideGuess);
+        }
+        total += score;
+
+        // kept in order, longest lasting first
+        if (kept < LAYOUT_POOL_SIZE) {
+            kept++;
+        } else if (score <= scores[kept - 1]) {
+            continue;
+        }
+        for (i = kept - 1; i > 0 && scores[i - 1] < score; i--) {
+            scores[i] = scores[i - 1];
+            for (flips = 0; flips < FIELD_NUM_BOATS; flips++) {
+                pool[i][flips] = pool[i - 1][flips];
+            }
+        }
+        scores[i] = score;
+        for (flips = 0; flips < FIELD_NUM_BOATS; flips++) {
+            pool[i][flips] = boats[flips];
+        }
+    }
+
+    printf("// %d candidates, %.2f shots on average, %.2f to %.2f kept\n", CANDIDATES,
+            total / 4.0 / CANDIDATES, scores[0] / 4.0, scores[kept - 1] / 4.0);
+    printf("static const uint8_t layoutPoolSizes[LAYOUT_POOL_NUM_BOATS] = {");
+    for (i = 0; i < FIELD_NUM_BOATS; i++) {
+        printf(i ? ", %d" : "%d", fieldBoatSizes[i]);
+    }
+    printf("};\nstatic const uint8_t layoutPool[LAYOUT_POOL_SIZE][LAYOUT_POOL_NUM_BOATS] = {\n");
+    for (c = 0; c < kept; c++) {
+        printf("    {");
+        for (i = 0; i < FIELD_NUM_BOATS; i++) {
+            printf(i ? ", 0x%02X" : "0x%02X", (pool[c][i].row * FIELD_COLS + pool[c][i].col) |
+                    (pool[c][i].dir == FIELD_DIR_EAST ? LAYOUT_POOL_EAST : 0));
+        }
+        printf("},\n");
+    }
+    printf("};\n");
+    return 0;
+}
+
+#endif
+
+#ifdef LAYOUT_POOL_BENCHMARK
+
+#include "PlacementSampler.h"
+
+#define GAMES 1000
+
+// an attacker the layouts were not picked against
+static GuessData SamplerAttack(const Field *opp_field) {
+    PlacementSamplerBegin(opp_field, 256);
+    PlacementSamplerStep(UINT16_MAX);
+    return PlacementSamplerResult();
+}
+
+int main(void) {
+    static const char *defenders[] = {"random", "pool", "pool, mutated"};
+    int defender, game;
+
+    printf("      defender    shots to sink, field AI    shots to sink, placement sampler\n");
+    for (defender = 0; defender < 3; defender++) {
+        long shots[2] = {0, 0};
+        int attacker;
+        for (attacker = 0; attacker < 2; attacker++) {
+            srand(1);
+            for (game = 0; game < GAMES; game++) {
+                LayoutPoolBoat boats[FIELD_NUM_BOATS];
+                Field own, opp;
+                FieldInit(&own, &opp);
+                if (defender == 0) {
+                    LayoutPoolPlaceRandomly(&own, boats);
+                } else {
+                    LayoutPoolPlace(&own, defender == 2);
+                }
+                shots[attacker] += LayoutPoolSurvival(&own, attacker ? SamplerAttack :
+                        FieldAIDecideGuess);
+            }
+        }
+        printf("%14s    %23.2f    %32.2f\n", defenders[defender], (double) shots[0] / GAMES,
+                (double) shots[1] / GAMES);
+    }
+    return 0;
+}
+
+#endif
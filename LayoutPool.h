@@ -0,0 +1,39 @@
+#ifndef LAYOUT_POOL_H
+#define LAYOUT_POOL_H
+
+#include <stdint.h>
+#include "Field.h"
+
+/**
+ * The layout pool holds boat layouts that take a density-based attacker longer than most to sink.
+ * Boats placed anywhere at random are found in about the time the attacker needs on average,
+ * but some layouts keep it searching the wrong squares for longer.  The pool is a table in flash
+ * of the layouts that lasted longest against the field AI's own attack, out of many drawn at
+ * random.
+ *
+ * A layout is scored by the mean number of shots the attack takes to sink it, over the layout and
+ * its mirror images, so mirroring a layout does not change its score.  At run time a layout is
+ * picked from the pool at random, mirrored at random, and one of its boats is moved a square if
+ * it fits there, so the same layout is seldom placed twice.
+ *
+ * The table is generated for the standard field and fleet, and the pool is left out for any
+ * other.  It is generated again, after a change to the field or the field AI, by compiling with
+ * the LAYOUT_POOL_GENERATE macro and pasting what it prints over the table.
+ * With gcc: `gcc <field AI sources> -DLAYOUT_POOL_GENERATE`, see Field.h
+ *
+ * How long the layouts survive against the field AI, and against the placement sampler, which
+ * they were not picked against, can be measured on x86 by compiling with the
+ * LAYOUT_POOL_BENCHMARK macro instead.
+ */
+
+/**
+ * LayoutPoolPlaceAllBoats() places every boat on a field in a layout from the pool.
+ * FieldAIPlaceAllBoats() uses it when there is a pool for the field.
+ *
+ * @param own_field The agent's own field, freshly initialized.
+ * @return SUCCESS if the boats were placed, STANDARD_ERROR if there is no pool for this field,
+ *         in which case the field is left as it was.
+ */
+uint8_t LayoutPoolPlaceAllBoats(Field *own_field);
+
+#endif // LAYOUT_POOL_H
@@ -0,0 +1,411 @@
+/*
+ * File:   LinkLayer.c
+ * Author: jwang456
+ *
+ * Purpose: Sequence numbers, acknowledgements and retransmission for BattleBoats messages
+ *
+ *
+ */
+#include "LinkLayer.h"
+
+#include <stdint.h>
+
+#include "BOARD.h"
+#include "BattleBoats.h"
+#include "Message.h"
+
+struct LinkLayer {
+    uint8_t enabled;
+    uint8_t nextSeq; // number of the next new message
+    uint8_t unacked; // number of the oldest unacknowledged message
+    uint8_t resend; // number of the next message to retransmit, nextSeq if there is none
+    uint8_t expected; // number of the next message we expect to receive
+    uint32_t sentAt; // when the oldest unacknowledged message was last sent
+    uint8_t ackPending;
+    uint32_t ackDue;
+    uint8_t nakPending;
+    uint8_t nakSent; // only one NAK is sent until the next message arrives in order
+    Message window[LINK_LAYER_WINDOW];
+    uint8_t handshakePending; // our CHA or ACC has not been answered yet
+    uint32_t handshakeSentAt;
+    Message handshake;
+};
+
+static struct LinkLayer link;
+
+#define SEQ_NEXT(seq) (((seq) + 1) % MESSAGE_SEQ_MODULUS)
+#define SEQ_DISTANCE(from, to) (((to) + MESSAGE_SEQ_MODULUS - (from)) % MESSAGE_SEQ_MODULUS)
+
+// events that come from a message, any others may have a stale link field
+static uint8_t LinkLayerIsMessage(BB_EventType type) {
+    switch (type) {
+    case BB_EVENT_CHA_RECEIVED:
+    case BB_EVENT_ACC_RECEIVED:
+    case BB_EVENT_REV_RECEIVED:
+    case BB_EVENT_SHO_RECEIVED:
+    case BB_EVENT_RES_RECEIVED:
+    case BB_EVENT_RSH_RECEIVED:
+    case BB_EVENT_SAL_RECEIVED:
+    case BB_EVENT_SRS_RECEIVED:
+    case BB_EVENT_ACK_RECEIVED:
+    case BB_EVENT_NAK_RECEIVED:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/**
+ * LinkLayerInit() disables the link layer and forgets everything in flight.
+ */
+void LinkLayerInit(void) {
+    LinkLayerEnable(FALSE);
+}
+
+/**
+ * LinkLayerEnable() turns the link layer on or off.  Turning it on starts numbering from 0, both
+ * agents do so once they have agreed on MESSAGE_CAPABILITY_RELIABLE.
+ *
+ * @param enable TRUE to turn the link layer on, FALSE to turn it off.
+ */
+void LinkLayerEnable(uint8_t enable) {
+    link.enabled = enable;
+    link.nextSeq = 0;
+    link.unacked = 0;
+    link.resend = 0;
+    link.expected = 0;
+    link.ackPending = FALSE;
+    link.nakPending = FALSE;
+    link.nakSent = FALSE;
+    link.handshakePending = FALSE;
+}
+
+/**
+ * @return TRUE if the link layer is on, FALSE otherwise.
+ */
+uint8_t LinkLayerIsEnabled(void) {
+    return link.enabled;
+}
+
+/**
+ * @return TRUE if the link layer has nothing in flight: no message of ours waiting for an
+ *         acknowledgement or an answer, and no ACK or NAK of its own to send.  Always TRUE if it
+ *         is off.
+ */
+uint8_t LinkLayerIsIdle(void) {
+    return !link.enabled || (link.unacked == link.nextSeq && !link.ackPending &&
+            !link.nakPending && !link.handshakePending);
+}
+
+/**
+ * LinkLayerSend() numbers a message the agent is about to send and keeps a copy of it until it
+ * is acknowledged.  A CHA or ACC is not numbered, it is kept until it is answered instead.  It
+ * does nothing if the link layer is off.
+ *
+ * @param message The message, its link field is filled in.
+ * @param now The current time in ticks.
+ * @return SUCCESS, or STANDARD_ERROR if LINK_LAYER_WINDOW messages are already waiting for an
+ *         acknowledgement, in which case the message is not numbered and must not be sent.
+ */
+uint8_t LinkLayerSend(Message *message, uint32_t now) {
+    if (!link.enabled) {
+        return SUCCESS;
+    }
+
+    // handshake messages go out unnumbered, and are repeated until they are answered
+    if (message->type == MESSAGE_CHA || message->type == MESSAGE_ACC) {
+        link.handshake = *message;
+        link.handshakePending = TRUE;
+        link.handshakeSentAt = now;
+        return SUCCESS;
+    }
+
+    // a full window would overwrite a message that has not been acknowledged yet
+    if (SEQ_DISTANCE(link.unacked, link.nextSeq) >= LINK_LAYER_WINDOW) {
+        return STANDARD_ERROR;
+    }
+
+    // the acknowledgement rides along, so no separate ACK is needed
+    message->link = MESSAGE_LINK(link.nextSeq, link.expected);
+    link.ackPending = FALSE;
+    link.window[link.nextSeq % LINK_LAYER_WINDOW] = *message;
+    if (link.unacked == link.nextSeq) {
+        link.sentAt = now;
+    }
+    // a message sent while retransmitting is retransmitted along with the others
+    if (link.resend == link.nextSeq) {
+        link.resend = SEQ_NEXT(link.nextSeq);
+    }
+    link.nextSeq = SEQ_NEXT(link.nextSeq);
+    return SUCCESS;
+}
+
+/**
+ * LinkLayerReceive() screens an event before it is passed to the agent.  ACKs, NAKs, duplicates,
+ * messages that arrived out of order and errors are handled here and dropped.  Events that did
+ * not come from a message are always passed on.
+ *
+ * @param event The event.
+ * @param now The current time in ticks.
+ * @return TRUE if the event should be passed on to the agent, FALSE if it should be dropped.
+ */
+uint8_t LinkLayerReceive(const BB_Event *event, uint32_t now) {
+    if (!link.enabled) {
+        return TRUE;
+    }
+
+    // something got corrupted, ask for everything unacknowledged again
+    if (event->type == BB_EVENT_ERROR) {
+        if (!link.nakSent) {
+            link.nakPending = TRUE;
+            link.nakSent = TRUE;
+        }
+        return FALSE;
+    }
+    if (!LinkLayerIsMessage(event->type)) {
+        return TRUE;
+    }
+
+    // the first CHA is passed on, and so is the ACC that answers ours.  A repeated CHA means our
+    // ACC was lost, and anything else unnumbered is a repeat we have already answered
+    if (!event->link) {
+        if (event->type == BB_EVENT_CHA_RECEIVED && !link.handshakePending &&
+                link.nextSeq == 0 && link.expected == 0) {
+            return TRUE;
+        }
+        if (link.handshakePending && link.handshake.type == MESSAGE_CHA &&
+                event->type == BB_EVENT_ACC_RECEIVED) {
+            link.handshakePending = FALSE;
+            return TRUE;
+        }
+        if (link.handshakePending && link.handshake.type == MESSAGE_ACC &&
+                event->type == BB_EVENT_CHA_RECEIVED) {
+            link.handshakeSentAt = now - LINK_LAYER_RETRANSMIT_TIMEOUT;
+        }
+        return FALSE;
+    }
+
+    // any numbered message but a NAK answers our ACC
+    if (event->type != BB_EVENT_NAK_RECEIVED) {
+        link.handshakePending = FALSE;
+    }
+
+    // everything before the acknowledged number has arrived, if it is one we are waiting on
+    uint8_t ack = MESSAGE_LINK_ACK(event->link);
+    uint8_t inFlight = SEQ_DISTANCE(link.unacked, link.nextSeq);
+    uint8_t acked = SEQ_DISTANCE(link.unacked, ack);
+    if (acked > 0 && acked <= inFlight) {
+        if (SEQ_DISTANCE(link.unacked, link.resend) < acked) {
+            link.resend = ack;
+        }
+        link.unacked = ack;
+        link.sentAt = now;
+    }
+
+    switch (event->type) {
+    case BB_EVENT_ACK_RECEIVED:
+        return FALSE;
+    case BB_EVENT_NAK_RECEIVED:
+        link.resend = link.unacked;
+        link.handshakeSentAt = now - LINK_LAYER_RETRANSMIT_TIMEOUT;
+        return FALSE;
+    default:
+        break;
+    }
+
+    // only the next message in order is passed on, anything else is acknowledged again right
+    // away so the sender knows where we are
+    if (MESSAGE_LINK_SEQ(event->link) != link.expected) {
+        link.ackPending = TRUE;
+        link.ackDue = now;
+        return FALSE;
+    }
+    link.expected = SEQ_NEXT(link.expected);
+    link.nakSent = FALSE;
+    if (!link.ackPending) {
+        link.ackPending = TRUE;
+        link.ackDue = now + LINK_LAYER_ACK_DELAY;
+    }
+    return TRUE;
+}
+
+/**
+ * LinkLayerPoll() picks the next message the link layer wants to send on its own: a NAK, a
+ * repeated CHA or ACC, a retransmission or an ACK, in that order.  It should be called whenever
+ * the transmitter is idle, and no MESSAGE_SENT event should be generated for the messages it
+ * returns.
+ *
+ * @param message Filled with the message to send, if there is one.
+ * @param now The current time in ticks.
+ * @return TRUE if there is a message to send, FALSE otherwise.
+ */
+uint8_t LinkLayerPoll(Message *message, uint32_t now) {
+    if (!link.enabled) {
+        return FALSE;
+    }
+
+    if (link.nakPending) {
+        link.nakPending = FALSE;
+        message->type = MESSAGE_NAK;
+        message->link = MESSAGE_LINK(link.nextSeq, link.expected);
+        return TRUE;
+    }
+
+    if (link.handshakePending &&
+            (int32_t) (now - link.handshakeSentAt) >= LINK_LAYER_RETRANSMIT_TIMEOUT) {
+        link.handshakeSentAt = now;
+        *message = link.handshake;
+        return TRUE;
+    }
+
+    // go back to the oldest unacknowledged message once it has timed out
+    if (link.unacked != link.nextSeq && link.resend == link.nextSeq &&
+            (int32_t) (now - link.sentAt) >= LINK_LAYER_RETRANSMIT_TIMEOUT) {
+        link.resend = link.unacked;
+    }
+    if (link.resend != link.nextSeq) {
+        *message = link.window[link.resend % LINK_LAYER_WINDOW];
+        message->link = MESSAGE_LINK(link.resend, link.expected);
+        if (link.resend == link.unacked) {
+            link.sentAt = now;
+        }
+        link.resend = SEQ_NEXT(link.resend);
+        link.ackPending = FALSE;
+        return TRUE;
+    }
+
+    if (link.ackPending && (int32_t) (now - link.ackDue) >= 0) {
+        link.ackPending = FALSE;
+        message->type = MESSAGE_ACK;
+        message->link = MESSAGE_LINK(link.nextSeq, link.expected);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+#ifdef UNIT_TEST_LINK_LAYER
+
+#include <stdio.h>
+#include <assert.h>
+#include "Field.h"
+
+// passes a message from one side to the other the way Message_Decode() would present it
+static BB_Event Deliver(const Message *message) {
+    char frame[MESSAGE_MAX_LEN + 1];
+    BB_Event event;
+    int i, length = Message_Encode(frame, *message);
+    for (i = 0; i < length; i++) {
+        Message_Decode(frame[i], &event);
+    }
+    return event;
+}
+
+int main(void) {
+    Message shot = {.type = MESSAGE_SHO, .param0 = 2, .param1 = 9};
+    Message result = {.type = MESSAGE_RES, .param0 = 2, .param1 = 9, .param2 = RESULT_MISS};
+    Message frame;
+    BB_Event event;
+
+    printf("Running unit tests.\n");
+
+    // messages are only numbered once enabled, and never during the handshake
+    LinkLayerInit();
+    LinkLayerSend(&shot, 0);
+    assert(shot.link == 0);
+    LinkLayerEnable(TRUE);
+    Message challenge = {.type = MESSAGE_CHA, .param0 = 1};
+    LinkLayerSend(&challenge, 0);
+    assert(challenge.link == 0);
+    assert(!LinkLayerPoll(&frame, LINK_LAYER_RETRANSMIT_TIMEOUT - 1));
+
+    // the challenge is repeated until it is answered, repeats of it are dropped by the accepter
+    assert(LinkLayerPoll(&frame, LINK_LAYER_RETRANSMIT_TIMEOUT));
+    assert(frame.type == MESSAGE_CHA && frame.link == 0);
+    event = Deliver(&challenge);
+    assert(!LinkLayerReceive(&event, LINK_LAYER_RETRANSMIT_TIMEOUT));
+    Message accept = {.type = MESSAGE_ACC, .param0 = 5};
+    event = Deliver(&accept);
+    assert(LinkLayerReceive(&event, LINK_LAYER_RETRANSMIT_TIMEOUT));
+    assert(!LinkLayerReceive(&event, LINK_LAYER_RETRANSMIT_TIMEOUT));
+    assert(!LinkLayerPoll(&frame, 2 * LINK_LAYER_RETRANSMIT_TIMEOUT));
+
+    // an accepter passes the first challenge on, and errors before it are NAKed
+    LinkLayerEnable(TRUE);
+    event.type = BB_EVENT_ERROR;
+    assert(!LinkLayerReceive(&event, 0));
+    assert(LinkLayerPoll(&frame, 0) && frame.type == MESSAGE_NAK);
+    event = Deliver(&challenge);
+    assert(LinkLayerReceive(&event, 0));
+    LinkLayerEnable(TRUE);
+    LinkLayerSend(&accept, 0);
+
+    // a repeated challenge means our accept was lost
+    assert(!LinkLayerReceive(&event, 10));
+    assert(LinkLayerPoll(&frame, 10) && frame.type == MESSAGE_ACC);
+    assert(!LinkLayerPoll(&frame, 10));
+    LinkLayerEnable(TRUE);
+
+    // a message is retransmitted once it times out, and not before
+    LinkLayerSend(&shot, 0);
+    assert(shot.link == MESSAGE_LINK(0, 0));
+    assert(!LinkLayerPoll(&frame, LINK_LAYER_RETRANSMIT_TIMEOUT - 1));
+    assert(LinkLayerPoll(&frame, LINK_LAYER_RETRANSMIT_TIMEOUT));
+    assert(frame.type == MESSAGE_SHO && frame.param1 == 9 && frame.link == MESSAGE_LINK(0, 0));
+    assert(!LinkLayerPoll(&frame, LINK_LAYER_RETRANSMIT_TIMEOUT));
+
+    // a reply acknowledges it, and is acknowledged on its own after a delay
+    result.link = MESSAGE_LINK(0, 1);
+    event = Deliver(&result);
+    assert(event.type == BB_EVENT_RES_RECEIVED && event.link == result.link);
+    assert(LinkLayerReceive(&event, 1000));
+    assert(!LinkLayerPoll(&frame, 1000 + LINK_LAYER_ACK_DELAY - 1));
+    assert(LinkLayerPoll(&frame, 1000 + LINK_LAYER_ACK_DELAY));
+    assert(frame.type == MESSAGE_ACK && MESSAGE_LINK_ACK(frame.link) == 1);
+    assert(!LinkLayerPoll(&frame, 1000 + LINK_LAYER_RETRANSMIT_TIMEOUT));
+
+    // duplicates are dropped and acknowledged again right away
+    assert(!LinkLayerReceive(&event, 2000));
+    assert(LinkLayerPoll(&frame, 2000) && frame.type == MESSAGE_ACK);
+
+    // an error is answered with one NAK, and a NAK sends everything unacknowledged again
+    event.type = BB_EVENT_ERROR;
+    assert(!LinkLayerReceive(&event, 3000));
+    assert(!LinkLayerReceive(&event, 3000));
+    assert(LinkLayerPoll(&frame, 3000) && frame.type == MESSAGE_NAK);
+    assert(!LinkLayerPoll(&frame, 3000));
+    LinkLayerSend(&result, 3000);
+    LinkLayerSend(&shot, 3000);
+    frame.type = MESSAGE_NAK;
+    frame.link = MESSAGE_LINK(1, 1);
+    event = Deliver(&frame);
+    assert(event.type == BB_EVENT_NAK_RECEIVED);
+    assert(!LinkLayerReceive(&event, 3010));
+    assert(LinkLayerPoll(&frame, 3010) && frame.type == MESSAGE_RES);
+    assert(LinkLayerPoll(&frame, 3010) && frame.type == MESSAGE_SHO);
+    assert(!LinkLayerPoll(&frame, 3010));
+
+    // a cumulative acknowledgement covers both
+    frame.type = MESSAGE_ACK;
+    frame.link = MESSAGE_LINK(1, 3);
+    event = Deliver(&frame);
+    assert(!LinkLayerReceive(&event, 3020));
+    assert(!LinkLayerPoll(&frame, 3020 + 2 * LINK_LAYER_RETRANSMIT_TIMEOUT));
+
+    // events that are not messages always get through, even if the link field is left over
+    event.type = BB_EVENT_MESSAGE_SENT;
+    assert(LinkLayerReceive(&event, 4000));
+
+    // a full window refuses a message rather than overwrite one not yet acknowledged
+    int i;
+    for (i = 0; i < LINK_LAYER_WINDOW; i++) {
+        assert(LinkLayerSend(&shot, 5000) == SUCCESS);
+    }
+    assert(LinkLayerSend(&result, 5000) == STANDARD_ERROR);
+    assert(LinkLayerPoll(&frame, 5000 + LINK_LAYER_RETRANSMIT_TIMEOUT));
+    assert(frame.type == MESSAGE_SHO);
+
+    printf("All tests passed.\n");
+    return 0;
+}
+
+#endif
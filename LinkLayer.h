@@ -0,0 +1,115 @@
+#ifndef LINK_LAYER_H
+#define LINK_LAYER_H
+
+#include <stdint.h>
+#include "BattleBoats.h"
+#include "Message.h"
+
+/**
+ * The link layer sits between the agent and Message_Encode()/Message_Decode() once both agents
+ * have agreed on MESSAGE_CAPABILITY_RELIABLE.  It numbers outgoing messages, retransmits them
+ * until they are acknowledged, drops duplicates and messages that arrive out of order, and turns
+ * corrupted messages into a NAK instead of passing the error on to the agent.
+ *
+ * It is a go-back-N protocol: acknowledgements are cumulative and ride along on every message
+ * (see MESSAGE_LINK()), and a separate ACK is only sent if nothing else goes out in time.
+ *
+ * CHA and ACC messages are never numbered, as the other agent may not support the link layer.
+ * An agent that offers MESSAGE_CAPABILITY_RELIABLE turns the link layer on before the handshake,
+ * so that errors are NAKed instead of ending the game, and its CHA or ACC is repeated until it
+ * is answered.  A legacy opponent never sees any of this unless something was lost already.
+ *
+ * The link layer does no I/O itself.  Every message the agent sends is passed through
+ * LinkLayerSend() before it is encoded, every event decoded from the UART is passed through
+ * LinkLayerReceive() before it reaches the agent, and LinkLayerPoll() is called whenever the
+ * transmitter is idle to pick up ACKs, NAKs and retransmissions.  Time is given in the caller's
+ * ticks, see LINK_LAYER_RETRANSMIT_TIMEOUT.
+ *
+ * Unit testing can be done on x86 by compiling with the UNIT_TEST_LINK_LAYER macro.
+ * With gcc: `gcc LinkLayer.c Message.c -DUNIT_TEST_LINK_LAYER`
+ */
+
+/**
+ * The most messages that can be waiting for an acknowledgement.  The agent never has more than
+ * two in flight (a result followed by a shot), and this has to be less than MESSAGE_SEQ_MODULUS.
+ */
+#define LINK_LAYER_WINDOW 4
+
+/**
+ * How long to wait for an acknowledgement before sending everything unacknowledged again, in
+ * ticks of 10ms.  This has to cover a message and its reply at the throttled rate.
+ */
+#ifndef LINK_LAYER_RETRANSMIT_TIMEOUT
+#define LINK_LAYER_RETRANSMIT_TIMEOUT 500
+#endif
+
+/**
+ * How long to wait for a message of our own to carry an acknowledgement before sending a
+ * separate ACK, in ticks of 10ms.  This has to cover the gap between a result and the shot that
+ * follows it, so that both are acknowledged by our reply to the shot.
+ */
+#ifndef LINK_LAYER_ACK_DELAY
+#define LINK_LAYER_ACK_DELAY 200
+#endif
+
+/**
+ * LinkLayerInit() disables the link layer and forgets everything in flight.
+ */
+void LinkLayerInit(void);
+
+/**
+ * LinkLayerEnable() turns the link layer on or off.  Turning it on starts numbering from 0, both
+ * agents do so once they have agreed on MESSAGE_CAPABILITY_RELIABLE.
+ *
+ * @param enable TRUE to turn the link layer on, FALSE to turn it off.
+ */
+void LinkLayerEnable(uint8_t enable);
+
+/**
+ * @return TRUE if the link layer is on, FALSE otherwise.
+ */
+uint8_t LinkLayerIsEnabled(void);
+
+/**
+ * @return TRUE if the link layer has nothing in flight: no message of ours waiting for an
+ *         acknowledgement or an answer, and no ACK or NAK of its own to send.  Always TRUE if it
+ *         is off.
+ */
+uint8_t LinkLayerIsIdle(void);
+
+/**
+ * LinkLayerSend() numbers a message the agent is about to send and keeps a copy of it until it
+ * is acknowledged.  A CHA or ACC is not numbered, it is kept until it is answered instead.  It
+ * does nothing if the link layer is off.
+ *
+ * @param message The message, its link field is filled in.
+ * @param now The current time in ticks.
+ * @return SUCCESS, or STANDARD_ERROR if LINK_LAYER_WINDOW messages are already waiting for an
+ *         acknowledgement, in which case the message is not numbered and must not be sent.
+ */
+uint8_t LinkLayerSend(Message *message, uint32_t now);
+
+/**
+ * LinkLayerReceive() screens an event before it is passed to the agent.  ACKs, NAKs, duplicates,
+ * messages that arrived out of order and errors are handled here and dropped.  Events that did
+ * not come from a message are always passed on.
+ *
+ * @param event The event.
+ * @param now The current time in ticks.
+ * @return TRUE if the event should be passed on to the agent, FALSE if it should be dropped.
+ */
+uint8_t LinkLayerReceive(const BB_Event *event, uint32_t now);
+
+/**
+ * LinkLayerPoll() picks the next message the link layer wants to send on its own: a NAK, a
+ * repeated CHA or ACC, a retransmission or an ACK, in that order.  It should be called whenever
+ * the transmitter is idle, and no MESSAGE_SENT event should be generated for the messages it
+ * returns.
+ *
+ * @param message Filled with the message to send, if there is one.
+ * @param now The current time in ticks.
+ * @return TRUE if there is a message to send, FALSE otherwise.
+ */
+uint8_t LinkLayerPoll(Message *message, uint32_t now);
+
+#endif // LINK_LAYER_H
@@ -0,0 +1,101 @@
+/*
+ * File:   LinkStats.c
+ * Author: jwang456
+ *
+ * Purpose: Counters on the health of the UART link
+ *
+ *
+ */
+#include "LinkStats.h"
+
+#include <stdint.h>
+
+#include "BOARD.h"
+#include "BattleBoats.h"
+
+static volatile uint32_t counters[LINK_STATS_NUM_COUNTERS];
+
+static const char *counterNames[LINK_STATS_NUM_COUNTERS] = {
+    [LINK_STATS_BYTES_IN] = "bytes in",
+    [LINK_STATS_BYTES_OUT] = "bytes out",
+    [LINK_STATS_FRAMES_DECODED] = "frames decoded",
+    [LINK_STATS_BAD_CHECKSUM] = "bad checksum",
+    [LINK_STATS_PAYLOAD_LEN_EXCEEDED] = "payload too long",
+    [LINK_STATS_CHECKSUM_LEN_EXCEEDED] = "checksum too long",
+    [LINK_STATS_CHECKSUM_LEN_INSUFFICIENT] = "checksum too short",
+    [LINK_STATS_INVALID_MESSAGE_TYPE] = "invalid message type",
+    [LINK_STATS_MESSAGE_PARSE_FAILURE] = "parse failure",
+    [LINK_STATS_RX_OVERFLOWS] = "RX ring overflows",
+    [LINK_STATS_TX_OVERFLOWS] = "TX ring overflows",
+    [LINK_STATS_UART_OVERRUNS] = "UART overruns",
+    [LINK_STATS_RATE_FALLBACKS] = "rate fallbacks",
+    [LINK_STATS_RX_PEAK] = "RX ring peak",
+    [LINK_STATS_TX_PEAK] = "TX ring peak",
+};
+
+/**
+ * LinkStatsInit() sets every counter to 0.  It should only be called once, on startup.
+ */
+void LinkStatsInit(void) {
+    int i;
+    for (i = 0; i < LINK_STATS_NUM_COUNTERS; i++) {
+        counters[i] = 0;
+    }
+}
+
+/**
+ * LinkStatsCount() adds to a counter.
+ *
+ * @param counter The counter.
+ * @param amount How much to add.
+ */
+void LinkStatsCount(LinkStatsCounter counter, uint32_t amount) {
+    counters[counter] += amount;
+}
+
+/**
+ * LinkStatsRecordPeak() raises a peak counter, such as LINK_STATS_RX_PEAK, to a level if it
+ * is below it.
+ *
+ * @param counter The counter.
+ * @param level The level just seen.
+ */
+void LinkStatsRecordPeak(LinkStatsCounter counter, uint32_t level) {
+    if (level > counters[counter]) {
+        counters[counter] = level;
+    }
+}
+
+/**
+ * LinkStatsCountDecode() counts the event Message_Decode() just produced: a decoded frame, an
+ * error of its kind, or nothing if the message is not complete yet.
+ *
+ * @param event The event filled in by Message_Decode().
+ */
+void LinkStatsCountDecode(const BB_Event *event) {
+    if (event->type == BB_EVENT_NO_EVENT) {
+        return;
+    }
+    if (event->type != BB_EVENT_ERROR) {
+        counters[LINK_STATS_FRAMES_DECODED]++;
+    } else if (event->param0 >= BB_ERROR_BAD_CHECKSUM &&
+            event->param0 <= BB_ERROR_MESSAGE_PARSE_FAILURE) {
+        counters[LINK_STATS_BAD_CHECKSUM + event->param0 - BB_ERROR_BAD_CHECKSUM]++;
+    }
+}
+
+/**
+ * @param counter The counter.
+ * @return The counter's value.
+ */
+uint32_t LinkStatsGet(LinkStatsCounter counter) {
+    return counters[counter];
+}
+
+/**
+ * @param counter The counter.
+ * @return A short name for the counter, for printing.
+ */
+const char *LinkStatsName(LinkStatsCounter counter) {
+    return counterNames[counter];
+}
@@ -0,0 +1,81 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <stdint.h>
+#include "BattleBoats.h"
+
+/**
+ * LinkStats keeps counters on the health of the UART link: traffic, decode results by kind of
+ * error, and how close the UART ring buffers have come to overflowing.  Counters are 32 bits and
+ * only ever go up, so they can be sampled at any time and compared with an earlier sample.
+ *
+ * No locking is done.  The receive side is only counted from the UART interrupt, and the rest
+ * from wherever messages are sent and decoded, so a count can only be lost if trace output is
+ * written while the timer interrupt is sending.
+ */
+
+/**
+ * The counters kept.  The decode errors are in the same order as BB_Error.
+ */
+typedef enum {
+    LINK_STATS_BYTES_IN,
+    LINK_STATS_BYTES_OUT,
+    LINK_STATS_FRAMES_DECODED,
+    LINK_STATS_BAD_CHECKSUM,
+    LINK_STATS_PAYLOAD_LEN_EXCEEDED,
+    LINK_STATS_CHECKSUM_LEN_EXCEEDED,
+    LINK_STATS_CHECKSUM_LEN_INSUFFICIENT,
+    LINK_STATS_INVALID_MESSAGE_TYPE,
+    LINK_STATS_MESSAGE_PARSE_FAILURE,
+    LINK_STATS_RX_OVERFLOWS, //bytes dropped because the RX ring was full
+    LINK_STATS_TX_OVERFLOWS, //bytes dropped because the TX ring was full
+    LINK_STATS_UART_OVERRUNS, //times the UART's own receive FIFO overran
+    LINK_STATS_RATE_FALLBACKS, //times an upgraded link fell back to the default rate
+    LINK_STATS_RX_PEAK, //most bytes ever waiting in the RX ring
+    LINK_STATS_TX_PEAK, //most bytes ever waiting in the TX ring
+    LINK_STATS_NUM_COUNTERS
+} LinkStatsCounter;
+
+/**
+ * LinkStatsInit() sets every counter to 0.  It should only be called once, on startup.
+ */
+void LinkStatsInit(void);
+
+/**
+ * LinkStatsCount() adds to a counter.
+ *
+ * @param counter The counter.
+ * @param amount How much to add.
+ */
+void LinkStatsCount(LinkStatsCounter counter, uint32_t amount);
+
+/**
+ * LinkStatsRecordPeak() raises a peak counter, such as LINK_STATS_RX_PEAK, to a level if it
+ * is below it.
+ *
+ * @param counter The counter.
+ * @param level The level just seen.
+ */
+void LinkStatsRecordPeak(LinkStatsCounter counter, uint32_t level);
+
+/**
+ * LinkStatsCountDecode() counts the event Message_Decode() just produced: a decoded frame, an
+ * error of its kind, or nothing if the message is not complete yet.
+ *
+ * @param event The event filled in by Message_Decode().
+ */
+void LinkStatsCountDecode(const BB_Event *event);
+
+/**
+ * @param counter The counter.
+ * @return The counter's value.
+ */
+uint32_t LinkStatsGet(LinkStatsCounter counter);
+
+/**
+ * @param counter The counter.
+ * @return A short name for the counter, for printing.
+ */
+const char *LinkStatsName(LinkStatsCounter counter);
+
+#endif // LINK_STATS_H
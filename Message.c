@@ -23,17 +23,57 @@ typedef enum {
 #define Hex2Bin "0123456789ABCDEF"
 #define START_DELIM '$'
 #define CHECKSUM_DELIM '*'
+#define CRC_DELIM '#'
 #define LAST_DELIM '\n'
 #define BOUND1 65
 #define BOUND2 57
 #define BOUND3 48
 #define BOUND4 70
-#define checklength 2
 
 static DecodingState decodeState = WAITING;
 static char decPayload[MESSAGE_MAX_PAYLOAD_LEN];
-static char checkSumString[3];
+static char checkSumString[MESSAGE_CRC_LEN + 1];
+static int checklength = MESSAGE_CHECKSUM_LEN;
 static int counter = 0;
+static uint8_t useCrc = FALSE;
+static uint8_t useResync = FALSE;
+static uint32_t discardedBytes = 0;
+
+// CRC-16/CCITT-FALSE lookup table, indexed by the top byte of the CRC xor the next character
+static const uint16_t crcTable[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
 
 /**
  * Given a payload string, calculate its checksum
@@ -52,6 +92,46 @@ uint8_t Message_CalculateChecksum(const char* payload) {
     return result;
 }
 
+/**
+ * Given a payload string, calculate its CRC-16 (see MESSAGE_TEMPLATE_CRC)
+ * 
+ * @param payload       //the string whose CRC we wish to calculate
+ * @return   //The resulting 16-bit CRC
+ */
+uint16_t Message_CalculateCrc(const char* payload) {
+    uint16_t crc = 0xFFFF;
+    // one table lookup per character
+    while (*payload) {
+        crc = (crc << 8) ^ crcTable[(crc >> 8) ^ (uint8_t) *payload];
+        payload++;
+    }
+    return crc;
+}
+
+/**
+ * Selects the framing Message_Encode() uses.  The XOR checksum is used until this is called.
+ * 
+ * @param use_crc       //TRUE to frame messages with a CRC-16, FALSE for the XOR checksum
+ */
+void Message_UseCrc(uint8_t use_crc) {
+    useCrc = use_crc;
+}
+
+// wraps a payload in the link layer talker, start delimiter, frame check and end delimiter
+static void Message_Frame(char *message_string, const char *payload, uint8_t link) {
+    char talkerPayload[MESSAGE_MAX_PAYLOAD_LEN + 1];
+    if (link) {
+        sprintf(talkerPayload, PAYLOAD_TEMPLATE_LINK, MESSAGE_LINK_SEQ(link), MESSAGE_LINK_ACK(link));
+        strcat(talkerPayload, payload);
+        payload = talkerPayload;
+    }
+    if (useCrc) {
+        sprintf(message_string, MESSAGE_TEMPLATE_CRC, payload, Message_CalculateCrc(payload));
+    } else {
+        sprintf(message_string, MESSAGE_TEMPLATE, payload, Message_CalculateChecksum(payload));
+    }
+}
+
 /**
  * ParseMessage() converts a message string into a BB_Event.  The payload and
  * checksum of a message are passed into ParseMessage(), and it modifies a
@@ -59,7 +139,8 @@ uint8_t Message_CalculateChecksum(const char* payload) {
  * 
  * @param payload       //the payload of a message
  * @param checksum      //the checksum (in string form) of  a message,
- *                          should be exactly 2 chars long, plus a null char
+ *                          should be exactly 2 chars long, plus a null char,
+ *                          or 4 chars long for a CRC-16
  * @param message_event //A BB_Event which will be modified by this function.
  *                      //If the message could be parsed successfully,
  *                          message_event's type will correspond to the message type and 
@@ -69,7 +150,7 @@ uint8_t Message_CalculateChecksum(const char* payload) {
  * 
  * @return STANDARD_ERROR if:
  *              the payload does not match the checksum
- *              the checksum string is not two characters long
+ *              the checksum string is not two or four characters long
  *              the message does not match any message template
  *          SUCCESS otherwise
  * 
@@ -84,45 +165,87 @@ int Message_ParseMessage(const char* payload,
     message_event->param0 = 0;
     message_event->param1 = 0;
     message_event->param2 = 0;
+    message_event->param3 = 0;
+    message_event->param4 = 0;
+    message_event->link = 0;
     
     char payCopy[MESSAGE_MAX_PAYLOAD_LEN];
     strcpy(payCopy, payload);
     
-    // the checksum string has to be length 2, if it is not we have an error
-    if (strlen(checksum_string) != 2) {
+    // the checksum string has to be length 2, or 4 for a CRC, if it is not we have an error
+    // converts the checksum string to its correct values and checks it against the payload
+    uint16_t totconv = strtoul(checksum_string, NULL, 16);
+    if (strlen(checksum_string) == MESSAGE_CHECKSUM_LEN) {
+        if (Message_CalculateChecksum(payload) != totconv) {
+            message_event->type = BB_EVENT_ERROR;
+            return STANDARD_ERROR;
+        }
+    } else if (strlen(checksum_string) == MESSAGE_CRC_LEN) {
+        if (Message_CalculateCrc(payload) != totconv) {
+            message_event->type = BB_EVENT_ERROR;
+            return STANDARD_ERROR;
+        }
+    } else {
         message_event->type = BB_EVENT_ERROR;
         return STANDARD_ERROR;
     }
     
-    // converts the checksum string to its correct values
-    uint8_t totconv = strtoul(checksum_string, NULL, 16);
-    
-    if (Message_CalculateChecksum(payload) != totconv) {
+    //a link layer talker may come before the message type
+    char *token;
+    if (payload[0] >= '0' && payload[0] < '0' + MESSAGE_SEQ_MODULUS &&
+            payload[1] >= '0' && payload[1] < '0' + MESSAGE_SEQ_MODULUS) {
+        message_event->link = MESSAGE_LINK(payload[0] - '0', payload[1] - '0');
+        token = strtok(payCopy + 2, ",");
+    } else {
+        //takes the string at each comma
+        token = strtok(payCopy, ",");
+    }
+    if (token == NULL) {
         message_event->type = BB_EVENT_ERROR;
         return STANDARD_ERROR;
     }
     
-    //takes the string at each comma
-    char *token = strtok(payCopy, ",");
-    
     // we check to see what the first string taken was if it is incorrect we return error
     // expected tokens counts for how many tokens are expected depending on the first string
+    // optional tokens may follow them, CHA and ACC can carry capabilities and a BRG value,
+    // and the halves of a strong commitment or of a 32-bit B and A
     int expected_tokens;
+    int optional_tokens = 0;
     if (strcmp(token, "CHA") == 0) {
         expected_tokens = 1;
+        optional_tokens = 4;
         message_event->type = BB_EVENT_CHA_RECEIVED;
     } else if (strcmp(token, "ACC") == 0) {
         expected_tokens = 1;
+        optional_tokens = 3;
         message_event->type = BB_EVENT_ACC_RECEIVED;
     } else if (strcmp(token, "SHO") == 0) {
         expected_tokens = 2;
         message_event->type = BB_EVENT_SHO_RECEIVED;
     } else if (strcmp(token, "REV") == 0) {
         expected_tokens = 1;
+        optional_tokens = 1;
         message_event->type = BB_EVENT_REV_RECEIVED;
     } else if (strcmp(token, "RES") == 0) {
         expected_tokens = 3;
         message_event->type = BB_EVENT_RES_RECEIVED;
+    } else if (strcmp(token, "RSH") == 0) {
+        expected_tokens = 5;
+        message_event->type = BB_EVENT_RSH_RECEIVED;
+    } else if (strcmp(token, "SAL") == 0) {
+        expected_tokens = 2;
+        optional_tokens = MESSAGE_SALVO_MAX - 1;
+        message_event->type = BB_EVENT_SAL_RECEIVED;
+    } else if (strcmp(token, "SRS") == 0) {
+        expected_tokens = 2;
+        optional_tokens = MESSAGE_SALVO_MAX - 1;
+        message_event->type = BB_EVENT_SRS_RECEIVED;
+    } else if (strcmp(token, "ACK") == 0 && message_event->link) {
+        expected_tokens = 0;
+        message_event->type = BB_EVENT_ACK_RECEIVED;
+    } else if (strcmp(token, "NAK") == 0 && message_event->link) {
+        expected_tokens = 0;
+        message_event->type = BB_EVENT_NAK_RECEIVED;
     } else {
         message_event->type = BB_EVENT_ERROR;
         return STANDARD_ERROR;
@@ -130,10 +253,12 @@ int Message_ParseMessage(const char* payload,
     
     // we take the next token for as many expected tokens there are
     int iter;
-    for (iter = 0; iter < expected_tokens; iter++) {
+    for (iter = 0; iter < expected_tokens + optional_tokens; iter++) {
         token = strtok(NULL, ",");
         
-        if (token == NULL) {
+        if (token == NULL && iter >= expected_tokens) {
+            break;
+        } else if (token == NULL) {
             message_event->type = BB_EVENT_ERROR;
             return STANDARD_ERROR;
         }
@@ -146,6 +271,10 @@ int Message_ParseMessage(const char* payload,
             message_event->param1 = p;
         } else if (iter == 2) {
             message_event->param2 = p;
+        } else if (iter == 3) {
+            message_event->param3 = p;
+        } else if (iter == 4) {
+            message_event->param4 = p;
         }
     }
     
@@ -156,6 +285,13 @@ int Message_ParseMessage(const char* payload,
         return STANDARD_ERROR;
     }
     
+    // salvos have to carry exactly as many fields as they say
+    if ((message_event->type == BB_EVENT_SAL_RECEIVED || message_event->type == BB_EVENT_SRS_RECEIVED)
+            && message_event->param0 != iter - 1) {
+        message_event->type = BB_EVENT_ERROR;
+        return STANDARD_ERROR;
+    }
+    
     // everything worked well, success
     return SUCCESS;
     
@@ -181,43 +317,94 @@ int Message_ParseMessage(const char* payload,
 int Message_Encode(char *message_string, Message message_to_encode) {
     char toMessageTemplate[MESSAGE_MAX_PAYLOAD_LEN];
     char finalMessage[MESSAGE_MAX_LEN];
-    uint8_t checksum;
     
     // we check for the type of the message
     // based on what message it is, we format the string with the correct number of params
-    // we also calculate the checksum and add it in
+    // we also calculate the checksum or CRC and add it in
     switch (message_to_encode.type) {
         case MESSAGE_NONE:
             return 0;
             break;
         case MESSAGE_ACC:
-            sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_ACC, message_to_encode.param0);
-            checksum = Message_CalculateChecksum(toMessageTemplate);
-            sprintf(finalMessage, MESSAGE_TEMPLATE, toMessageTemplate, checksum);
+            if (message_to_encode.param1 & MESSAGE_CAPABILITY_STRONG_COMMIT) {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_ACC_COMMIT, message_to_encode.param0,
+                        message_to_encode.param1, message_to_encode.param2,
+                        message_to_encode.param3);
+            } else if (message_to_encode.param1 & MESSAGE_CAPABILITY_FAST_LINK) {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_ACC_LINK, message_to_encode.param0,
+                        message_to_encode.param1, message_to_encode.param2);
+            } else if (message_to_encode.param1) {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_ACC_CAPS, message_to_encode.param0,
+                        message_to_encode.param1);
+            } else {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_ACC, message_to_encode.param0);
+            }
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
             strcpy(message_string, finalMessage);
             break;
         case MESSAGE_CHA:
-            sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_CHA, message_to_encode.param0);
-            checksum = Message_CalculateChecksum(toMessageTemplate);
-            sprintf(finalMessage, MESSAGE_TEMPLATE, toMessageTemplate, checksum);
+            if (message_to_encode.param1 & MESSAGE_CAPABILITY_STRONG_COMMIT) {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_CHA_COMMIT, message_to_encode.param0,
+                        message_to_encode.param1, message_to_encode.param2,
+                        message_to_encode.param3, message_to_encode.param4);
+            } else if (message_to_encode.param1 & MESSAGE_CAPABILITY_FAST_LINK) {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_CHA_LINK, message_to_encode.param0,
+                        message_to_encode.param1, message_to_encode.param2);
+            } else if (message_to_encode.param1) {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_CHA_CAPS, message_to_encode.param0,
+                        message_to_encode.param1);
+            } else {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_CHA, message_to_encode.param0);
+            }
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
             strcpy(message_string, finalMessage);
             break;
         case MESSAGE_SHO:
             sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_SHO, message_to_encode.param0, message_to_encode.param1);
-            checksum = Message_CalculateChecksum(toMessageTemplate);
-            sprintf(finalMessage, MESSAGE_TEMPLATE, toMessageTemplate, checksum);
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
             strcpy(message_string, finalMessage);
             break;
         case MESSAGE_REV:
-            sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_REV, message_to_encode.param0);
-            checksum = Message_CalculateChecksum(toMessageTemplate);
-            sprintf(finalMessage, MESSAGE_TEMPLATE, toMessageTemplate, checksum);
+            if (message_to_encode.param1) {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_REV_COMMIT, message_to_encode.param0,
+                        message_to_encode.param1);
+            } else {
+                sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_REV, message_to_encode.param0);
+            }
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
             strcpy(message_string, finalMessage);
             break;
         case MESSAGE_RES:
             sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_RES, message_to_encode.param0, message_to_encode.param1, message_to_encode.param2);
-            checksum = Message_CalculateChecksum(toMessageTemplate);
-            sprintf(finalMessage, MESSAGE_TEMPLATE, toMessageTemplate, checksum);
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
+            strcpy(message_string, finalMessage);
+            break;
+        case MESSAGE_RSH:
+            sprintf(toMessageTemplate, PAYLOAD_TEMPLATE_RSH, message_to_encode.param0, message_to_encode.param1,
+                    message_to_encode.param2, message_to_encode.param3, message_to_encode.param4);
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
+            strcpy(message_string, finalMessage);
+            break;
+        case MESSAGE_SAL:
+        case MESSAGE_SRS: {
+            sprintf(toMessageTemplate, message_to_encode.type == MESSAGE_SAL ?
+                    PAYLOAD_TEMPLATE_SAL : PAYLOAD_TEMPLATE_SRS, message_to_encode.param0);
+            unsigned int fields[] = {message_to_encode.param1, message_to_encode.param2,
+                message_to_encode.param3, message_to_encode.param4};
+            int field;
+            for (field = 0; field < message_to_encode.param0 && field < MESSAGE_SALVO_MAX; field++) {
+                sprintf(toMessageTemplate + strlen(toMessageTemplate), PAYLOAD_TEMPLATE_SALVO_FIELD,
+                        fields[field]);
+            }
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
+            strcpy(message_string, finalMessage);
+            break;
+        }
+        case MESSAGE_ACK:
+        case MESSAGE_NAK:
+            strcpy(toMessageTemplate, message_to_encode.type == MESSAGE_ACK ?
+                    PAYLOAD_TEMPLATE_ACK : PAYLOAD_TEMPLATE_NAK);
+            Message_Frame(finalMessage, toMessageTemplate, message_to_encode.link);
             strcpy(message_string, finalMessage);
             break;
         case MESSAGE_ERROR:
@@ -253,11 +440,15 @@ int Message_Decode(unsigned char char_in, BB_Event * decoded_message_event) {
     switch (decodeState) {
         case WAITING:
             // in the first state we wait for a $, if it doesnt arrive or arrives late
-            // we return error
+            // we return error, unless we are skipping noise
             if (char_in == START_DELIM) {
                 decoded_message_event->type = BB_EVENT_NO_EVENT;
                 decodeState = RECORDING_PAYLOAD;
+            } else if (useResync) {
+                decoded_message_event->type = BB_EVENT_NO_EVENT;
+                discardedBytes++;
             } else {
+                discardedBytes++;
                 decoded_message_event->type = BB_EVENT_ERROR;
                 decoded_message_event->param0 = BB_ERROR_INVALID_MESSAGE_TYPE;
                 return STANDARD_ERROR;
@@ -274,6 +465,11 @@ int Message_Decode(unsigned char char_in, BB_Event * decoded_message_event) {
                 decodeState = WAITING;
                 
                 return STANDARD_ERROR;
+            } else if (char_in == START_DELIM && useResync) {
+                // the message we were recording was cut short, start over with this one
+                discardedBytes += counter + 1;
+                counter = 0;
+                decoded_message_event->type = BB_EVENT_NO_EVENT;
             } else if (char_in == LAST_DELIM || char_in == START_DELIM) {
                 counter = 0;
                 decoded_message_event->type = BB_EVENT_ERROR;
@@ -281,11 +477,13 @@ int Message_Decode(unsigned char char_in, BB_Event * decoded_message_event) {
                 decodeState = WAITING;
                 
                 return STANDARD_ERROR;
-            } else if (char_in == CHECKSUM_DELIM) {
+            } else if (char_in == CHECKSUM_DELIM || char_in == CRC_DELIM) {
                 // might need to add null here
+                // the delimiter tells us how long the checksum is
                 decoded_message_event->type = BB_EVENT_NO_EVENT;
                 decPayload[counter] = '\0';
                 decodeState = RECORDING_CHECKSUM;
+                checklength = (char_in == CRC_DELIM) ? MESSAGE_CRC_LEN : MESSAGE_CHECKSUM_LEN;
                 counter = 0;
             } else {
                 decoded_message_event->type = BB_EVENT_NO_EVENT;
@@ -297,7 +495,13 @@ int Message_Decode(unsigned char char_in, BB_Event * decoded_message_event) {
             // we record this into a string until \n
             // if it is too long we return error
             // if there is an invalid character we return error
-            if (counter > checklength) {
+            if (char_in == START_DELIM && useResync) {
+                // the message we were recording was cut short, start over with this one
+                discardedBytes += strlen(decPayload) + counter + 2;
+                counter = 0;
+                decoded_message_event->type = BB_EVENT_NO_EVENT;
+                decodeState = RECORDING_PAYLOAD;
+            } else if (counter > checklength) {
                 counter = 0;
                 decoded_message_event->type = BB_EVENT_ERROR;
                 decoded_message_event->param0 = BB_ERROR_CHECKSUM_LEN_EXCEEDED;
@@ -338,3 +542,252 @@ int Message_Decode(unsigned char char_in, BB_Event * decoded_message_event) {
     
     return SUCCESS;
 }
+
+/**
+ * Selects how Message_Decode() treats bytes that cannot belong to a message.  Normally every
+ * byte outside a message is reported as an error.  When resynchronising, those bytes are skipped
+ * until the next '$', and a '$' in the middle of a message starts over with a new one.  Skipped
+ * bytes are counted, see Message_GetDiscardedBytes().  Messages that are framed but corrupted
+ * are still reported as errors.
+ * 
+ * @param resync        //TRUE to skip noise between messages, FALSE to report it
+ */
+void Message_UseResync(uint8_t resync) {
+    useResync = resync;
+}
+
+/**
+ * Tells the decoder that the line has been quiet for longer than the gap between two bytes of a
+ * message.  A message cut short, most likely by a garbled '\n', is then abandoned and reported
+ * as an error, as it would have been once the next message arrived.  Otherwise nothing happens.
+ * 
+ * @param decoded_message_event - set to an ERROR event if a message was abandoned, and left as
+ *                                it was otherwise
+ * @return SUCCESS if no message was abandoned
+ *         STANDARD_ERROR if one was
+ */
+int Message_DecodeTimeout(BB_Event * decoded_message_event) {
+    if (decodeState == WAITING) {
+        return SUCCESS;
+    }
+    counter = 0;
+    decoded_message_event->type = BB_EVENT_ERROR;
+    decoded_message_event->param0 = BB_ERROR_MESSAGE_PARSE_FAILURE;
+    decodeState = WAITING;
+    return STANDARD_ERROR;
+}
+
+/**
+ * @return   //The number of received bytes Message_Decode() has thrown away since startup,
+ *              noise between messages and, when resynchronising, the start of any message
+ *              abandoned for a new '$'
+ */
+uint32_t Message_GetDiscardedBytes(void) {
+    return discardedBytes;
+}
+
+#ifdef MESSAGE_BENCHMARK
+
+#include <stdlib.h>
+#include <time.h>
+
+#define TRIALS 100000
+#define STREAM_FRAMES 10000
+
+// the kinds of transmission errors injected into frames
+typedef enum {
+    ERROR_ONE_BIT,
+    ERROR_TWO_BITS,
+    ERROR_SWAP,
+    ERROR_BURST,
+    ERROR_THREE_BYTES,
+    NUM_ERRORS
+} InjectedError;
+
+static const char *errorNames[NUM_ERRORS] = {
+    "1 bit flipped", "2 bits flipped", "2 chars swapped", "burst <= 16 bits", "3 bytes garbled"
+};
+
+// encodes a random reveal, shot, result or combined message, as sent during a game
+static int RandomFrame(char *frame) {
+    Message message;
+    message.type = MESSAGE_REV + rand() % 4;
+    message.param0 = (message.type == MESSAGE_REV) ? rand() & 0xFFFF : rand() % 6;
+    message.param1 = rand() % 10;
+    message.param2 = rand() % 4;
+    message.param3 = rand() % 6;
+    message.param4 = rand() % 10;
+    if (message.type == MESSAGE_REV) {
+        message.param1 = 0; // a plain reveal, as in the frames measured so far
+    }
+    return Message_Encode(frame, message);
+}
+
+static void InjectError(char *frame, int length, InjectedError error) {
+    int i = rand() % length;
+    int j, bit;
+    char c;
+    switch (error) {
+    case ERROR_ONE_BIT:
+        frame[i] ^= 1 << (rand() % 8);
+        break;
+    case ERROR_TWO_BITS:
+        bit = rand() % (length * 8);
+        do {
+            j = rand() % (length * 8);
+        } while (j == bit);
+        frame[bit / 8] ^= 1 << (bit % 8);
+        frame[j / 8] ^= 1 << (j % 8);
+        break;
+    case ERROR_SWAP:
+        i = rand() % (length - 1);
+        c = frame[i];
+        frame[i] = frame[i + 1];
+        frame[i + 1] = c;
+        break;
+    case ERROR_BURST:
+        // a burst starts and ends with a flipped bit, anything in between may flip
+        bit = rand() % (length * 8 - 15);
+        j = 1 + rand() % 15;
+        frame[bit / 8] ^= 1 << (bit % 8);
+        frame[(bit + j) / 8] ^= 1 << ((bit + j) % 8);
+        for (i = bit + 1; i < bit + j; i++) {
+            if (rand() & 1) frame[i / 8] ^= 1 << (i % 8);
+        }
+        break;
+    default:
+        for (j = 0; j < 3; j++) {
+            frame[rand() % length] ^= 1 + rand() % 255;
+        }
+        break;
+    }
+}
+
+// feeds a frame to the decoder, returning TRUE if it came out as a valid message
+static uint8_t DecodeFrame(const char *frame, int length) {
+    BB_Event event;
+    uint8_t valid = FALSE;
+    int i;
+    for (i = 0; i < length; i++) {
+        Message_Decode(frame[i], &event);
+        valid = (event.type != BB_EVENT_NO_EVENT && event.type != BB_EVENT_ERROR);
+    }
+    // make sure the decoder is waiting for the next frame
+    Message_Decode(LAST_DELIM, &event);
+    return valid;
+}
+
+// records the bytes a board sees during a game on a noisy line: frames with trace output from a
+// board in TRACE_MODE, random noise, and frames cut short between them
+static int RecordNoisyStream(char *stream) {
+    char frame[MESSAGE_MAX_LEN + 1];
+    int length = 0, frames, i;
+    for (frames = 0; frames < STREAM_FRAMES; frames++) {
+        switch (rand() % 4) {
+        case 0:
+            length += sprintf(stream + length, "%c | %02x\n", 'A' + rand() % 26, rand() % 256);
+            break;
+        case 1:
+            for (i = rand() % 8; i >= 0; i--) {
+                stream[length++] = rand() % 256;
+            }
+            break;
+        case 2:
+            i = RandomFrame(frame);
+            memcpy(stream + length, frame, i / 2);
+            length += i / 2;
+            break;
+        default:
+            break;
+        }
+        length += RandomFrame(stream + length);
+    }
+    return length;
+}
+
+// decodes the recorded stream and reports the cost per byte in ns
+static double DecodeStream(const char *stream, int length, long *frames, long *errors) {
+    BB_Event event;
+    long passes = 0;
+    int i;
+    clock_t start = clock();
+    do {
+        *frames = 0;
+        *errors = 0;
+        for (i = 0; i < length; i++) {
+            Message_Decode(stream[i], &event);
+            if (event.type == BB_EVENT_ERROR) {
+                (*errors)++;
+            } else if (event.type != BB_EVENT_NO_EVENT) {
+                (*frames)++;
+            }
+        }
+        passes++;
+    } while (clock() - start < CLOCKS_PER_SEC / 10);
+    return 1e9 * (clock() - start) / CLOCKS_PER_SEC / passes / length;
+}
+
+// measures how long a frame check takes per payload character, in ns
+static double TimeCheck(uint8_t use_crc) {
+    static const char *payloads[] = {"SHO,2,9", "RES,4,7,1", "RSH,1,2,3,4,5", "CHA,12345,15,0"};
+    long chars = 0;
+    volatile uint16_t sink = 0;
+    int i;
+    clock_t start = clock();
+    while (clock() - start < CLOCKS_PER_SEC / 10) {
+        for (i = 0; i < 1000; i++) {
+            const char *payload = payloads[i % 4];
+            sink ^= use_crc ? Message_CalculateCrc(payload) : Message_CalculateChecksum(payload);
+            chars += strlen(payload);
+        }
+    }
+    return 1e9 * (clock() - start) / CLOCKS_PER_SEC / chars;
+}
+
+int main(void) {
+    char original[MESSAGE_MAX_LEN + 1], frame[MESSAGE_MAX_LEN + 1];
+    int error, trial, length;
+
+    printf("frame check    ns per char\n");
+    printf("XOR            %11.2f\n", TimeCheck(FALSE));
+    printf("CRC-16         %11.2f\n\n", TimeCheck(TRUE));
+
+    printf("injected error       undetected XOR   undetected CRC-16\n");
+    for (error = 0; error < NUM_ERRORS; error++) {
+        long undetected[2] = {0, 0};
+        int use_crc;
+        for (use_crc = 0; use_crc < 2; use_crc++) {
+            Message_UseCrc(use_crc);
+            srand(1);
+            for (trial = 0; trial < TRIALS; trial++) {
+                length = RandomFrame(original);
+                do {
+                    strcpy(frame, original);
+                    InjectError(frame, length, error);
+                } while (strcmp(frame, original) == 0);
+                undetected[use_crc] += DecodeFrame(frame, length);
+            }
+        }
+        printf("%-20s %13.3f%% %18.3f%%\n", errorNames[error],
+                100.0 * undetected[0] / TRIALS, 100.0 * undetected[1] / TRIALS);
+    }
+
+    static char stream[STREAM_FRAMES * 2 * MESSAGE_MAX_LEN];
+    long frames, errors;
+    double ns;
+    int resync;
+    Message_UseCrc(FALSE);
+    srand(1);
+    length = RecordNoisyStream(stream);
+    printf("\nnoisy stream of %d frames    ns per byte   frames decoded   errors per frame\n",
+            STREAM_FRAMES);
+    for (resync = 0; resync < 2; resync++) {
+        Message_UseResync(resync);
+        ns = DecodeStream(stream, length, &frames, &errors);
+        printf("%-28s %12.2f %16ld %18.2f\n", resync ? "resynchronising" : "reporting noise", ns,
+                frames, (double) errors / STREAM_FRAMES);
+    }
+    return 0;
+}
+
+#endif
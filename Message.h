@@ -21,6 +21,9 @@
 /*NMEA also defines a specific  checksum length*/
 #define MESSAGE_CHECKSUM_LEN 2
 
+/*the CRC-16 frame check (see MESSAGE_CAPABILITY_CRC) is twice as long*/
+#define MESSAGE_CRC_LEN 4
+
 /** 
  * The types of messages that can be sent or received:
  */
@@ -31,6 +34,11 @@ typedef enum {
     MESSAGE_REV,
     MESSAGE_SHO,
     MESSAGE_RES,
+    MESSAGE_RSH,
+    MESSAGE_SAL,
+    MESSAGE_SRS,
+    MESSAGE_ACK,
+    MESSAGE_NAK,
             
     //while not required, an error message can be a useful debugging tool:
     MESSAGE_ERROR = -1, 
@@ -44,6 +52,9 @@ typedef struct {
     unsigned int param0;
     unsigned int param1;
     unsigned int param2;
+    unsigned int param3;
+    unsigned int param4;
+    uint8_t link; //link layer header, see MESSAGE_CAPABILITY_RELIABLE
 } Message;
 
 
@@ -62,6 +73,104 @@ typedef struct {
 #define PAYLOAD_TEMPLATE_SHO "SHO,%d,%d"    // Shot (guess) message: 	row, col
 #define PAYLOAD_TEMPLATE_RES "RES,%u,%u,%u" // Result message: 			row, col, GuessResult
 
+/**
+ * Protocol extensions.  A challenger may offer extensions by adding a bitfield of
+ * MESSAGE_CAPABILITY_* values to its CHA message, and the accepter answers with the ones it also
+ * supports in its ACC message.  Peers that send no bitfield get the plain protocol above.
+ * 
+ * Note that the original BattleBoats parser rejects a CHA with an extra field, so only offer
+ * extensions to a peer that is known to understand them.
+ */
+#define PAYLOAD_TEMPLATE_CHA_CAPS "CHA,%u,%u" // Challenge message:	hash_a, capabilities
+#define PAYLOAD_TEMPLATE_ACC_CAPS "ACC,%u,%u" // Accept message:		B, capabilities
+
+/**
+ * With MESSAGE_CAPABILITY_RSH, the defender answers a shot with a combined message carrying the
+ * result and its own next shot, saving a message per turn.
+ */
+#define MESSAGE_CAPABILITY_RSH 0x01
+#define PAYLOAD_TEMPLATE_RSH "RSH,%u,%u,%u,%u,%u" // Result and shot:	row, col, GuessResult, row, col
+
+/**
+ * With MESSAGE_CAPABILITY_SALVO, the attacker fires one shot per boat it has left in a single
+ * SAL message, and the defender answers all of them in a single SRS message.  Both carry a count
+ * in param0 followed by that many fields in param1 to param4:
+ *   SAL fields are MESSAGE_PACK_SHOT(row, col)
+ *   SRS fields are MESSAGE_PACK_RESULT(row, col, GuessResult)
+ * Salvo takes the place of the combined result/shot message if both are offered.
+ */
+#define MESSAGE_CAPABILITY_SALVO 0x02
+#define MESSAGE_SALVO_MAX 4
+#define PAYLOAD_TEMPLATE_SAL "SAL,%u"   // Salvo message:			count, shots...
+#define PAYLOAD_TEMPLATE_SRS "SRS,%u"   // Salvo result message:	count, results...
+#define PAYLOAD_TEMPLATE_SALVO_FIELD ",%u"
+
+#define MESSAGE_PACK_SHOT(row, col) (((row) << 4) | (col))
+#define MESSAGE_PACK_RESULT(row, col, result) ((MESSAGE_PACK_SHOT(row, col) << 4) | (result))
+#define MESSAGE_SHOT_ROW(shot) (((shot) >> 4) & 0x0F)
+#define MESSAGE_SHOT_COL(shot) ((shot) & 0x0F)
+#define MESSAGE_RESULT_SHOT(packed) ((packed) >> 4)
+#define MESSAGE_RESULT_RESULT(packed) ((packed) & 0x0F)
+
+/**
+ * With MESSAGE_CAPABILITY_FAST_LINK, both boards switch their UART to the fastest rate they
+ * both support once the REV message has gone by, and stop throttling transmission.  CHA and
+ * ACC then carry a third field, the lowest UART BRG value (that is, the fastest rate) the
+ * sender supports.
+ */
+#define MESSAGE_CAPABILITY_FAST_LINK 0x04
+#define PAYLOAD_TEMPLATE_CHA_LINK "CHA,%u,%u,%u" // Challenge message:	hash_a, capabilities, BRG
+#define PAYLOAD_TEMPLATE_ACC_LINK "ACC,%u,%u,%u" // Accept message:		B, capabilities, BRG
+
+/**
+ * With MESSAGE_CAPABILITY_CRC, messages are framed with a CRC-16 instead of the XOR checksum, see
+ * MESSAGE_TEMPLATE_CRC.  The accepter switches as soon as it has agreed, so its ACC message is
+ * already framed with a CRC; the decoder accepts both framings at all times.
+ */
+#define MESSAGE_CAPABILITY_CRC 0x08
+
+/**
+ * With MESSAGE_CAPABILITY_RELIABLE, the link layer (see LinkLayer.h) numbers every message after
+ * the handshake and retransmits it until it is acknowledged.  It puts two digits in the NMEA
+ * talker position at the start of the payload: the message's sequence number, then the sequence
+ * number the sender expects to receive next, which acknowledges everything before it.
+ * 
+ * ACK and NAK messages carry nothing but the talker.  A NAK asks for everything that has not been
+ * acknowledged to be sent again.
+ * 
+ * example message:      $35SHO,2,9*HH\n   (message 3, messages up to 4 received)
+ * 
+ * Message structs keep the talker in their link field, built with MESSAGE_LINK().  A link of 0
+ * means the message has no talker.
+ */
+#define MESSAGE_CAPABILITY_RELIABLE 0x10
+#define MESSAGE_SEQ_MODULUS 8
+#define PAYLOAD_TEMPLATE_LINK "%u%u"    // Talker:					sequence number, next expected
+#define PAYLOAD_TEMPLATE_ACK "ACK"      // Acknowledgement message
+#define PAYLOAD_TEMPLATE_NAK "NAK"      // Negative acknowledgement message
+
+#define MESSAGE_LINK(seq, ack) (0x80 | ((seq) << 3) | (ack))
+#define MESSAGE_LINK_SEQ(link) (((link) >> 3) & 0x07)
+#define MESSAGE_LINK_ACK(link) ((link) & 0x07)
+
+/**
+ * With MESSAGE_CAPABILITY_STRONG_COMMIT, the coin flip is done on 32-bit numbers committed to with
+ * NegotiationCommit() instead of the Beef hash (see Negotiation.h).  32-bit values are sent as two
+ * fields, the low half where the plain protocol has its number:
+ *   CHA carries hash_a, capabilities, BRG, then the commitment's high and low halves
+ *   ACC carries B's low half, capabilities, BRG, then B's high half
+ *   REV carries A's low half, then A's high half
+ * 
+ * CHA keeps the Beef hash of a separate 16-bit secret in its first field, so that the plain coin
+ * flip can still be done if the accepter does not agree.
+ * 
+ * REV leaves out the high half when it is 0, so a plain REV reads as a 32-bit secret below 65536.
+ */
+#define MESSAGE_CAPABILITY_STRONG_COMMIT 0x20
+#define PAYLOAD_TEMPLATE_CHA_COMMIT "CHA,%u,%u,%u,%u,%u" // Challenge message:	see above
+#define PAYLOAD_TEMPLATE_ACC_COMMIT "ACC,%u,%u,%u,%u"    // Accept message:		see above
+#define PAYLOAD_TEMPLATE_REV_COMMIT "REV,%u,%u"          // Reveal message:		see above
+
 
 /** 
  * NEMA0183 messages wrap the payload with a start delimiter, 
@@ -91,6 +200,22 @@ typedef struct {
  */
 #define MESSAGE_TEMPLATE "$%s*%02X\n"
 
+/**
+ * The CRC-16 framing uses its own checksum delimiter (a literal #) followed by four hex digits,
+ * so a frame cannot be mistaken for the other kind even if it is corrupted:
+ * 
+ * example message:      $SHO,2,9#E750\n
+ * 
+ * The CRC is CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) over the payload.
+ * Unlike the XOR checksum, it catches all errors of up to three bits, all bursts of up to 16
+ * bits, and swapped characters.
+ * 
+ * CRC speed and detection rates against the XOR checksum can be measured on x86 by compiling
+ * with the MESSAGE_BENCHMARK macro.
+ * With gcc: `gcc Message.c -DMESSAGE_BENCHMARK`
+ */
+#define MESSAGE_TEMPLATE_CRC "$%s#%04X\n"
+
 /**
  * Given a payload string, calculate its checksum
  * 
@@ -99,6 +224,21 @@ typedef struct {
  */
 uint8_t Message_CalculateChecksum(const char* payload);
 
+/**
+ * Given a payload string, calculate its CRC-16 (see MESSAGE_TEMPLATE_CRC)
+ * 
+ * @param payload       //the string whose CRC we wish to calculate
+ * @return   //The resulting 16-bit CRC
+ */
+uint16_t Message_CalculateCrc(const char* payload);
+
+/**
+ * Selects the framing Message_Encode() uses.  The XOR checksum is used until this is called.
+ * 
+ * @param use_crc       //TRUE to frame messages with a CRC-16, FALSE for the XOR checksum
+ */
+void Message_UseCrc(uint8_t use_crc);
+
 /**
  * ParseMessage() converts a message string into a BB_Event.  The payload and
  * checksum of a message are passed into ParseMessage(), and it modifies a
@@ -106,7 +246,8 @@ uint8_t Message_CalculateChecksum(const char* payload);
  * 
  * @param payload       //the payload of a message
  * @param checksum      //the checksum (in string form) of  a message,
- *                          should be exactly 2 chars long, plus a null char
+ *                          should be exactly 2 chars long, plus a null char,
+ *                          or 4 chars long for a CRC-16
  * @param message_event //A BB_Event which will be modified by this function.
  *                      //If the message could be parsed successfully,
  *                          message_event's type will correspond to the message type and 
@@ -116,7 +257,7 @@ uint8_t Message_CalculateChecksum(const char* payload);
  * 
  * @return STANDARD_ERROR if:
  *              the payload does not match the checksum
- *              the checksum string is not two characters long
+ *              the checksum string is not two or four characters long
  *              the message does not match any message template
  *          SUCCESS otherwise
  * 
@@ -165,5 +306,35 @@ int Message_Encode(char *message_string, Message message_to_encode);
  */
 int Message_Decode(unsigned char char_in, BB_Event * decoded_message_event);
 
+/**
+ * Selects how Message_Decode() treats bytes that cannot belong to a message.  Normally every
+ * byte outside a message is reported as an error.  When resynchronising, those bytes are skipped
+ * until the next '$', and a '$' in the middle of a message starts over with a new one.  Skipped
+ * bytes are counted, see Message_GetDiscardedBytes().  Messages that are framed but corrupted
+ * are still reported as errors.
+ * 
+ * @param resync        //TRUE to skip noise between messages, FALSE to report it
+ */
+void Message_UseResync(uint8_t resync);
+
+/**
+ * Tells the decoder that the line has been quiet for longer than the gap between two bytes of a
+ * message.  A message cut short, most likely by a garbled '\n', is then abandoned and reported
+ * as an error, as it would have been once the next message arrived.  Otherwise nothing happens.
+ * 
+ * @param decoded_message_event - set to an ERROR event if a message was abandoned, and left as
+ *                                it was otherwise
+ * @return SUCCESS if no message was abandoned
+ *         STANDARD_ERROR if one was
+ */
+int Message_DecodeTimeout(BB_Event * decoded_message_event);
+
+/**
+ * @return   //The number of received bytes Message_Decode() has thrown away since startup,
+ *              noise between messages and, when resynchronising, the start of any message
+ *              abandoned for a new '$'
+ */
+uint32_t Message_GetDiscardedBytes(void);
+
 
 #endif // MESSAGE_H
@@ -59,9 +59,18 @@ int main() {
     payload = "RES,1,2,3";
     checksum = Message_CalculateChecksum(payload);
     if (checksum == 0x58) {
-        printf("\tTest 3: passed!\n\n");
+        printf("\tTest 3: passed!\n");
+    } else {
+        printf("\tTest 3: failed! \n");
+        correct = 0;
+    }
+    
+    // the standard check value for CRC-16/CCITT-FALSE
+    payload = "123456789";
+    if (Message_CalculateCrc(payload) == 0x29B1) {
+        printf("\tTest 4: passed!\n\n");
     } else {
-        printf("\tTest 3: failed! \n\n");
+        printf("\tTest 4: failed! \n\n");
         correct = 0;
     }
     
@@ -110,8 +119,9 @@ int main() {
         correct = 0;
     }
     
-    payload = "CHA,1,2";
-    checkString = "49";
+    // CHA may carry capabilities, a link rate and a strong commitment, but nothing more
+    payload = "CHA,1,2,3,4,5,6";
+    checkString = "4D";
     result = Message_ParseMessage(payload, checkString, &testEvent);
     if (!result && testEvent.type == BB_EVENT_ERROR) {
         printf("\tTest 5: passed!\n");
@@ -124,9 +134,123 @@ int main() {
     checkString = "31";
     result = Message_ParseMessage(payload, checkString, &testEvent);
     if (!result && testEvent.type == BB_EVENT_ERROR) {
-        printf("\tTest 6: passed!\n\n");
+        printf("\tTest 6: passed!\n");
+    } else {
+        printf("\tTest 6: failed!\n");
+        correct = 0;
+    }
+    
+    payload = "CHA,1,2";
+    checkString = "49";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (result && testEvent.type == BB_EVENT_CHA_RECEIVED && testEvent.param0 == 1 && testEvent.param1 == 2) {
+        printf("\tTest 7: passed!\n");
+    } else {
+        printf("\tTest 7: failed!\n");
+        correct = 0;
+    }
+    
+    payload = "RSH,1,2,3,4,5";
+    checkString = "54";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (result && testEvent.type == BB_EVENT_RSH_RECEIVED && testEvent.param0 == 1 && testEvent.param1 == 2
+            && testEvent.param2 == 3 && testEvent.param3 == 4 && testEvent.param4 == 5) {
+        printf("\tTest 8: passed!\n");
+    } else {
+        printf("\tTest 8: failed!\n");
+        correct = 0;
+    }
+    
+    payload = "SAL,2,18,52";
+    checkString = "4E";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (result && testEvent.type == BB_EVENT_SAL_RECEIVED && testEvent.param0 == 2 &&
+            MESSAGE_SHOT_ROW(testEvent.param1) == 1 && MESSAGE_SHOT_COL(testEvent.param1) == 2 &&
+            MESSAGE_SHOT_ROW(testEvent.param2) == 3 && MESSAGE_SHOT_COL(testEvent.param2) == 4) {
+        printf("\tTest 9: passed!\n");
+    } else {
+        printf("\tTest 9: failed!\n");
+        correct = 0;
+    }
+    
+    // a salvo has to carry as many shots as it says
+    payload = "SAL,3,18,52";
+    checkString = "4F";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (!result && testEvent.type == BB_EVENT_ERROR) {
+        printf("\tTest 10: passed!\n");
+    } else {
+        printf("\tTest 10: failed!\n");
+        correct = 0;
+    }
+    
+    payload = "CHA,1,4,3";
+    checkString = "50";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (result && testEvent.type == BB_EVENT_CHA_RECEIVED && testEvent.param0 == 1 &&
+            testEvent.param1 == MESSAGE_CAPABILITY_FAST_LINK && testEvent.param2 == 3) {
+        printf("\tTest 11: passed!\n");
+    } else {
+        printf("\tTest 11: failed!\n");
+        correct = 0;
+    }
+    
+    // a four character checksum is a CRC
+    payload = "SHO,2,9";
+    checkString = "E750";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (result && testEvent.type == BB_EVENT_SHO_RECEIVED && testEvent.param0 == 2 && testEvent.param1 == 9) {
+        printf("\tTest 12: passed!\n");
+    } else {
+        printf("\tTest 12: failed!\n");
+        correct = 0;
+    }
+    
+    // swapped digits get past the XOR checksum, but not the CRC
+    payload = "REV,12354";
+    checkString = "4D69";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (!result && testEvent.type == BB_EVENT_ERROR &&
+            Message_CalculateChecksum("REV,12354") == Message_CalculateChecksum("REV,12345")) {
+        printf("\tTest 13: passed!\n");
+    } else {
+        printf("\tTest 13: failed!\n");
+        correct = 0;
+    }
+    
+    // two leading digits are the link layer's sequence and acknowledgement numbers
+    payload = "35SHO,2,9";
+    checkString = "59";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (result && testEvent.type == BB_EVENT_SHO_RECEIVED && testEvent.param1 == 9 &&
+            testEvent.link == MESSAGE_LINK(3, 5)) {
+        printf("\tTest 14: passed!\n");
+    } else {
+        printf("\tTest 14: failed!\n");
+        correct = 0;
+    }
+    
+    // an ACK only makes sense with the link layer's numbers
+    payload = "ACK";
+    checkString = "49";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (!result && testEvent.type == BB_EVENT_ERROR) {
+        printf("\tTest 15: passed!\n");
     } else {
-        printf("\tTest 6: failed!\n\n");
+        printf("\tTest 15: failed!\n");
+        correct = 0;
+    }
+    
+    // a challenge with a strong commitment carries its halves after the link rate
+    payload = "CHA,49,32,0,4660,22136";
+    checkString = "6A";
+    result = Message_ParseMessage(payload, checkString, &testEvent);
+    if (result && testEvent.type == BB_EVENT_CHA_RECEIVED && testEvent.param0 == 49 &&
+            testEvent.param1 == MESSAGE_CAPABILITY_STRONG_COMMIT && testEvent.param3 == 0x1234 &&
+            testEvent.param4 == 0x5678) {
+        printf("\tTest 16: passed!\n\n");
+    } else {
+        printf("\tTest 16: failed!\n\n");
         correct = 0;
     }
     
@@ -160,9 +284,92 @@ int main() {
     testMessage.param2 = 3;
     Message_Encode(message, testMessage);
     if (strcmp(message, "$RES,1,2,3*58\n") == 0) {
-        printf("\tTest 3: passed!\n\n");
+        printf("\tTest 3: passed!\n");
     } else {
-        printf("\tTest 3: failed!\n\n");
+        printf("\tTest 3: failed!\n");
+        correct = 0;
+    }
+    
+    testMessage.type = MESSAGE_RSH;
+    testMessage.param3 = 4;
+    testMessage.param4 = 5;
+    Message_Encode(message, testMessage);
+    if (strcmp(message, "$RSH,1,2,3,4,5*54\n") == 0) {
+        printf("\tTest 4: passed!\n");
+    } else {
+        printf("\tTest 4: failed!\n");
+        correct = 0;
+    }
+    
+    // a capabilities field is only added if there are any
+    testMessage.type = MESSAGE_CHA;
+    testMessage.param1 = 2;
+    Message_Encode(message, testMessage);
+    if (strcmp(message, "$CHA,1,2*49\n") == 0) {
+        printf("\tTest 5: passed!\n");
+    } else {
+        printf("\tTest 5: failed!\n");
+        correct = 0;
+    }
+    
+    testMessage.type = MESSAGE_SAL;
+    testMessage.param0 = 2;
+    testMessage.param1 = MESSAGE_PACK_SHOT(1, 2);
+    testMessage.param2 = MESSAGE_PACK_SHOT(3, 4);
+    Message_Encode(message, testMessage);
+    if (strcmp(message, "$SAL,2,18,52*4E\n") == 0) {
+        printf("\tTest 6: passed!\n");
+    } else {
+        printf("\tTest 6: failed!\n");
+        correct = 0;
+    }
+    
+    // the link rate is only added if a fast link is offered, even if it is 0
+    testMessage.type = MESSAGE_ACC;
+    testMessage.param0 = 4;
+    testMessage.param1 = MESSAGE_CAPABILITY_FAST_LINK;
+    testMessage.param2 = 0;
+    Message_Encode(message, testMessage);
+    if (strcmp(message, "$ACC,4,4,0*5D\n") == 0) {
+        printf("\tTest 7: passed!\n");
+    } else {
+        printf("\tTest 7: failed!\n");
+        correct = 0;
+    }
+    
+    testMessage.type = MESSAGE_SHO;
+    testMessage.param0 = 2;
+    testMessage.param1 = 9;
+    Message_UseCrc(TRUE);
+    Message_Encode(message, testMessage);
+    Message_UseCrc(FALSE);
+    if (strcmp(message, "$SHO,2,9#E750\n") == 0) {
+        printf("\tTest 8: passed!\n");
+    } else {
+        printf("\tTest 8: failed!\n");
+        correct = 0;
+    }
+    
+    testMessage.type = MESSAGE_ACK;
+    testMessage.link = MESSAGE_LINK(2, 5);
+    Message_Encode(message, testMessage);
+    testMessage.link = 0;
+    if (strcmp(message, "$25ACK*4E\n") == 0) {
+        printf("\tTest 9: passed!\n");
+    } else {
+        printf("\tTest 9: failed!\n");
+        correct = 0;
+    }
+    
+    // a 32-bit reveal only adds its high half if there is one
+    testMessage.type = MESSAGE_REV;
+    testMessage.param0 = 5;
+    testMessage.param1 = 2;
+    Message_Encode(message, testMessage);
+    if (strcmp(message, "$REV,5,2*46\n") == 0) {
+        printf("\tTest 10: passed!\n\n");
+    } else {
+        printf("\tTest 10: failed!\n\n");
         correct = 0;
     }
     
@@ -222,9 +429,77 @@ int main() {
         Message_Decode(message2[iter], &testEvent);
     } 
     if (testEvent.type == BB_EVENT_ERROR) {
-        printf("\tTest 5: passed!\n\n");
+        printf("\tTest 5: passed!\n");
+    } else {
+        printf("\tTest 5: failed!\n");
+        correct = 0;
+    }
+    
+    message2 = "$SHO,2,9#E750\n";
+    for (iter = 0; iter < strlen(message2); iter++) {
+        Message_Decode(message2[iter], &testEvent);
+    } 
+    if (testEvent.type == BB_EVENT_SHO_RECEIVED && testEvent.param0 == 2 && testEvent.param1 == 9) {
+        printf("\tTest 6: passed!\n");
+    } else {
+        printf("\tTest 6: failed! %d\n", testEvent.param0);
+        correct = 0;
+    }
+    
+    // a CRC after the XOR checksum delimiter is too long
+    message2 = "$SHO,2,9*E750\n";
+    for (iter = 0; iter < strlen(message2); iter++) {
+        Message_Decode(message2[iter], &testEvent);
+    } 
+    if (testEvent.type == BB_EVENT_ERROR) {
+        printf("\tTest 7: passed!\n");
+    } else {
+        printf("\tTest 7: failed!\n");
+        correct = 0;
+    }
+    
+    // when resynchronising, noise before a message is skipped without any errors
+    int errors = 0;
+    uint32_t discarded = Message_GetDiscardedBytes();
+    Message_UseResync(TRUE);
+    message2 = "S | 53\n$SHO,1,2*57\n";
+    for (iter = 0; iter < strlen(message2); iter++) {
+        errors += (Message_Decode(message2[iter], &testEvent) == STANDARD_ERROR);
+    } 
+    if (errors == 0 && testEvent.type == BB_EVENT_SHO_RECEIVED && testEvent.param1 == 2 &&
+            Message_GetDiscardedBytes() == discarded + 7) {
+        printf("\tTest 8: passed!\n");
+    } else {
+        printf("\tTest 8: failed!\n");
+        correct = 0;
+    }
+    
+    // and a message cut short is dropped for the one that follows it
+    message2 = "$RES,1,$SHO,1,2*57\n";
+    for (iter = 0; iter < strlen(message2); iter++) {
+        errors += (Message_Decode(message2[iter], &testEvent) == STANDARD_ERROR);
+    } 
+    Message_UseResync(FALSE);
+    if (errors == 0 && testEvent.type == BB_EVENT_SHO_RECEIVED && testEvent.param1 == 2 &&
+            Message_GetDiscardedBytes() == discarded + 14) {
+        printf("\tTest 9: passed!\n");
+    } else {
+        printf("\tTest 9: failed!\n");
+        correct = 0;
+    }
+    
+    // a message whose '\n' never arrives is an error once the line goes quiet, and only then
+    message2 = "$SHO,1,2*57";
+    for (iter = 0; iter < strlen(message2); iter++) {
+        Message_Decode(message2[iter], &testEvent);
+    }
+    if (testEvent.type == BB_EVENT_NO_EVENT &&
+            Message_DecodeTimeout(&testEvent) == STANDARD_ERROR &&
+            testEvent.type == BB_EVENT_ERROR &&
+            Message_DecodeTimeout(&testEvent) == SUCCESS) {
+        printf("\tTest 10: passed!\n\n");
     } else {
-        printf("\tTest 5: failed!\n\n");
+        printf("\tTest 10: failed!\n\n");
         correct = 0;
     }
     
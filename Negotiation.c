@@ -2,6 +2,71 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "BOARD.h"
+
+// 0xBEEF is 9 * 5431, and 5431 is a prime that is 3 mod 4
+#define KEY_FACTOR 9
+#define KEY_PRIME 5431
+#define KEY_FACTOR_INVERSE 1207 // 9 * 1207 is 1 mod 5431
+
+// the square roots modulo 9 of each residue, as a bitmask of the roots
+static const uint16_t rootsModFactor[KEY_FACTOR] = {
+    [0] = (1 << 0) | (1 << 3) | (1 << 6),
+    [1] = (1 << 1) | (1 << 8),
+    [4] = (1 << 2) | (1 << 7),
+    [7] = (1 << 4) | (1 << 5),
+};
+
+// base to the power exponent, modulo KEY_PRIME
+static uint32_t PowModPrime(uint32_t base, uint32_t exponent) {
+    uint32_t result = 1;
+    base %= KEY_PRIME;
+    while (exponent) {
+        if (exponent & 1) {
+            result = (result * base) % KEY_PRIME;
+        }
+        base = (base * base) % KEY_PRIME;
+        exponent >>= 1;
+    }
+    return result;
+}
+
+// HalfSipHash initialisation constants, "somepseudorandomlygeneratedbytes" cut down to 32 bits
+#define SIP_INIT_2 0x6C796765
+#define SIP_INIT_3 0x74656462
+
+#define ROTL32(x, b) (((x) << (b)) | ((x) >> (32 - (b))))
+
+// 1 if there are an odd number of one bits, 0 otherwise
+static int Parity(uint32_t x) {
+    return __builtin_popcount(x) & 1;
+}
+
+// one round of HalfSipHash on its four words of state
+static void SipRound(uint32_t *v) {
+    v[0] += v[1];
+    v[1] = ROTL32(v[1], 5);
+    v[1] ^= v[0];
+    v[0] = ROTL32(v[0], 16);
+    v[2] += v[3];
+    v[3] = ROTL32(v[3], 8);
+    v[3] ^= v[2];
+    v[0] += v[3];
+    v[3] = ROTL32(v[3], 7);
+    v[3] ^= v[0];
+    v[2] += v[1];
+    v[1] = ROTL32(v[1], 13);
+    v[1] ^= v[2];
+    v[2] = ROTL32(v[2], 16);
+}
+
+// compresses a 32-bit message word with the 2 rounds of HalfSipHash-2-4
+static void SipCompress(uint32_t *v, uint32_t m) {
+    v[3] ^= m;
+    SipRound(v);
+    SipRound(v);
+    v[0] ^= m;
+}
+
 /**
  * This function implements a one-way hash.  It maps its input, A, 
  * into an image, #a, in a way that is hard to reverse, but easy 
@@ -51,16 +116,302 @@ int NegotiationVerify(NegotiationData secret, NegotiationData commitment) {
  * A XOR B is 1, then the outcome is HEADS.  Otherwise, the outcome is TAILS.
  */
 NegotiationOutcome NegotiateCoinFlip(NegotiationData A, NegotiationData B) {
-    NegotiationData xored = A ^ B;
-    int i , counter = 0, o = 1;
+    return Parity(A ^ B) ? HEADS : TAILS;
+}
+
+/**
+ * This function commits to a 32-bit secret.  It computes HalfSipHash-2-4 of the secret's 4 bytes
+ * with the public key COMMIT_KEY_0/COMMIT_KEY_1.
+ *
+ * @param secret        //A number that a challenger commits to
+ * @return commitment   //the commitment to send in the CHA message
+ */
+NegotiationWideData NegotiationCommit(NegotiationWideData secret) {
+    uint32_t v[4] = {COMMIT_KEY_0, COMMIT_KEY_1, COMMIT_KEY_0 ^ SIP_INIT_2,
+        COMMIT_KEY_1 ^ SIP_INIT_3};
+    int i;
     
-    for(i = 0; i < 32; i++) {
-        if(xored & (o << i))  {
-            counter = counter + 1;
+    // the secret is the only block, read little-endian, and the last block holds the length
+    SipCompress(v, secret);
+    SipCompress(v, (uint32_t) sizeof (secret) << 24);
+    v[2] ^= 0xFF;
+    for (i = 0; i < 4; i++) {
+        SipRound(v);
+    }
+    return v[1] ^ v[3];
+}
+
+/**
+ * Detect cheating with the strong commitment.  The comparison takes the same time whether or
+ * not, and wherever, the commitment differs.
+ *
+ * @param secret        //the previously secret number that the challenging agent has revealed
+ * @param commitment    //the commitment to the secret number
+ * @return TRUE if the commitment validates the revealed secret, FALSE otherwise
+ */
+int NegotiationVerifyCommit(NegotiationWideData secret, NegotiationWideData commitment) {
+    uint32_t difference = NegotiationCommit(secret) ^ commitment;
+    
+    // fold every differing bit down into bit 0 instead of branching on them
+    difference |= difference >> 16;
+    difference |= difference >> 8;
+    difference |= difference >> 4;
+    difference |= difference >> 2;
+    difference |= difference >> 1;
+    return ~difference & 1; // TRUE if no bit differed
+}
+
+/**
+ * The coin flip for 32-bit packets: HEADS if the parity of A XOR B is 1, TAILS otherwise.
+ */
+NegotiationOutcome NegotiateCoinFlipWide(NegotiationWideData A, NegotiationWideData B) {
+    return Parity(A ^ B) ? HEADS : TAILS;
+}
+
+/**
+ * Inverts NegotiationHash().  The square roots modulo 9 come from a table, and those modulo the
+ * prime 5431 from a single modular exponentiation (5431 is 3 mod 4), so this takes the same
+ * short time for any hash instead of searching all 65536 secrets.
+ *
+ * @param hash          //a hash, as sent in a CHA message
+ * @param secrets       //filled with every secret that hashes to it, in increasing order,
+ *                          must have room for NEGOTIATION_MAX_SECRETS
+ * @return the number of secrets found, 0 if no secret has this hash
+ */
+int NegotiationFindSecrets(NegotiationData hash, NegotiationData *secrets) {
+    if (hash >= PUBLIC_KEY) {
+        return 0;
+    }
+
+    // the roots modulo the prime are r and -r, if hash is a square at all
+    uint32_t r = PowModPrime(hash, (KEY_PRIME + 1) / 4);
+    if ((r * r) % KEY_PRIME != hash % KEY_PRIME) {
+        return 0;
+    }
+    uint32_t primeRoots[2] = {r, (KEY_PRIME - r) % KEY_PRIME};
+    int numPrimeRoots = (r == 0) ? 1 : 2;
+
+    // combine every pair of roots with the Chinese remainder theorem, then add the key once more
+    // while it still fits in 16 bits
+    uint16_t factorRoots = rootsModFactor[hash % KEY_FACTOR];
+    uint32_t candidates[NEGOTIATION_MAX_SECRETS];
+    int count = 0;
+    int a, i, j;
+    for (a = 0; a < KEY_FACTOR; a++) {
+        if (!(factorRoots & (1 << a))) continue;
+        for (i = 0; i < numPrimeRoots; i++) {
+            uint32_t k = ((primeRoots[i] + KEY_PRIME - a) * KEY_FACTOR_INVERSE) % KEY_PRIME;
+            uint32_t x = a + KEY_FACTOR * k;
+            for (; x <= 0xFFFF; x += PUBLIC_KEY) {
+                candidates[count++] = x;
+            }
         }
     }
-    if( (counter % 2)) {
-        return FALSE;
-    }    
-    return TRUE; 
-}
\ No newline at end of file
+
+    // sort the handful of secrets found
+    for (i = 0; i < count; i++) {
+        uint32_t x = candidates[i];
+        for (j = i; j > 0 && secrets[j - 1] > x; j--) {
+            secrets[j] = secrets[j - 1];
+        }
+        secrets[j] = x;
+    }
+    return count;
+}
+
+/**
+ * Detect a commitment the challenger could cheat with.  If secrets of both parities share the
+ * hash, the challenger can wait to see B and then reveal whichever one wins the coin flip, and
+ * NegotiationVerify() will accept it.
+ *
+ * @param commitment    //the hash the challenger committed to
+ * @return TRUE if the outcome of the coin flip was still the challenger's to choose, FALSE otherwise
+ */
+int NegotiationIsForgeable(NegotiationData commitment) {
+    NegotiationData secrets[NEGOTIATION_MAX_SECRETS];
+    int count = NegotiationFindSecrets(commitment, secrets);
+    int i, odd = 0;
+    for (i = 0; i < count; i++) {
+        odd += Parity(secrets[i]);
+    }
+    return (odd > 0 && odd < count) ? TRUE : FALSE;
+}
+
+/**
+ * NegotiateGenerateBGivenHash() finds every secret the challenger may have committed to (see
+ * NegotiationFindSecrets()) and returns a random B that gives TAILS, so that the accepter goes
+ * first, against as many of them as possible.
+ */
+NegotiationData NegotiateGenerateBGivenHash(NegotiationData hash_a) {
+    NegotiationData secrets[NEGOTIATION_MAX_SECRETS];
+    int count = NegotiationFindSecrets(hash_a, secrets);
+    int i, odd = 0;
+    for (i = 0; i < count; i++) {
+        odd += Parity(secrets[i]);
+    }
+
+    // TAILS needs B to have the same parity as A, ties are broken at random
+    NegotiationData B = rand() & 0xFFFF;
+    int wantOdd = (2 * odd == count) ? (rand() & 1) : (2 * odd > count);
+    if (Parity(B) != wantOdd) {
+        B ^= 1;
+    }
+    return B;
+}
+
+/**
+ * NegotiateGenerateAGivenB() returns a random A that gives HEADS against B, so that the
+ * challenger goes first.  It only helps a challenger that has not committed yet, or whose
+ * commitment is forgeable and has a secret like it (see NegotiationIsForgeable()).
+ */
+NegotiationData NegotiateGenerateAGivenB(NegotiationData B) {
+    NegotiationData A = rand() & 0xFFFF;
+    if (Parity(A) == Parity(B)) {
+        A ^= 1;
+    }
+    return A;
+}
+
+#ifdef NEGOTIATION_BENCHMARK
+
+#include <time.h>
+
+// the obvious way to invert the hash, for comparison
+static int FindSecretsBruteForce(NegotiationData hash, NegotiationData *secrets) {
+    int count = 0;
+    uint32_t x;
+    for (x = 0; x <= 0xFFFF; x++) {
+        if (NegotiationHash(x) == hash) {
+            secrets[count++] = x;
+        }
+    }
+    return count;
+}
+
+// the coin flip as it was first written, for comparison
+static NegotiationOutcome CoinFlipLoop(NegotiationWideData A, NegotiationWideData B) {
+    NegotiationWideData xored = A ^ B;
+    int i, counter = 0;
+    for (i = 0; i < 32; i++) {
+        if (xored & ((uint32_t) 1 << i)) {
+            counter++;
+        }
+    }
+    return (counter % 2) ? HEADS : TAILS;
+}
+
+static uint32_t Random32(void) {
+    return ((uint32_t) rand() << 30) ^ ((uint32_t) rand() << 15) ^ rand();
+}
+
+static volatile uint32_t sink32;
+
+// measures how long one call takes, in ns
+#define TIME_CALLS(expression, ns) do { \
+    long calls = 0; \
+    clock_t start = clock(); \
+    while (clock() - start < CLOCKS_PER_SEC / 10) { \
+        int n; \
+        for (n = 0; n < 1000; n++, calls++) { \
+            sink32 += (expression); \
+        } \
+    } \
+    ns = 1e9 * (clock() - start) / CLOCKS_PER_SEC / calls; \
+} while (0)
+
+// searches for two secrets of different parity with the same strong commitment, the way a
+// cheating challenger could ahead of time, and returns how many commitments it took
+#define COLLISION_TABLE_BITS 20
+static long FindForgeablePair(NegotiationWideData *first, NegotiationWideData *second) {
+    static NegotiationWideData seen[1 << COLLISION_TABLE_BITS];
+    static uint8_t used[1 << COLLISION_TABLE_BITS];
+    long tries;
+    for (tries = 1; tries < (1 << COLLISION_TABLE_BITS); tries++) {
+        NegotiationWideData secret = Random32();
+        NegotiationWideData commitment = NegotiationCommit(secret);
+        uint32_t slot = commitment >> (32 - COLLISION_TABLE_BITS);
+        while (used[slot] && NegotiationCommit(seen[slot]) != commitment) {
+            slot = (slot + 1) & ((1 << COLLISION_TABLE_BITS) - 1);
+        }
+        if (used[slot] && Parity(seen[slot]) != Parity(secret)) {
+            *first = seen[slot];
+            *second = secret;
+            return tries;
+        }
+        seen[slot] = secret;
+        used[slot] = TRUE;
+    }
+    return -1;
+}
+
+// measures how long one inversion takes, in ns
+static double TimeFind(int (*find)(NegotiationData, NegotiationData *)) {
+    NegotiationData secrets[NEGOTIATION_MAX_SECRETS];
+    volatile int sink = 0;
+    long calls = 0;
+    clock_t start = clock();
+    while (clock() - start < CLOCKS_PER_SEC / 10) {
+        sink += find(NegotiationHash(rand() & 0xFFFF), secrets);
+        calls++;
+    }
+    return 1e9 * (clock() - start) / CLOCKS_PER_SEC / calls;
+}
+
+int main(void) {
+    NegotiationData fast[NEGOTIATION_MAX_SECRETS], slow[NEGOTIATION_MAX_SECRETS];
+    uint32_t hash;
+    int i, count, mismatches = 0, forgeable = 0;
+
+    // every hash has to give the same secrets both ways
+    for (hash = 0; hash < PUBLIC_KEY; hash++) {
+        count = NegotiationFindSecrets(hash, fast);
+        if (count != FindSecretsBruteForce(hash, slow)) {
+            mismatches++;
+            continue;
+        }
+        for (i = 0; i < count; i++) {
+            mismatches += (fast[i] != slow[i]);
+        }
+    }
+    printf("hashes checked against brute force: %u, mismatches: %d\n", PUBLIC_KEY, mismatches);
+
+    printf("brute force    %10.0f ns per inversion\n", TimeFind(FindSecretsBruteForce));
+    printf("square roots   %10.0f ns per inversion\n", TimeFind(NegotiationFindSecrets));
+
+    // how often a fair challenger's commitment would have let it cheat
+    srand(1);
+    for (i = 0; i < 10000; i++) {
+        forgeable += NegotiationIsForgeable(NegotiationHash(rand() & 0xFFFF));
+    }
+    printf("forgeable commitments: %.1f%%\n", forgeable / 100.0);
+
+    // the popcount coin flip has to agree with the loop
+    mismatches = 0;
+    for (i = 0; i < 1000000; i++) {
+        NegotiationWideData A = Random32(), B = Random32();
+        mismatches += (NegotiateCoinFlipWide(A, B) != CoinFlipLoop(A, B));
+        mismatches += (NegotiateCoinFlip(A, B) != CoinFlipLoop(A & 0xFFFF, B & 0xFFFF));
+    }
+    printf("coin flips checked against the loop: %d, mismatches: %d\n", 2 * i, mismatches);
+
+    double ns;
+    TIME_CALLS(NegotiationHash(sink32), ns);
+    printf("Beef hash      %10.1f ns per hash\n", ns);
+    TIME_CALLS(NegotiationCommit(sink32), ns);
+    printf("HalfSipHash    %10.1f ns per commitment\n", ns);
+    TIME_CALLS(NegotiationVerifyCommit(sink32, 0x12345678), ns);
+    printf("verify         %10.1f ns per commitment\n", ns);
+    TIME_CALLS(CoinFlipLoop(sink32, 0x12345678), ns);
+    printf("loop parity    %10.1f ns per coin flip\n", ns);
+    TIME_CALLS(NegotiateCoinFlipWide(sink32, 0x12345678), ns);
+    printf("popcount       %10.1f ns per coin flip\n", ns);
+
+    NegotiationWideData first = 0, second = 0;
+    clock_t start = clock();
+    long tries = FindForgeablePair(&first, &second);
+    printf("forgeable strong commitment found after %ld commitments, %.0f ms: %08X and %08X\n",
+            tries, 1e3 * (clock() - start) / CLOCKS_PER_SEC, first, second);
+    return 0;
+}
+
+#endif
\ No newline at end of file
@@ -61,6 +61,83 @@ int NegotiationVerify(NegotiationData secret, NegotiationData commitment);
  */
 NegotiationOutcome NegotiateCoinFlip(NegotiationData A, NegotiationData B);
 
+/**
+ * The strong commitment (see MESSAGE_CAPABILITY_STRONG_COMMIT) is done on 32-bit packets.
+ */
+typedef uint32_t NegotiationWideData;
+
+/**
+ * The strong commitment is keyed with a public key as well, made of two 32-bit words:
+ */
+#define COMMIT_KEY_0 0x46454542 // "BEEF"
+#define COMMIT_KEY_1 0x54414F42 // "BOAT"
+
+/**
+ * This function commits to a 32-bit secret.  It computes HalfSipHash-2-4 of the secret's 4 bytes
+ * with the public key above, which takes a few dozen adds, rotates and XORs on 32-bit words and
+ * no multiplies, so it is cheap on the PIC32.
+ *
+ * Unlike the Beef hash, it has no algebra to invert it with (see NegotiationFindSecrets()).  The
+ * accepter would have to try all 2^32 secrets to learn A early, which is far out of reach during a
+ * game on the boards.  Binding is weaker: with a 32-bit commitment, two secrets of different
+ * parity that share one turn up after about 2^17 tries, so a challenger that searched for such a
+ * pair ahead of time on a PC can still choose the outcome.  A commitment to a random secret
+ * leaves it no choice, though, where almost every Beef hash does (see NegotiationIsForgeable()).
+ *
+ * @param secret        //A number that a challenger commits to
+ * @return commitment   //the commitment to send in the CHA message
+ */
+NegotiationWideData NegotiationCommit(NegotiationWideData secret);
+
+/**
+ * Detect cheating with the strong commitment, as NegotiationVerify() does for the Beef hash.  The
+ * comparison takes the same time whether or not, and wherever, the commitment differs.
+ *
+ * @param secret        //the previously secret number that the challenging agent has revealed
+ * @param commitment    //the commitment to the secret number
+ * @return TRUE if the commitment validates the revealed secret, FALSE otherwise
+ */
+int NegotiationVerifyCommit(NegotiationWideData secret, NegotiationWideData commitment);
+
+/**
+ * The coin flip for 32-bit packets, with the same rule as NegotiateCoinFlip(): HEADS if the
+ * parity of A XOR B is 1, TAILS otherwise.
+ */
+NegotiationOutcome NegotiateCoinFlipWide(NegotiationWideData A, NegotiationWideData B);
+
+/**
+ * The most secrets that can share a hash.  0xBEEF is 9 * 5431, a hash has at most 3 square roots
+ * modulo 9 and 2 modulo 5431, and each of the 6 roots modulo 0xBEEF can be reached from two
+ * 16-bit secrets.
+ */
+#define NEGOTIATION_MAX_SECRETS 12
+
+/**
+ * Inverts NegotiationHash().  The square roots modulo 9 come from a table, and those modulo the
+ * prime 5431 from a single modular exponentiation (5431 is 3 mod 4), so this takes the same
+ * short time for any hash instead of searching all 65536 secrets.
+ *
+ * It can be checked against the search, and timed along with NegotiationCommit(), on x86 by
+ * compiling with the NEGOTIATION_BENCHMARK macro.
+ * With gcc: `gcc Negotiation.c -DNEGOTIATION_BENCHMARK`
+ *
+ * @param hash          //a hash, as sent in a CHA message
+ * @param secrets       //filled with every secret that hashes to it, in increasing order,
+ *                          must have room for NEGOTIATION_MAX_SECRETS
+ * @return the number of secrets found, 0 if no secret has this hash
+ */
+int NegotiationFindSecrets(NegotiationData hash, NegotiationData *secrets);
+
+/**
+ * Detect a commitment the challenger could cheat with.  If secrets of both parities share the
+ * hash, the challenger can wait to see B and then reveal whichever one wins the coin flip, and
+ * NegotiationVerify() will accept it.
+ *
+ * @param commitment    //the hash the challenger committed to
+ * @return TRUE if the outcome of the coin flip was still the challenger's to choose, FALSE otherwise
+ */
+int NegotiationIsForgeable(NegotiationData commitment);
+
 
 /**
  * Extra credit: 
@@ -75,6 +152,14 @@ NegotiationOutcome NegotiateCoinFlip(NegotiationData A, NegotiationData B);
  *
  * You must state that you did this at the top of your README, and describe your 
  * strategy thoroughly.
+ *
+ * NegotiateGenerateBGivenHash() finds every secret the challenger may have committed to (see
+ * NegotiationFindSecrets()) and returns a random B that gives TAILS, so that the accepter goes
+ * first, against as many of them as possible.
+ *
+ * NegotiateGenerateAGivenB() returns a random A that gives HEADS against B, so that the
+ * challenger goes first.  It only helps a challenger that has not committed yet, or whose
+ * commitment is forgeable and has a secret like it (see NegotiationIsForgeable()).
  */
 NegotiationData NegotiateGenerateBGivenHash(NegotiationData hash_a);
 NegotiationData NegotiateGenerateAGivenB(NegotiationData B);
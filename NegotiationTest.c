@@ -81,8 +81,83 @@ int main() {
         printf("\tFailed NegotiateCoinFlip\n");
     }
     
+    // every secret found has to hash back, and the real one has to be among them
+    printf("\nTesting NegotiationFindSecrets()\n");
+    
+    NegotiationData secrets[NEGOTIATION_MAX_SECRETS];
+    int count = NegotiationFindSecrets(43182, secrets);
+    int i, found = FALSE, hashed = TRUE;
+    for (i = 0; i < count; i++) {
+        found |= (secrets[i] == 12345);
+        hashed &= (NegotiationHash(secrets[i]) == 43182);
+    }
+    if (count > 1 && found && hashed) {
+        printf("\tPassed NegotiationFindSecrets()\n");
+        iter++;
+    } else {
+        printf("\tFailed NegotiationFindSecrets()\n");
+    }
+    
+    // 2 is not a square modulo 5431, so nothing hashes to it
+    if (NegotiationFindSecrets(2, secrets) == 0) {
+        printf("\tPassed NegotiationFindSecrets() with no secrets\n");
+        iter++;
+    } else {
+        printf("\tFailed NegotiationFindSecrets()\n");
+    }
+    
+    // the hash of 3 is also the hash of 0xBEEF - 3, which has the other parity, while every
+    // secret that hashes like 118 has an odd number of ones
+    printf("\nTesting NegotiationIsForgeable()\n");
+    
+    if (NegotiationIsForgeable(9) == TRUE && NegotiationIsForgeable(2) == FALSE &&
+            NegotiationIsForgeable(NegotiationHash(118)) == FALSE) {
+        printf("\tPassed NegotiationIsForgeable()\n");
+        iter++;
+    } else {
+        printf("\tFailed NegotiationIsForgeable()\n");
+    }
+    
+    // cheating has to win the coin flip for the cheater, 5420 has the parity of most secrets
+    // that hash like it
+    printf("\nTesting cheating\n");
+    
+    if (NegotiateCoinFlip(5420, NegotiateGenerateBGivenHash(NegotiationHash(5420))) == TAILS &&
+            NegotiateCoinFlip(NegotiateGenerateAGivenB(cheat), cheat) == HEADS) {
+        printf("\tPassed NegotiateGenerateBGivenHash() and NegotiateGenerateAGivenB()\n");
+        iter++;
+    } else {
+        printf("\tFailed cheating\n");
+    }
+    
+    // the strong commitment has to be reproducible, and catch a single flipped bit
+    printf("\nTesting NegotiationCommit() and NegotiationVerifyCommit()\n");
+    
+    NegotiationWideData wideSecret = 12345;
+    if (NegotiationCommit(wideSecret) == 0x9E0299C0 &&
+            NegotiationVerifyCommit(wideSecret, 0x9E0299C0) == TRUE &&
+            NegotiationVerifyCommit(wideSecret ^ 0x80000000, 0x9E0299C0) == FALSE &&
+            NegotiationVerifyCommit(wideSecret, 0x9E0299C0 ^ 0x00010000) == FALSE) {
+        printf("\tPassed NegotiationCommit() and NegotiationVerifyCommit()\n");
+        iter++;
+    } else {
+        printf("\tFailed NegotiationCommit()\n");
+    }
+    
+    // the wide coin flip counts the high half's bits too
+    printf("\nTesting NegotiateCoinFlipWide()\n");
+    
+    if (NegotiateCoinFlipWide(0x80000000, 0) == HEADS &&
+            NegotiateCoinFlipWide(0x80000001, 0) == TAILS &&
+            NegotiateCoinFlipWide(0x0001FFFF, 0x00010000) == TAILS) {
+        printf("\tPassed NegotiateCoinFlipWide()\n");
+        iter++;
+    } else {
+        printf("\tFailed NegotiateCoinFlipWide()\n");
+    }
+    
     printf("\nDone testing!\n");
-    printf("\nFinal result: %d/7 tests passed!\n", iter);
+    printf("\nFinal result: %d/13 tests passed!\n", iter);
     
 
     while(1);
@@ -5,7 +5,9 @@
 #include <stdint.h>
 
 // Include Microchip C libraries.
+#ifdef PIC32
 #include <xc.h>
+#endif
 
 /**
  * Configure the port and pins for each of the 4 control signals used with the OLED:
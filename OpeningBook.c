@@ -0,0 +1,213 @@
+/*
+ * File:   OpeningBook.c
+ * Author: jwang456
+ *
+ * Purpose: Table of the first shots of a game
+ *
+ *
+ */
+#include "OpeningBook.h"
+
+#include <stdint.h>
+
+#include "BOARD.h"
+#include "Field.h"
+
+// the field and fleet the table was generated for
+#define OPENING_BOOK_ROWS 6
+#define OPENING_BOOK_COLS 10
+#define OPENING_BOOK_NUM_BOATS 4
+
+// the number of shots in the book, the table holding one for each run of hits and misses before
+#define OPENING_BOOK_DEPTH 8
+#define OPENING_BOOK_SIZE ((1 << OPENING_BOOK_DEPTH) - 1)
+
+#if FIELD_ROWS == OPENING_BOOK_ROWS && FIELD_COLS == OPENING_BOOK_COLS && \
+        FIELD_NUM_BOATS == OPENING_BOOK_NUM_BOATS
+#define OPENING_BOOK_FITS
+#endif
+
+#ifdef OPENING_BOOK_FITS
+/*
+ * Generated by compiling with OPENING_BOOK_GENERATE.  Entry n is the square, row * FIELD_COLS +
+ * col, shot once the shots so far have led to it: the first shot is entry 0, and the shot after
+ * entry n is entry 2n + 1 if it missed and 2n + 2 if it hit.
+ */
+static const uint8_t openingBookSizes[OPENING_BOOK_NUM_BOATS] = {3, 4, 5, 6};
+static const uint8_t openingBook[OPENING_BOOK_SIZE] = {
+    24, 35, 25, 13, 34, 34, 23, 46, 14, 25, 33, 22, 35, 26, 26,  5,
+    45, 23, 15, 37, 15, 36, 36,  4, 23, 14, 33, 34, 27, 22, 22, 54,
+     4, 36, 44, 11, 33, 12, 16, 45, 36, 45, 45, 25, 37, 32, 32, 13,
+     5, 32, 21, 44, 44, 14, 36, 35, 35, 34, 28, 34, 21, 27, 27, 17,
+    55,  7,  6, 47, 26, 47, 43, 46, 21,  3, 43, 23, 11, 12, 12, 13,
+    44, 27, 38, 27, 44, 14, 14, 44, 15, 26, 38, 25, 31, 37, 37, 46,
+    14,  3,  3,  4, 12, 32, 20, 22, 45, 15, 15, 36, 44, 32, 32,  4,
+    15, 14, 33, 36, 35, 34, 29, 35, 35, 34, 20, 34, 28, 21, 21, 42,
+    16, 52, 53, 15,  6,  3,  3,  5, 37, 56, 16, 36, 48, 47, 42,  5,
+    45, 12, 31, 21,  4,  3,  3, 46, 33, 22, 10, 23, 11, 17, 17,  6,
+    14, 46, 43, 45, 17, 27, 39, 36, 37, 55, 43,  5, 13, 44, 13, 55,
+    45, 45, 45, 25, 16, 27, 39, 23, 15, 22, 30, 26, 38, 31, 31, 55,
+    45, 23, 15, 14,  2,  6,  6, 12,  5, 42, 42, 33, 12, 31, 31, 33,
+    32, 54, 43,  4, 13, 45, 13, 44, 37, 15, 45, 14, 31, 37, 37, 15,
+     5, 45, 45, 44, 44, 14, 36, 35, 16, 14, 36, 37, 35, 34, 34, 33,
+    15, 14, 33, 32, 35, 34, 34, 36, 35, 34, 29, 34, 20, 28, 28,
+};
+#endif
+
+/**
+ * OpeningBookDecideGuess() looks up the next shot, if the game is still in the book.
+ *
+ * @param opp_field The opponent's field.
+ * @param guess Filled with the shot, the result parameter is irrelevant.
+ * @return TRUE if the shot was found, FALSE if the game has left the book.
+ */
+uint8_t OpeningBookDecideGuess(const Field *opp_field, GuessData *guess) {
+#ifdef OPENING_BOOK_FITS
+    uint8_t row, depth, known = 0;
+    uint16_t node = 0;
+
+    for (depth = 0; depth < FIELD_NUM_BOATS; depth++) {
+        if (fieldBoatSizes[depth] != openingBookSizes[depth]) {
+            return FALSE;
+        }
+    }
+    for (row = 0; row < FIELD_ROWS; row++) {
+        known += FIELD_COLS - FieldCountInRow(opp_field, row, FIELD_SQUARE_UNKNOWN);
+    }
+
+    // follow the book's shots by what they found, until one not taken yet
+    for (depth = 0; depth < OPENING_BOOK_DEPTH && known >= depth; depth++) {
+        uint8_t square = openingBook[node];
+        SquareStatus status = FIELD_SQUARE(opp_field, square / FIELD_COLS, square % FIELD_COLS);
+        if (status == FIELD_SQUARE_UNKNOWN) {
+            // any other square known means a shot the book did not make
+            if (known != depth) {
+                return FALSE;
+            }
+            guess->row = square / FIELD_COLS;
+            guess->col = square % FIELD_COLS;
+            guess->result = RESULT_MISS;
+            return TRUE;
+        } else if (status == FIELD_SQUARE_EMPTY) {
+            node = 2 * node + 1;
+        } else if (status == FIELD_SQUARE_HIT) {
+            node = 2 * node + 2;
+        } else {
+            return FALSE;
+        }
+    }
+#endif
+    return FALSE;
+}
+
+#ifdef OPENING_BOOK_GENERATE
+
+#include <stdio.h>
+
+#include "GuessEngine.h"
+
+static uint8_t book[OPENING_BOOK_SIZE];
+
+// fills in the engine's shot for a node of the book, and for the nodes after it
+static void Generate(const Field *opp, uint16_t node, uint8_t depth) {
+    if (depth == OPENING_BOOK_DEPTH) {
+        return;
+    }
+    GuessEngineBegin(opp);
+    while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+    GuessData guess = GuessEngineResult();
+    book[node] = guess.row * FIELD_COLS + guess.col;
+
+    Field next = *opp;
+    guess.result = RESULT_MISS;
+    FieldUpdateKnowledge(&next, &guess);
+    Generate(&next, 2 * node + 1, depth + 1);
+    next = *opp;
+    guess.result = RESULT_HIT;
+    FieldUpdateKnowledge(&next, &guess);
+    Generate(&next, 2 * node + 2, depth + 1);
+}
+
+int main(void) {
+    Field own, opp;
+    int i;
+
+    FieldInit(&own, &opp);
+    Generate(&opp, 0, 0);
+
+    printf("static const uint8_t openingBookSizes[OPENING_BOOK_NUM_BOATS] = {");
+    for (i = 0; i < FIELD_NUM_BOATS; i++) {
+        printf(i ? ", %d" : "%d", fieldBoatSizes[i]);
+    }
+    printf("};\nstatic const uint8_t openingBook[OPENING_BOOK_SIZE] = {");
+    for (i = 0; i < OPENING_BOOK_SIZE; i++) {
+        printf(i % 16 ? " %2d," : "\n    %2d,", book[i]);
+    }
+    printf("\n};\n");
+    return 0;
+}
+
+#endif
+
+#ifdef OPENING_BOOK_BENCHMARK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "Endgame.h"
+#include "GuessEngine.h"
+
+#define GAMES 1000
+
+// plays one game against a random placement, with or without the book
+static int PlayGame(uint8_t useBook, long *booked) {
+    Field own, opp;
+    FieldInit(&own, &opp);
+    FieldAIPlaceAllBoats(&own);
+    int shots = 0;
+    while (FieldGetBoatStates(&own)) {
+        GuessData guess;
+        if (useBook && OpeningBookDecideGuess(&opp, &guess)) {
+            (*booked)++;
+        } else if (!EndgameDecideGuess(&opp, ENDGAME_MAX_PLACEMENTS, &guess)) {
+            GuessEngineBegin(&opp);
+            while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+            guess = GuessEngineResult();
+        }
+        FieldRegisterEnemyAttack(&own, &guess);
+        FieldUpdateKnowledge(&opp, &guess);
+        shots++;
+    }
+    return shots;
+}
+
+int main(void) {
+    static int withoutBook[GAMES];
+    int useBook, game;
+
+    // the time per game includes playing it, which is the same whichever way it was decided
+    printf("book    mean shots    win rate    us per game    shots from book\n");
+    for (useBook = 0; useBook <= 1; useBook++) {
+        long shots = 0, booked = 0;
+        double wins = 0;
+        clock_t start = clock();
+        for (game = 0; game < GAMES; game++) {
+            srand(game);
+            int s = PlayGame(useBook, &booked);
+            if (!useBook) {
+                withoutBook[game] = s;
+            }
+            // against the same placement without the book, a tie is half a win
+            wins += (s < withoutBook[game]) + 0.5 * (s == withoutBook[game]);
+            shots += s;
+        }
+        double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+        printf("%4s    %10.2f    %7.1f%%    %11.2f    %14.2f\n", useBook ? "yes" : "no",
+                (double) shots / GAMES, 100.0 * wins / GAMES, 1e6 * seconds / GAMES,
+                (double) booked / GAMES);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef OPENING_BOOK_H
+#define OPENING_BOOK_H
+
+#include <stdint.h>
+#include "Field.h"
+
+/**
+ * The opening book holds the first shots of a game, which the guess engine would otherwise work
+ * out from scratch every game even though it knows nothing new.  It is a table in flash of the
+ * shot the engine takes for every run of hits and misses over the first eight shots,
+ * so a game stays in the book until a boat is sunk or a shot is taken that the book did not make.
+ *
+ * The table is generated for the standard field and fleet, and the book is left out for any
+ * other.  It is generated again, after a change to the field or the guess engine, by compiling
+ * with the OPENING_BOOK_GENERATE macro and pasting what it prints over the table.
+ * With gcc: `gcc <field AI sources> -DOPENING_BOOK_GENERATE`, see Field.h
+ *
+ * The time it saves can be measured on x86 by compiling with the OPENING_BOOK_BENCHMARK macro
+ * instead.
+ */
+
+/**
+ * OpeningBookDecideGuess() looks up the next shot, if the game is still in the book.
+ *
+ * @param opp_field The opponent's field.
+ * @param guess Filled with the shot, the result parameter is irrelevant.
+ * @return TRUE if the shot was found, FALSE if the game has left the book.
+ */
+uint8_t OpeningBookDecideGuess(const Field *opp_field, GuessData *guess);
+
+#endif // OPENING_BOOK_H
@@ -0,0 +1,133 @@
+#ifndef OPPONENT_MODEL_H
+#define OPPONENT_MODEL_H
+
+#include <stdint.h>
+#include "Field.h"
+
+/**
+ * The opponent model remembers, from one game to the next, where the opponent put its boats and
+ * in what order it shot at ours.  Every game starts with nothing known about the opponent's
+ * field, but an opponent that places its boats by a fixed strategy puts them on some squares
+ * more often than others, and one that shoots by a fixed strategy reaches some squares sooner.
+ *
+ * At the end of a game the opponent's field is folded in: a square with a hit on it counts as a
+ * boat, one we missed as empty, and one we never shot as empty only if every boat was sunk, since
+ * then every boat square was hit.  Each square keeps how often it has held a boat out of how often
+ * it has been seen, and the mean turn it was shot at by the opponent, a square it never shot
+ * counting as shot after every other.  Both are averaged with a decay, by
+ * OPPONENT_MODEL_DECAY_SHIFT, so that games long past fade and a change of strategy is followed.
+ *
+ * The boat counts become a prior for the guess engine, see GuessEngineSetPrior(): each square's
+ * factor is how much more often it has held a boat than it would if the boats were placed
+ * anywhere they fit, which the density already counts on.  Over the games remembered the rates
+ * also differ by chance, and a prior made of chance costs games, so the factors are pulled
+ * towards 1 by the share of their spread that chance would explain.  Against an opponent that
+ * places its boats anywhere they stay near 1.  While the model has anything in it the field AI
+ * leaves the opening book, which is for boats placed anywhere, to the prior.
+ *
+ * The shot turns score a layout by how late the opponent reaches each of its boats, and
+ * FieldAIPlaceAllBoats() keeps the best scoring of a few layouts.
+ *
+ * The model can be saved, on the PIC32 to a page of flash that keeps it over a reset, and on a
+ * host to the file OPPONENT_MODEL_FILE.  The agent only keeps it in flash on the PIC32 with
+ * OPPONENT_MODEL_FLASH set, and then saves it only every few games, see OPPONENT_MODEL_SAVE_EVERY.
+ *
+ * How much the model wins against an opponent with a fixed strategy, the field AI itself, can be
+ * measured on x86 by compiling with the OPPONENT_MODEL_BENCHMARK macro.
+ * With gcc: `gcc <field AI sources> -DOPPONENT_MODEL_BENCHMARK`, see Field.h
+ */
+
+/**
+ * Each game's weight in the model shrinks by 1 / 2^OPPONENT_MODEL_DECAY_SHIFT every game after
+ * it, so the model remembers about that many games.  A longer memory is steadier, but is slower
+ * to follow an opponent that changes.  No more than 7.
+ */
+#ifndef OPPONENT_MODEL_DECAY_SHIFT
+#define OPPONENT_MODEL_DECAY_SHIFT 7
+#endif
+
+/**
+ * How many layouts FieldAIPlaceAllBoats() draws to keep the best of, once there is a model.
+ */
+#ifndef OPPONENT_MODEL_LAYOUTS
+#define OPPONENT_MODEL_LAYOUTS 8
+#endif
+
+/**
+ * With OPPONENT_MODEL_FLASH set to 1, the agent on the PIC32 loads the model from flash when the
+ * board starts up, and saves it there.  It is 0 by default, as the erase and write sequence has
+ * not been checked on a board yet, and the model is then kept in RAM only.
+ */
+#ifndef OPPONENT_MODEL_FLASH
+#define OPPONENT_MODEL_FLASH 0
+#endif
+
+/**
+ * With OPPONENT_MODEL_FLASH, the agent saves the model once every OPPONENT_MODEL_SAVE_EVERY
+ * games, from the end screen once the link layer has nothing left in flight.  The PIC32MX flash
+ * is rated for at least 1000 erase/write cycles of a page, so saving after every game could wear
+ * the page out within 1000 games, and every 8 games lasts at least 8000.  The games since the
+ * last save are lost if the board is switched off.
+ */
+#ifndef OPPONENT_MODEL_SAVE_EVERY
+#define OPPONENT_MODEL_SAVE_EVERY 8
+#endif
+
+/**
+ * The file the model is saved to and loaded from on a host.
+ */
+#ifndef OPPONENT_MODEL_FILE
+#define OPPONENT_MODEL_FILE "opponent_model.bin"
+#endif
+
+/**
+ * OpponentModelRecordShot() notes a shot the opponent took at our field this game.  Shots are
+ * numbered in the order they are recorded.
+ *
+ * @param opp_guess The opponent's shot.
+ */
+void OpponentModelRecordShot(const GuessData *opp_guess);
+
+/**
+ * OpponentModelEndGame() folds a finished game into the model, and sets the guess engine's prior
+ * from it.  The shots recorded are forgotten, ready for the next game.
+ *
+ * @param opp_field The opponent's field, as we knew it at the end of the game.
+ */
+void OpponentModelEndGame(const Field *opp_field);
+
+/**
+ * @return The prior the guess engine is given, a factor for each square in units of
+ *         GUESS_ENGINE_PRIOR_ONE, or NULL until a game has been folded in.
+ */
+const uint8_t *OpponentModelPrior(void);
+
+/**
+ * OpponentModelLayoutScore() scores a layout by how late the opponent has reached its boats.
+ *
+ * @param own_field A field with every boat placed.
+ * @return The sum over the boats of the earliest mean turn any of its squares was shot at, in
+ *         1/16ths of a turn, higher being later.  0 until a game has been folded in.
+ */
+uint32_t OpponentModelLayoutScore(const Field *own_field);
+
+/**
+ * OpponentModelLoad() replaces the model with the one saved, and sets the guess engine's prior
+ * from it.
+ *
+ * @return SUCCESS, or STANDARD_ERROR if there is none saved for this field and fleet, in which
+ *         case the model is left as it was.
+ */
+uint8_t OpponentModelLoad(void);
+
+/**
+ * OpponentModelSave() saves the model.  On the PIC32 this erases and writes a page of flash with
+ * interrupts off, which takes about 20ms and wears the page, see OPPONENT_MODEL_SAVE_EVERY, so it
+ * should only be done while nothing is arriving on the UART.  Nothing is written if the page
+ * already holds the model.
+ *
+ * @return SUCCESS, or STANDARD_ERROR if it could not be written.
+ */
+uint8_t OpponentModelSave(void);
+
+#endif // OPPONENT_MODEL_H
@@ -0,0 +1,545 @@
+/*
+ * File:   PlacementSampler.c
+ * Author: jwang456
+ *
+ * Purpose: Monte Carlo sampling of fleet placements for the field AI
+ *
+ *
+ */
+#include "PlacementSampler.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "BOARD.h"
+#include "Field.h"
+#include "GuessEngine.h"
+
+#define NUM_DIRS 2
+
+// the distance between columns in a bitboard laid out column by column
+#define COL_STRIDE FIELD_BITBOARD_BIT_BY_COL(0, 1)
+
+struct PlacementSampler {
+    const Field *field;
+    // the boats still afloat, largest first
+    uint8_t boats[FIELD_NUM_BOATS];
+    uint8_t numBoats;
+    // the squares a boat can cover and the known hits, laid out by row for boats facing east and
+    // by column for boats facing south, see FieldBitboard
+    FieldBitboard open[NUM_DIRS];
+    FieldBitboard hits[NUM_DIRS];
+    // the squares each boat afloat can start from without leaving the field
+    FieldBitboard edge[FIELD_NUM_BOATS][NUM_DIRS];
+    // whether the boats afloat have to cover every hit
+    uint8_t covering;
+    uint16_t samples;
+    uint16_t maxSamples;
+    uint32_t draws;
+    // the weight of the samples, in all and covering each square, and the best square's weight
+    // scaled by the prior, if there is one
+    float weight;
+    float occupancy[FIELD_SQUARES];
+    float bestScore;
+    GuessData best;
+    const uint8_t *prior;
+};
+
+static struct PlacementSampler sampler;
+
+// the squares the boat at position i of the boats afloat can start from facing a direction,
+// without overlapping another boat or lying on hits alone, which would have sunk it
+static void PlacementSamplerStarts(uint8_t i, uint8_t dir, const FieldBitboard *occupied,
+        FieldBitboard *starts) {
+    uint8_t length = fieldBoatSizes[sampler.boats[i]], j;
+    int w;
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        // a run never crosses into the next word from a square it can start from
+        uint64_t free = sampler.open[dir].words[w] & ~occupied[dir].words[w];
+        uint64_t hits = sampler.hits[dir].words[w] & free;
+        uint64_t fits = sampler.edge[i][dir].words[w], allHits = fits;
+        for (j = 0; j < length; j++) {
+            fits &= free >> j;
+            allHits &= hits >> j;
+        }
+        starts->words[w] = fits & ~allHits;
+    }
+}
+
+// puts the boat at position i down from a square of its starts
+static void PlacementSamplerPlace(uint8_t i, uint8_t dir, uint16_t start,
+        FieldBitboard *occupied) {
+    uint8_t length = fieldBoatSizes[sampler.boats[i]], j;
+    uint8_t dRow = (dir == FIELD_DIR_SOUTH), dCol = (dir == FIELD_DIR_EAST);
+    uint8_t row = dCol ? FIELD_BITBOARD_ROW(start) : start % COL_STRIDE;
+    uint8_t col = dCol ? FIELD_BITBOARD_COL(start) : start / COL_STRIDE;
+    for (j = 0; j < length; j++) {
+        FIELD_BITBOARD_SET(&occupied[FIELD_DIR_EAST],
+                FIELD_BITBOARD_BIT(row + dRow * j, col + dCol * j));
+        FIELD_BITBOARD_SET(&occupied[FIELD_DIR_SOUTH],
+                FIELD_BITBOARD_BIT_BY_COL(row + dRow * j, col + dCol * j));
+    }
+}
+
+// the square of the k-th start, counting from the lowest
+static uint16_t PlacementSamplerPick(const FieldBitboard *starts, uint16_t k) {
+    int w;
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        uint64_t bits = starts->words[w];
+        uint8_t count = __builtin_popcountll(bits);
+        if (k >= count) {
+            k -= count;
+            continue;
+        }
+        for (; k; k--) {
+            bits &= bits - 1;
+        }
+        return w * 64 + __builtin_ctzll(bits);
+    }
+    return 0;
+}
+
+static uint16_t PlacementSamplerCount(const FieldBitboard *starts) {
+    uint16_t count = 0;
+    int w;
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        count += __builtin_popcountll(starts->words[w]);
+    }
+    return count;
+}
+
+// draws a placement of the boats afloat, and adds it to the occupancy if it fits
+static void PlacementSamplerDraw(void) {
+    FieldBitboard occupied[NUM_DIRS] = {{{0}}}, starts[FIELD_NUM_BOATS][NUM_DIRS];
+    uint16_t counts[FIELD_NUM_BOATS][NUM_DIRS];
+    uint8_t placed = 0, i, dir;
+    float weight = 1;
+    int w;
+
+    sampler.draws++;
+    while (sampler.covering) {
+        // the first hit not covered yet
+        for (w = 0; w < FIELD_BITBOARD_WORDS &&
+                !(sampler.hits[FIELD_DIR_EAST].words[w] & ~occupied[FIELD_DIR_EAST].words[w]);
+                w++);
+        if (w == FIELD_BITBOARD_WORDS) {
+            break;
+        }
+        uint16_t bit = w * 64 + __builtin_ctzll(sampler.hits[FIELD_DIR_EAST].words[w] &
+                ~occupied[FIELD_DIR_EAST].words[w]);
+        uint8_t row = FIELD_BITBOARD_ROW(bit), col = FIELD_BITBOARD_COL(bit);
+
+        // every boat left that can cover it, from a start at most its length before it
+        uint16_t total = 0;
+        for (i = 0; i < sampler.numBoats; i++) {
+            if (placed & (1 << i)) {
+                continue;
+            }
+            uint8_t back = fieldBoatSizes[sampler.boats[i]] - 1;
+            for (dir = 0; dir < NUM_DIRS; dir++) {
+                uint16_t last = dir == FIELD_DIR_EAST ? bit : FIELD_BITBOARD_BIT_BY_COL(row, col);
+                uint16_t first = dir == FIELD_DIR_EAST ?
+                        FIELD_BITBOARD_BIT(row, col > back ? col - back : 0) :
+                        FIELD_BITBOARD_BIT_BY_COL(row > back ? row - back : 0, col);
+                PlacementSamplerStarts(i, dir, occupied, &starts[i][dir]);
+                for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+                    if (w != last >> 6) {
+                        starts[i][dir].words[w] = 0;
+                    }
+                }
+                starts[i][dir].words[last >> 6] &= ((((uint64_t) 2 << (last & 63)) - 1) >>
+                        (first & 63)) << (first & 63);
+                counts[i][dir] = PlacementSamplerCount(&starts[i][dir]);
+                total += counts[i][dir];
+            }
+        }
+        if (total == 0) {
+            return;
+        }
+
+        uint16_t k = rand() % total;
+        for (i = 0; i < sampler.numBoats; i++) {
+            if (placed & (1 << i)) {
+                continue;
+            }
+            for (dir = 0; dir < NUM_DIRS && k >= counts[i][dir]; dir++) {
+                k -= counts[i][dir];
+            }
+            if (dir < NUM_DIRS) {
+                break;
+            }
+        }
+        PlacementSamplerPlace(i, dir, PlacementSamplerPick(&starts[i][dir], k), occupied);
+        placed |= 1 << i;
+        weight *= total;
+    }
+
+    // the rest in order, anywhere they fit
+    for (i = 0; i < sampler.numBoats; i++) {
+        if (placed & (1 << i)) {
+            continue;
+        }
+        PlacementSamplerStarts(i, FIELD_DIR_EAST, occupied, &starts[i][FIELD_DIR_EAST]);
+        PlacementSamplerStarts(i, FIELD_DIR_SOUTH, occupied, &starts[i][FIELD_DIR_SOUTH]);
+        uint16_t east = PlacementSamplerCount(&starts[i][FIELD_DIR_EAST]);
+        uint16_t total = east + PlacementSamplerCount(&starts[i][FIELD_DIR_SOUTH]);
+        if (total == 0) {
+            return;
+        }
+        uint16_t k = rand() % total;
+        dir = k < east ? FIELD_DIR_EAST : FIELD_DIR_SOUTH;
+        PlacementSamplerPlace(i, dir, PlacementSamplerPick(&starts[i][dir], k < east ? k :
+                k - east), occupied);
+        weight *= total;
+    }
+
+    // every unknown square the fleet covers
+    sampler.samples++;
+    sampler.weight += weight;
+    for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+        uint64_t bits = occupied[FIELD_DIR_EAST].words[w] & ~sampler.hits[FIELD_DIR_EAST].words[w];
+        for (; bits; bits &= bits - 1) {
+            uint16_t bit = w * 64 + __builtin_ctzll(bits);
+            uint8_t row = FIELD_BITBOARD_ROW(bit), col = FIELD_BITBOARD_COL(bit);
+            float *occupancy = &sampler.occupancy[row * FIELD_COLS + col];
+            *occupancy += weight;
+            float score = sampler.prior ? *occupancy * sampler.prior[row * FIELD_COLS + col] :
+                    *occupancy;
+            if (score > sampler.bestScore) {
+                sampler.bestScore = score;
+                sampler.best.row = row;
+                sampler.best.col = col;
+            }
+        }
+    }
+}
+
+/**
+ * PlacementSamplerBegin() starts sampling a new field.  The field must not change until the
+ * sampling is done or abandoned.  Until a sample is taken, the result is a random square that
+ * has not been guessed.
+ *
+ * @param opp_field The opponent's field.
+ * @param max_samples The number of samples to take before the sampling is done.
+ */
+void PlacementSamplerBegin(const Field *opp_field, uint16_t max_samples) {
+    uint8_t placed[FIELD_NUM_BOATS] = {0};
+    uint8_t boat, row, col, dir;
+    int i, w;
+
+    sampler.field = opp_field;
+    sampler.maxSamples = max_samples;
+    sampler.samples = 0;
+    sampler.draws = 0;
+    sampler.weight = 0;
+    sampler.bestScore = 0;
+    sampler.prior = GuessEngineGetPrior();
+    for (i = 0; i < FIELD_SQUARES; i++) {
+        sampler.occupancy[i] = 0;
+    }
+
+    // one pass over the field for the squares boats can cover and the squares of sunk boats
+    for (dir = 0; dir < NUM_DIRS; dir++) {
+        for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+            sampler.open[dir].words[w] = 0;
+            sampler.hits[dir].words[w] = 0;
+        }
+    }
+    for (row = 0; row < FIELD_ROWS; row++) {
+        for (col = 0; col < FIELD_COLS; col++) {
+            SquareStatus s = FIELD_SQUARE(opp_field, row, col);
+            if (s == FIELD_SQUARE_HIT) {
+                FIELD_BITBOARD_SET(&sampler.hits[FIELD_DIR_EAST], FIELD_BITBOARD_BIT(row, col));
+                FIELD_BITBOARD_SET(&sampler.hits[FIELD_DIR_SOUTH],
+                        FIELD_BITBOARD_BIT_BY_COL(row, col));
+            } else if (FIELD_SQUARE_IS_BOAT(s)) {
+                placed[FIELD_SQUARE_BOAT_TYPE(s)]++;
+            }
+            if (s == FIELD_SQUARE_HIT || s == FIELD_SQUARE_UNKNOWN) {
+                FIELD_BITBOARD_SET(&sampler.open[FIELD_DIR_EAST], FIELD_BITBOARD_BIT(row, col));
+                FIELD_BITBOARD_SET(&sampler.open[FIELD_DIR_SOUTH],
+                        FIELD_BITBOARD_BIT_BY_COL(row, col));
+            }
+        }
+    }
+
+    sampler.numBoats = 0;
+    sampler.covering = TRUE;
+    for (boat = 0; boat < FIELD_NUM_BOATS; boat++) {
+        uint8_t length = fieldBoatSizes[boat];
+        if (opp_field->boatLives[boat] == 0) {
+            sampler.covering &= (placed[boat] == length);
+            continue;
+        }
+        for (i = sampler.numBoats++; i > 0 && fieldBoatSizes[sampler.boats[i - 1]] < length;
+                i--) {
+            sampler.boats[i] = sampler.boats[i - 1];
+        }
+        sampler.boats[i] = boat;
+    }
+    for (i = 0; i < sampler.numBoats; i++) {
+        uint8_t length = fieldBoatSizes[sampler.boats[i]];
+        for (w = 0; w < FIELD_BITBOARD_WORDS; w++) {
+            sampler.edge[i][FIELD_DIR_EAST].words[w] = 0;
+            sampler.edge[i][FIELD_DIR_SOUTH].words[w] = 0;
+        }
+        for (row = 0; row < FIELD_ROWS; row++) {
+            for (col = 0; col < FIELD_COLS; col++) {
+                if (col + length <= FIELD_COLS) {
+                    FIELD_BITBOARD_SET(&sampler.edge[i][FIELD_DIR_EAST],
+                            FIELD_BITBOARD_BIT(row, col));
+                }
+                if (row + length <= FIELD_ROWS) {
+                    FIELD_BITBOARD_SET(&sampler.edge[i][FIELD_DIR_SOUTH],
+                            FIELD_BITBOARD_BIT_BY_COL(row, col));
+                }
+            }
+        }
+    }
+
+    // start from a random square and take the first one that has not been guessed
+    int start = rand() % FIELD_SQUARES;
+    sampler.best.row = start / FIELD_COLS;
+    sampler.best.col = start % FIELD_COLS;
+    sampler.best.result = RESULT_MISS;
+    for (i = 0; i < FIELD_SQUARES; i++) {
+        int j = (start + i) % FIELD_SQUARES;
+        if (FIELD_SQUARE(opp_field, j / FIELD_COLS, j % FIELD_COLS) == FIELD_SQUARE_UNKNOWN) {
+            sampler.best.row = j / FIELD_COLS;
+            sampler.best.col = j % FIELD_COLS;
+            break;
+        }
+    }
+}
+
+/**
+ * PlacementSamplerStep() continues sampling.
+ *
+ * @param budget The maximum number of samples to draw, rejected ones included.
+ * @return TRUE if max_samples have been taken, FALSE if there is more work to do.
+ */
+uint8_t PlacementSamplerStep(uint16_t budget) {
+    while (budget-- > 0 && sampler.samples < sampler.maxSamples) {
+        PlacementSamplerDraw();
+    }
+    return PlacementSamplerIsDone();
+}
+
+/**
+ * @return TRUE if max_samples have been taken, FALSE otherwise.
+ */
+uint8_t PlacementSamplerIsDone(void) {
+    return sampler.samples >= sampler.maxSamples;
+}
+
+/**
+ * @return The square covered most often so far, scaled by the prior.  The result parameter is
+ *         irrelevant.
+ */
+GuessData PlacementSamplerResult(void) {
+    return sampler.best;
+}
+
+/**
+ * PlacementSamplerResults() picks several different squares to shoot at once.  The first is
+ * PlacementSamplerResult(), the others are the next most often covered squares so far, scaled
+ * by the prior.
+ *
+ * @param guesses Filled with the guesses, result parameters are irrelevant.
+ * @param count The number of guesses wanted.
+ * @return The number of guesses filled in, less than count if there are not enough squares left.
+ */
+uint8_t PlacementSamplerResults(GuessData *guesses, uint8_t count) {
+    uint8_t found = 0;
+    if (count == 0 || FIELD_SQUARE(sampler.field, sampler.best.row, sampler.best.col) !=
+            FIELD_SQUARE_UNKNOWN) {
+        return 0;
+    }
+    guesses[found++] = sampler.best;
+
+    // take the most often covered squares not already picked, scaled by the prior if there is
+    // one, ties going to the first one
+    while (found < count) {
+        float bestScore = -1;
+        uint8_t row, col, i;
+        for (row = 0; row < FIELD_ROWS; row++) {
+            for (col = 0; col < FIELD_COLS; col++) {
+                uint16_t square = row * FIELD_COLS + col;
+                float score = sampler.occupancy[square] *
+                        (sampler.prior ? sampler.prior[square] : 1);
+                if (FIELD_SQUARE(sampler.field, row, col) != FIELD_SQUARE_UNKNOWN ||
+                        score <= bestScore) {
+                    continue;
+                }
+                for (i = 0; i < found; i++) {
+                    if (guesses[i].row == row && guesses[i].col == col) break;
+                }
+                if (i == found) {
+                    bestScore = score;
+                    guesses[found].row = row;
+                    guesses[found].col = col;
+                    guesses[found].result = RESULT_MISS;
+                }
+            }
+        }
+        if (bestScore < 0) break;
+        found++;
+    }
+    return found;
+}
+
+/**
+ * PlacementSamplerFrequency() reads how often a square has been covered so far.
+ *
+ * @param row The square's row.
+ * @param col The square's column.
+ * @return The weighted share of the samples that cover the square, from 0 to 1, or 0 before a
+ *         sample is taken.
+ */
+float PlacementSamplerFrequency(uint8_t row, uint8_t col) {
+    if (sampler.weight == 0) {
+        return 0;
+    }
+    return sampler.occupancy[row * FIELD_COLS + col] / sampler.weight;
+}
+
+/**
+ * PlacementSamplerStats() reports the work done since PlacementSamplerBegin().
+ *
+ * @param samples Set to the number of samples taken.
+ * @param draws Set to the number of samples drawn, rejected ones included.
+ */
+void PlacementSamplerStats(uint16_t *samples, uint32_t *draws) {
+    *samples = sampler.samples;
+    *draws = sampler.draws;
+}
+
+#ifdef PLACEMENT_SAMPLER_BENCHMARK
+
+#include <stdio.h>
+#include <time.h>
+
+#define POSITIONS 10
+#define REFERENCE_SAMPLES 60000
+#define GAMES 200
+
+static const uint16_t sampleCounts[] = {16, 64, 256, 1024, 4096, 16384};
+#define NUM_SAMPLE_COUNTS (sizeof (sampleCounts) / sizeof (sampleCounts[0]))
+static const uint8_t depths[] = {0, 10, 20};
+#define NUM_DEPTHS (sizeof (depths) / sizeof (depths[0]))
+
+// plays the first shots of a game with the guess engine, leaving what is known in opp
+static uint8_t PlayShots(Field *own, Field *opp, uint8_t shots) {
+    FieldInit(own, opp);
+    FieldAIPlaceAllBoats(own);
+    while (shots-- > 0 && FieldGetBoatStates(own)) {
+        GuessEngineBegin(opp);
+        while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+        GuessData guess = GuessEngineResult();
+        FieldRegisterEnemyAttack(own, &guess);
+        FieldUpdateKnowledge(opp, &guess);
+    }
+    return FieldGetBoatStates(own) != 0;
+}
+
+// plays one game against a random placement, with the sampler if given a number of samples
+static int PlayGame(uint16_t samples) {
+    Field own, opp;
+    FieldInit(&own, &opp);
+    FieldAIPlaceAllBoats(&own);
+    int shots = 0;
+    while (FieldGetBoatStates(&own)) {
+        GuessData guess;
+        if (samples) {
+            PlacementSamplerBegin(&opp, samples);
+            // a budget of draws too, in case nothing fits
+            PlacementSamplerStep(UINT16_MAX);
+            guess = PlacementSamplerResult();
+        } else {
+            GuessEngineBegin(&opp);
+            while (!GuessEngineStep(GUESS_ENGINE_MAX_PLACEMENTS));
+            guess = GuessEngineResult();
+        }
+        FieldRegisterEnemyAttack(&own, &guess);
+        FieldUpdateKnowledge(&opp, &guess);
+        shots++;
+    }
+    return shots;
+}
+
+int main(void) {
+    static float reference[FIELD_SQUARES];
+    double error[NUM_SAMPLE_COUNTS][NUM_DEPTHS] = {{0}}, seconds[NUM_SAMPLE_COUNTS] = {0};
+    long taken[NUM_SAMPLE_COUNTS] = {0}, drawn[NUM_SAMPLE_COUNTS] = {0};
+    int d, i, p, row, col;
+
+    // the mean difference from a long run of the share of samples covering each unknown square,
+    // on fields from the start of a game and after some shots by the guess engine
+    srand(1);
+    for (d = 0; d < NUM_DEPTHS; d++) {
+        for (p = 0; p < POSITIONS; p++) {
+            Field own, opp;
+            while (!PlayShots(&own, &opp, depths[d]));
+            PlacementSamplerBegin(&opp, REFERENCE_SAMPLES);
+            while (!PlacementSamplerStep(UINT16_MAX));
+            int unknown = 0;
+            for (row = 0; row < FIELD_ROWS; row++) {
+                for (col = 0; col < FIELD_COLS; col++) {
+                    reference[row * FIELD_COLS + col] = PlacementSamplerFrequency(row, col);
+                    unknown += FieldGetSquareStatus(&opp, row, col) == FIELD_SQUARE_UNKNOWN;
+                }
+            }
+            for (i = 0; i < NUM_SAMPLE_COUNTS; i++) {
+                uint16_t samples;
+                uint32_t draws;
+                clock_t start = clock();
+                PlacementSamplerBegin(&opp, sampleCounts[i]);
+                while (!PlacementSamplerStep(UINT16_MAX));
+                seconds[i] += (double) (clock() - start) / CLOCKS_PER_SEC;
+                PlacementSamplerStats(&samples, &draws);
+                taken[i] += samples;
+                drawn[i] += draws;
+                double sum = 0;
+                for (row = 0; row < FIELD_ROWS; row++) {
+                    for (col = 0; col < FIELD_COLS; col++) {
+                        if (FieldGetSquareStatus(&opp, row, col) == FIELD_SQUARE_UNKNOWN) {
+                            double e = PlacementSamplerFrequency(row, col) -
+                                    reference[row * FIELD_COLS + col];
+                            sum += e < 0 ? -e : e;
+                        }
+                    }
+                }
+                error[i][d] += sum / unknown / POSITIONS;
+            }
+        }
+    }
+    printf("samples    mean error after 0 / 10 / 20 shots    us per sample    samples kept\n");
+    for (i = 0; i < NUM_SAMPLE_COUNTS; i++) {
+        printf("%7u    %10.4f %10.4f %10.4f    %13.2f    %11.1f%%\n", sampleCounts[i],
+                error[i][0], error[i][1], error[i][2], 1e6 * seconds[i] / taken[i],
+                100.0 * taken[i] / drawn[i]);
+    }
+
+    // shots to win on a sample budget, against the guess engine on the same placements
+    static const uint16_t budgets[] = {0, 64, 256, 1024};
+    printf("\nsamples per shot    mean shots to win    us per shot\n");
+    for (i = 0; i < sizeof (budgets) / sizeof (budgets[0]); i++) {
+        long shots = 0;
+        int game;
+        clock_t start = clock();
+        for (game = 0; game < GAMES; game++) {
+            srand(game);
+            shots += PlayGame(budgets[i]);
+        }
+        double micros = 1e6 * (clock() - start) / CLOCKS_PER_SEC / shots;
+        if (budgets[i]) {
+            printf("%16u", budgets[i]);
+        } else {
+            printf("    guess engine");
+        }
+        printf("    %17.2f    %11.2f\n", (double) shots / GAMES, micros);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef PLACEMENT_SAMPLER_H
+#define PLACEMENT_SAMPLER_H
+
+#include <stdint.h>
+#include "Field.h"
+
+/**
+ * The placement sampler decides a shot by drawing random placements of the whole fleet that are
+ * consistent with what we know about the opponent's field, and shooting the unknown square that
+ * is covered most often.  The guess engine counts each boat's placements on its own, and listing
+ * the placements of the fleet together, as the endgame solver does, takes far too long on a
+ * larger field with many boats afloat.  Sampling them costs the same per sample however many
+ * there are.
+ *
+ * A sample is drawn one boat at a time.  While a known hit is not covered, one of the boats left
+ * is placed over the first such hit, picked evenly from every boat and placement that fits there.
+ * Once every hit is covered the rest are placed in order, each evenly among the placements that
+ * fit around those already placed.  A sample that gets stuck is rejected.  Since each sample can
+ * only be drawn one way, weighting it by the product of the number of choices at each step makes
+ * every placement of the fleet count the same.
+ *
+ * Nothing has to cover the hits while a sunk boat has squares that have not been placed, since
+ * the hits left over could belong to it.  Boats are then placed in order and can cover hits, but
+ * do not have to.
+ *
+ * The work is split into steps like the guess engine's, so it can be run against a clock in the
+ * same way.  The field AI and the agent search with it in place of the guess engine when
+ * FIELD_AI_SAMPLES is set, see Field.h, and like the guess engine's density, how often a square
+ * is covered is scaled by the guess engine's prior, see GuessEngineSetPrior(), to pick the shot.
+ * How fast the frequencies converge, and how well it plays on a sample budget against the guess
+ * engine, can be measured on x86 by compiling with the PLACEMENT_SAMPLER_BENCHMARK macro.
+ * With gcc: `gcc <field AI sources> -DPLACEMENT_SAMPLER_BENCHMARK`, see Field.h
+ */
+
+/**
+ * PlacementSamplerBegin() starts sampling a new field.  The field must not change until the
+ * sampling is done or abandoned.  Until a sample is taken, the result is a random square that
+ * has not been guessed.
+ *
+ * @param opp_field The opponent's field.
+ * @param max_samples The number of samples to take before the sampling is done.
+ */
+void PlacementSamplerBegin(const Field *opp_field, uint16_t max_samples);
+
+/**
+ * PlacementSamplerStep() continues sampling.
+ *
+ * @param budget The maximum number of samples to draw, rejected ones included.
+ * @return TRUE if max_samples have been taken, FALSE if there is more work to do.
+ */
+uint8_t PlacementSamplerStep(uint16_t budget);
+
+/**
+ * @return TRUE if max_samples have been taken, FALSE otherwise.
+ */
+uint8_t PlacementSamplerIsDone(void);
+
+/**
+ * @return The square covered most often so far, scaled by the prior.  The result parameter is
+ *         irrelevant.
+ */
+GuessData PlacementSamplerResult(void);
+
+/**
+ * PlacementSamplerResults() picks several different squares to shoot at once.  The first is
+ * PlacementSamplerResult(), the others are the next most often covered squares so far, scaled
+ * by the prior.
+ *
+ * @param guesses Filled with the guesses, result parameters are irrelevant.
+ * @param count The number of guesses wanted.
+ * @return The number of guesses filled in, less than count if there are not enough squares left.
+ */
+uint8_t PlacementSamplerResults(GuessData *guesses, uint8_t count);
+
+/**
+ * PlacementSamplerFrequency() reads how often a square has been covered so far.
+ *
+ * @param row The square's row.
+ * @param col The square's column.
+ * @return The weighted share of the samples that cover the square, from 0 to 1, or 0 before a
+ *         sample is taken.
+ */
+float PlacementSamplerFrequency(uint8_t row, uint8_t col);
+
+/**
+ * PlacementSamplerStats() reports the work done since PlacementSamplerBegin().
+ *
+ * @param samples Set to the number of samples taken.
+ * @param draws Set to the number of samples drawn, rejected ones included.
+ */
+void PlacementSamplerStats(uint16_t *samples, uint32_t *draws);
+
+#endif // PLACEMENT_SAMPLER_H
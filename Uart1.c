@@ -1,4 +1,5 @@
 #include "CircularBuffer.h"
+#include "LinkStats.h"
 #include "Uart1.h"
 
 //CSE13E Support Library
@@ -8,9 +9,9 @@
 #include <sys/attribs.h>
 
 static CircularBuffer uart1RxBuffer;
-static uint8_t u1RxBuf[1024];
+static uint8_t u1RxBuf[UART1_RX_BUFFER_SIZE];
 static CircularBuffer uart1TxBuffer;
-static uint8_t u1TxBuf[1024];
+static uint8_t u1TxBuf[UART1_TX_BUFFER_SIZE];
 
 /*
  * Private functions.
@@ -72,6 +73,11 @@ uint8_t Uart1HasData(void)
     return (uart1RxBuffer.dataSize > 0);
 }
 
+uint16_t Uart1TxSpace(void)
+{
+    return uart1TxBuffer.staticSize - uart1TxBuffer.dataSize;
+}
+
 /**
  * This function actually initiates transmission. It
  * attempts to start transmission with the first element
@@ -102,7 +108,12 @@ int Uart1ReadByte(uint8_t *datum)
  */
 void Uart1WriteByte(uint8_t datum)
 {
-    CB_WriteByte(&uart1TxBuffer, datum);
+    if (CB_WriteByte(&uart1TxBuffer, datum)) {
+        LinkStatsCount(LINK_STATS_BYTES_OUT, 1);
+        LinkStatsRecordPeak(LINK_STATS_TX_PEAK, uart1TxBuffer.dataSize);
+    } else {
+        LinkStatsCount(LINK_STATS_TX_OVERFLOWS, 1);
+    }
     Uart1StartTransmission();
 }
 
@@ -112,8 +123,14 @@ void Uart1WriteByte(uint8_t datum)
  */
 int Uart1WriteData(const void *data, size_t length)
 {
+    uint8_t overflows = uart1TxBuffer.overflowCount;
     int success = CB_WriteMany(&uart1TxBuffer, data, length, FALSE);
 
+    // the buffer keeps as much as fits, the rest is lost
+    overflows = uart1TxBuffer.overflowCount - overflows;
+    LinkStatsCount(LINK_STATS_BYTES_OUT, length - overflows);
+    LinkStatsCount(LINK_STATS_TX_OVERFLOWS, overflows);
+    LinkStatsRecordPeak(LINK_STATS_TX_PEAK, uart1TxBuffer.dataSize);
     Uart1StartTransmission();
 
     return success;
@@ -127,11 +144,16 @@ void __ISR(_UART_1_VECTOR, ipl6auto) Uart1Interrupt(void)
     if (IFS0bits.U1RXIF) {
         // Keep receiving new bytes while the buffer has data.
         while (U1STAbits.URXDA == 1) {
-            CB_WriteByte(&uart1RxBuffer, (uint8_t) U1RXREG);
+            LinkStatsCount(LINK_STATS_BYTES_IN, 1);
+            if (!CB_WriteByte(&uart1RxBuffer, (uint8_t) U1RXREG)) {
+                LinkStatsCount(LINK_STATS_RX_OVERFLOWS, 1);
+            }
         }
+        LinkStatsRecordPeak(LINK_STATS_RX_PEAK, uart1RxBuffer.dataSize);
 
-        // Clear buffer overflow bit if triggered
+        // Clear buffer overflow bit if triggered, bytes have been lost
         if (U1STAbits.OERR == 1) {
+            LinkStatsCount(LINK_STATS_UART_OVERRUNS, 1);
             U1STAbits.OERR = 0;
         }
 
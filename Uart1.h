@@ -11,6 +11,26 @@
 
 #include "CircularBuffer.h"
 
+/**
+ * The sizes of the receive and transmit ring buffers, in bytes.  Each must be a power of two.
+ * The defaults hold the most an agent sends without waiting to hear back, as measured by the soak
+ * test in BattleBoatsSim.c, with room to spare.  TRACE_MODE writes a lot more than that, so
+ * builds that use it need a bigger TX buffer, and a bigger RX buffer on the other board.
+ */
+#ifndef UART1_RX_BUFFER_SIZE
+#define UART1_RX_BUFFER_SIZE 128
+#endif
+#ifndef UART1_TX_BUFFER_SIZE
+#define UART1_TX_BUFFER_SIZE 128
+#endif
+
+#if UART1_RX_BUFFER_SIZE < 2 || (UART1_RX_BUFFER_SIZE & (UART1_RX_BUFFER_SIZE - 1)) != 0
+#error "UART1_RX_BUFFER_SIZE must be a power of two"
+#endif
+#if UART1_TX_BUFFER_SIZE < 2 || (UART1_TX_BUFFER_SIZE & (UART1_TX_BUFFER_SIZE - 1)) != 0
+#error "UART1_TX_BUFFER_SIZE must be a power of two"
+#endif
+
 /**
  * Initializes the UART1 peripheral according to the BRG SFR value passed to it.
  * @param brgRegister The value to be placed in the BRG register.
@@ -36,6 +56,12 @@ uint8_t Uart1HasData(void);
  */
 int Uart1ReadByte(uint8_t *datum);
 
+/**
+ * Returns how many more bytes can be queued for transmission without any being lost.
+ * @return The free space in the TX buffer for UART1.
+ */
+uint16_t Uart1TxSpace(void);
+
 /**
  * This function starts a transmission sequence after enqueuing a single byte into
  * the buffer.